@@ -0,0 +1,59 @@
+/* BENCH_UTIL.C */
+
+/* clock_gettime() is POSIX, the rest of the build is plain C99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include "bench_util.h"
+
+
+
+/**
+ * This function returns the time in seconds.
+ *
+ * @return Monotonic time
+*/
+double now(void){
+
+    /* Declaration of variables */
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * This function creates a cover which looks like a photo (smooth gradients with noise in the LSBs).
+ *
+ * @return Image or NULL if error
+*/
+image *synthetic_cover(void){
+
+    /* Declaration and initialization of variables */
+    image *img = create_image(BENCH_WIDTH, BENCH_HEIGHT);
+    unsigned long seed = 12345;
+    byte *px;
+    int x, y;
+
+    if (!img) {
+        return NULL;
+    }
+
+    for (y = 0; y < img->height; y++) {
+
+        px = IMAGE_ROW(img, y);
+
+        for (x = 0; x < img->width; x++, px += 3) {
+
+            seed = seed * 1103515245UL + 12345UL;
+
+            px[0] = (byte)(x * 255 / img->width) ^ (byte)((seed >> 16) & 0x01);
+            px[1] = (byte)(y * 255 / img->height) ^ (byte)((seed >> 18) & 0x01);
+            px[2] = (byte)((x + y) * 127 / (img->width + img->height) + 64) ^ (byte)((seed >> 20) & 0x01);
+        }
+    }
+
+    return img;
+}
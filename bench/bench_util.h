@@ -0,0 +1,36 @@
+/* BENCH_UTIL.H */
+
+/* Inclusion guard */
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include "image.h"
+
+
+/* Defines */
+
+/* Size of the synthetic cover (used if no picture is given) */
+#define BENCH_WIDTH 2048
+#define BENCH_HEIGHT 1536
+
+
+
+/* Prototypes */
+
+/**
+ * This function returns the time in seconds.
+ *
+ * @return Monotonic time
+*/
+double now(void);
+
+
+/**
+ * This function creates a cover which looks like a photo (smooth gradients with noise in the LSBs).
+ *
+ * @return Image or NULL if error
+*/
+image *synthetic_cover(void);
+
+
+#endif
@@ -0,0 +1,231 @@
+/* COVER_FORMATS.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include "bmp_lib.h"
+#include "png_lib.h"
+#include "qoi_lib.h"
+#include "bench_util.h"
+
+
+/* Defines */
+
+/* Writes and reads of every format (the fastest ones are reported) */
+#define BENCH_ROUNDS 3
+
+/* Files written by the benchmark */
+#define BENCH_BMP "cover_formats.out.bmp"
+#define BENCH_PNG "cover_formats.out.png"
+#define BENCH_QOI "cover_formats.out.qoi"
+
+/* Formats in the order of the rows of the table */
+#define FORMAT_COUNT 3
+
+
+
+/**
+ * This function writes the image in the format (the whole picture, as a hide does).
+ *
+ * @param format BMP, PNG or QOI
+ * @param img Image
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int write_cover(int format, image *img){
+
+    /* Declaration and initialization of variables */
+    BMP_HEAD head;
+    int row = (img->width * 3 + 3) & ~3;
+
+    switch (format) {
+
+        case BMP:
+
+            /* Bottom-up 24-bit BMP without a palette */
+            memset(&head, 0, sizeof(BMP_HEAD));
+            head.id_field_1 = 'B';
+            head.id_field_2 = 'M';
+            head.offset = BMP_HEADER_SIZE;
+            head.size_of_raw = row * img->height;
+            head.size_of_bmp = head.offset + head.size_of_raw;
+            head.size_of_dib = BMP_HEADER_SIZE - 14;
+            head.width = img->width;
+            head.height = img->height;
+            head.planes = 1;
+            head.bits_per_pixel = BIT_PER_PIXEL;
+            head.path = BENCH_BMP;
+
+            return write_bmp(img, &head) == FAILURE ? FAILURE : SUCCESS;
+
+        case PNG:
+            return write_png_file(BENCH_PNG, img, PNG_PROFILE_DEFAULT) == FAILURE ? FAILURE : SUCCESS;
+
+        default:
+            return write_qoi_file(BENCH_QOI, img);
+    }
+}
+
+
+/**
+ * This function reads the picture written by write_cover.
+ *
+ * @param format BMP, PNG or QOI
+ *
+ * @return Image or NULL if error
+*/
+static image *read_cover(int format){
+
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    BMP_HEAD *head;
+    png_structp png;
+    png_infop info;
+    png_source src;
+    FILE *fp;
+    int code = 2;
+
+    switch (format) {
+
+        case BMP:
+
+            head = check_bmp(BENCH_BMP, &code);
+
+            if (head && read_bmp(head, &img) == FAILURE) {
+                img = NULL;
+            }
+
+            if (head) free_bmp_header(head);
+            return img;
+
+        case PNG:
+
+            fp = fopen(BENCH_PNG, "rb");
+
+            if (!fp) {
+                return NULL;
+            }
+
+            png_file_source(&src, fp, TRUE);
+
+            if (read_png(&src, &img, &png, &info, FALSE) == FAILURE) {
+                return NULL;
+            }
+
+            png_destroy_read_struct(&png, &info, NULL);
+            return img;
+
+        default:
+            return read_qoi(BENCH_QOI, &img, &code) == FAILURE ? NULL : img;
+    }
+}
+
+
+/**
+ * This function prints the time of writing and reading and the size of the picture as BMP, PNG and QOI.
+ *
+ * @param argc Count of arguments
+ * @param argv Array of arguments (optional 24-bit PNG picture)
+ *
+ * @return 0 if success, 1 if error
+*/
+int main(int argc, char *argv[]){
+
+    /* Declaration and initialization of variables */
+    static const char *names[FORMAT_COUNT] = {"bmp", "png", "qoi"};
+    static const char *files[FORMAT_COUNT] = {BENCH_BMP, BENCH_PNG, BENCH_QOI};
+    image *img = NULL, *back;
+    png_structp png;
+    png_infop info;
+    png_source src;
+    FILE *fp;
+    double start, write_best, read_best;
+    long size;
+    int format, round, y;
+
+    /* The given picture or the synthetic cover */
+    if (argc > 1) {
+
+        fp = fopen(argv[1], "rb");
+
+        if (fp) {
+            png_file_source(&src, fp, TRUE);
+        }
+
+        if (!fp || read_png(&src, &img, &png, &info, FALSE) == FAILURE) {
+            printf("Invalid picture: %s\n", argv[1]);
+            return 1;
+        }
+
+        png_destroy_read_struct(&png, &info, NULL);
+
+    } else {
+
+        img = synthetic_cover();
+
+        if (!img) {
+            printf("Error in main!\n");
+            return 1;
+        }
+    }
+
+    printf("%dx%d pixels, %ld bytes of pixel data\n", img->width, img->height, (long)img->width * img->height * 3);
+    printf("%-6s %10s %10s %12s %8s\n", "format", "write ms", "read ms", "bytes", "ratio");
+
+    for (format = 0; format < FORMAT_COUNT; format++) {
+
+        write_best = read_best = -1;
+
+        for (round = 0; round < BENCH_ROUNDS; round++) {
+
+            start = now();
+
+            if (write_cover(format, img) == FAILURE) {
+                free_image(img);
+                return 1;
+            }
+
+            if (write_best < 0 || now() - start < write_best) write_best = now() - start;
+
+            start = now();
+            back = read_cover(format);
+
+            if (!back) {
+                free_image(img);
+                return 1;
+            }
+
+            if (read_best < 0 || now() - start < read_best) read_best = now() - start;
+
+            /* Every format is lossless, the LSBs must survive */
+            for (y = 0; y < img->height; y++) {
+
+                if (memcmp(IMAGE_ROW(img, y), IMAGE_ROW(back, y), (size_t)img->width * 3) != 0) {
+                    printf("The %s picture differs in row %d!\n", names[format], y);
+                    free_image(back);
+                    free_image(img);
+                    return 1;
+                }
+            }
+
+            free_image(back);
+        }
+
+        /* Size of the written file */
+        fp = fopen(files[format], "rb");
+        size = -1;
+
+        if (fp && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+        if (fp) fclose(fp);
+
+        printf("%-6s %10.1f %10.1f %12ld %7.1f%%\n", names[format], write_best * 1000, read_best * 1000, size,
+               100.0 * size / ((double)img->width * img->height * 3));
+
+        remove(files[format]);
+    }
+
+    free_image(img);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* PNG_PROFILES.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <png.h>
+#include "png_lib.h"
+#include "bench_util.h"
+
+
+/* Defines */
+
+/* Encodings of every profile (the fastest one is reported) */
+#define BENCH_ROUNDS 3
+
+/* File written by the benchmark */
+#define BENCH_OUTPUT "png_profiles.out.png"
+
+
+
+/**
+ * This function prints the time and the size of the output of every PNG profile.
+ *
+ * @param argc Count of arguments
+ * @param argv Array of arguments (optional 24-bit PNG picture)
+ *
+ * @return 0 if success, 1 if error
+*/
+int main(int argc, char *argv[]){
+
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    png_structp png;
+    png_infop info;
+    png_source src;
+    FILE *fp;
+    double start, best;
+    long size;
+    int profile, round;
+
+    /* The given picture or the synthetic cover */
+    if (argc > 1) {
+
+        fp = fopen(argv[1], "rb");
+
+        if (fp) {
+            png_file_source(&src, fp, TRUE);
+        }
+
+        if (!fp || read_png(&src, &img, &png, &info, FALSE) == FAILURE) {
+            printf("Invalid picture: %s\n", argv[1]);
+            return 1;
+        }
+
+        png_destroy_read_struct(&png, &info, NULL);
+
+    } else {
+
+        img = synthetic_cover();
+
+        if (!img) {
+            printf("Error in main!\n");
+            return 1;
+        }
+    }
+
+    printf("%dx%d pixels, %ld bytes of pixel data\n", img->width, img->height, (long)img->width * img->height * 3);
+    printf("%-10s %10s %12s %8s\n", "profile", "ms", "bytes", "ratio");
+
+    for (profile = 0; profile < PNG_PROFILE_COUNT; profile++) {
+
+        best = -1;
+
+        for (round = 0; round < BENCH_ROUNDS; round++) {
+
+            start = now();
+
+            if (write_png_file(BENCH_OUTPUT, img, profile) == FAILURE) {
+                free_image(img);
+                return 1;
+            }
+
+            if (best < 0 || now() - start < best) best = now() - start;
+        }
+
+        /* Size of the written file */
+        fp = fopen(BENCH_OUTPUT, "rb");
+        size = -1;
+
+        if (fp && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+        if (fp) fclose(fp);
+
+        printf("%-10s %10.1f %12ld %7.1f%%\n", png_profile_name(profile), best * 1000, size,
+               100.0 * size / ((double)img->width * img->height * 3));
+    }
+
+    remove(BENCH_OUTPUT);
+    free_image(img);
+
+    return 0;
+}
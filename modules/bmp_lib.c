@@ -4,34 +4,134 @@
 #include <png.h>
 #include "bmp_lib.h"
 #include "pixel_secrets.h"
+#include "cpu_dispatch.h"
+#include "file_map.h"
+
+
+/* Source of the rows of a mapped BMP file */
+typedef struct {
+
+    /* Mapped file */
+    file_map map;
+
+    /* First byte of the pixel data and bytes of one row (with the align bytes) */
+    long offset;
+    int row_size;
+
+} bmp_source;
+
+
+/**
+ * This function rewrites only the changed rows of the BMP file (the header and the other rows stay).
+ * 
+ * @param img Image (tracking the changed rows)
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param row_size Bytes of one row in the file (with the align bytes)
+ * @param row Buffer for one row
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_bmp_rows(image *img, BMP_HEAD *bmp_header, int row_size, byte *row){
+
+    /* Declaration and initialization of variables */
+    FILE *fp;
+    int i, ret = SUCCESS;
+
+    /* Nothing changed, the file stays as it is */
+    if (count_dirty(img) == 0) {
+        return SUCCESS;
+    }
+
+    fp = fopen(bmp_header->path, "r+b");
+
+    if (!fp) {
+        printf("Error in write_bmp!\n");
+        return FAILURE;
+    }
+
+    for (i = 0; i < bmp_header->height && ret == SUCCESS; i++) {
+
+        if (!img->dirty[i]) continue;
+
+        get_kernels()->swizzle(row, IMAGE_ROW(img, i), bmp_header->width);
+
+        /* Rows are stored in the order they were read */
+        if (fseek(fp, bmp_header->offset + (long)i * row_size, SEEK_SET) != 0
+            || fwrite(row, 1, bmp_header->width * sizeof(pixel), fp) != bmp_header->width * sizeof(pixel)) {
+            printf("Error in write_bmp!\n");
+            ret = FAILURE;
+        }
+    }
+
+    if (fclose(fp) != 0) ret = FAILURE;
+
+    return ret;
+}
+
+
+/**
+ * This function returns the count of rows moved by one read or write.
+ * 
+ * @param row_size Bytes of one row in the file (with the align bytes)
+ * @param height Count of rows
+ * 
+ * @return Count of rows (at least 1)
+*/
+static int chunk_rows(int row_size, int height){
+
+    /* Declaration and initialization of variables */
+    long rows = BMP_IO_CHUNK / row_size;
+
+    if (rows < 1) rows = 1;
+    if (rows > height) rows = height;
+
+    return (int)rows;
+}
 
 
 /**
  * This function writes the BMP file.
  * 
- * @param filename Name of the file
- * @param png_row_pointers Array of png_bytep
+ * @param img Image
  * @param bmp_data Pointer to the BMP_data structure
  * 
  * @return SUCCESS or FAILURE
 */
-int write_bmp(png_bytep **png_row_pointers, BMP_HEAD *bmp_header) {
+int write_bmp(image *img, BMP_HEAD *bmp_header) {
 
     /* Declaration and initialization of variables */
     FILE *fp;
-    png_bytep *row_pointers;
     int align = 0,
-    i, j;
-    byte b;
+    i, j, rows, row_size, ret = 0;
+    byte *block = NULL;
 
     /* Sanity check */
-    if (!bmp_header || !png_row_pointers) {
+    if (!bmp_header || !img) {
+        printf("Error in write_bmp!\n");
+        return FAILURE;
+    }
+
+    /* Calculate align bytes */
+    align = (ALIGN - ( (bmp_header->width * sizeof(pixel) ) % ALIGN) ) % ALIGN;
+    row_size = bmp_header->width * sizeof(pixel) + align;
+    rows = chunk_rows(row_size, bmp_header->height);
+
+    /* Allocate memory for a chunk of rows of the file (align bytes are zero) */
+    block = (byte *)calloc((size_t)rows * row_size, 1);
+
+    if (!block) {
         printf("Error in write_bmp!\n");
         return FAILURE;
     }
 
-    /* Get the png_row_pointers */  
-    row_pointers = *png_row_pointers;
+    /* Only the changed rows are written */
+    if (img->dirty) {
+
+        i = write_bmp_rows(img, bmp_header, row_size, block);
+        free(block);
+
+        return i == FAILURE ? FAILURE : 0;
+    }
 
     /* Open the file */
     fp = fopen(bmp_header->path , "wb");
@@ -39,44 +139,47 @@ int write_bmp(png_bytep **png_row_pointers, BMP_HEAD *bmp_header) {
     /* Check if the file was opened */
     if (!fp) {
 
+        free(block);
         printf("Error in write_bmp!\n");
         return FAILURE;
     }
 
+    /* The chunks are written in one call each */
+    setvbuf(fp, NULL, _IONBF, 0);
 
-    /* Write header */
-    fwrite(bmp_header, 1, bmp_header->offset, fp);
+    /* Write header (the fixed part and everything up to the pixel data) */
+    if (fwrite(bmp_header, 1, BMP_HEADER_SIZE, fp) != BMP_HEADER_SIZE
+        || (bmp_header->offset > BMP_HEADER_SIZE && fwrite(bmp_header->extra, 1, bmp_header->offset - BMP_HEADER_SIZE, fp) != (size_t)(bmp_header->offset - BMP_HEADER_SIZE))) {
+        ret = FAILURE;
+    }
 
-    /* Calculate align bytes */
-    align = (ALIGN - ( (bmp_header->width * sizeof(pixel) ) % ALIGN) ) % ALIGN;
 
+    /* Write pixel data */
+    for (i = 0; i < bmp_header->height && ret != FAILURE; i += rows) {
 
+        if (rows > bmp_header->height - i) rows = bmp_header->height - i;
 
-    /* Write pixel data */
-    for (i = 0; i < bmp_header->height; i++) {
-
-        for (j = 0; j < bmp_header->width; j++) {
-                
-            /* Write pixel data b, g,r */
-            b = row_pointers[i][3 * j + 2];
-            fwrite(&b, sizeof(byte), 1, fp);
-            b = row_pointers[i][3 * j + 1];
-            fwrite(&b, sizeof(byte), 1, fp);
-            b = row_pointers[i][3 * j];
-            fwrite(&b, sizeof(byte), 1, fp);
+        /* Convert r, g, b to b, g, r */
+        for (j = 0; j < rows; j++) {
+            get_kernels()->swizzle(block + (long)j * row_size, IMAGE_ROW(img, i + j), bmp_header->width);
         }
 
-        /* Write align bytes */
-        for (j = 0; j < align; j++) {
-            fwrite("\0", 1, 1, fp);
+        /* Write the rows with align bytes */
+        if (fwrite(block, 1, (size_t)rows * row_size, fp) != (size_t)rows * row_size) {
+            ret = FAILURE;
         }
 
     }
 
     /* Close the file */
-    fclose(fp);
+    if (fclose(fp) != 0) ret = FAILURE;
+    free(block);
 
-    return 0;
+    if (ret == FAILURE) {
+        printf("Error in write_bmp!\n");
+    }
+
+    return ret;
 
 
 
@@ -89,21 +192,21 @@ int write_bmp(png_bytep **png_row_pointers, BMP_HEAD *bmp_header) {
  * This function reads the BMP file.
  * 
  * @param bmp_data Pointer to the BMP_data structure
- * @param png_row_pointers Array of png_bytep
+ * @param img Pointer to the image (allocated here)
  * 
  * @return SUCCESS or FAILURE
  * 
 */
-int read_bmp(BMP_HEAD *bmp_header, png_bytep **png_row_pointers){
+int read_bmp(BMP_HEAD *bmp_header, image **img){
 
     /* Declaration and initialization of variables */
     FILE *fp = NULL;
-    int i, j, align = 0;
-    pixel **bmp_row_pointers = NULL;
-    byte b;
+    int i, j, rows, align = 0, row_size;
+    size_t got;
+    byte *block = NULL;
 
     /* Sanity check */
-    if (!bmp_header || !png_row_pointers) {
+    if (!bmp_header || !img) {
         return FAILURE;
     }
 
@@ -116,102 +219,451 @@ int read_bmp(BMP_HEAD *bmp_header, png_bytep **png_row_pointers){
         return FAILURE;
     }
 
-    /* Move the pointer to the beginning of the pixel data */
-    fseek(fp, bmp_header->offset, SEEK_SET); 
+    /* The chunks are read in one call each */
+    setvbuf(fp, NULL, _IONBF, 0);
 
     /* Calculate align bytes */
     align = (ALIGN - ( (bmp_header->width * sizeof(pixel) ) % ALIGN) ) % ALIGN;
+    row_size = bmp_header->width * sizeof(pixel) + align;
+    rows = chunk_rows(row_size, bmp_header->height);
 
-    /* Allocate memory for BMP pixel data */
-    bmp_row_pointers = (pixel **) malloc(sizeof(pixel *) * (bmp_header->height));
+    /* Allocate the image (the stride of a row fits the align bytes too) and a chunk of rows of the file */
+    *img = create_image(bmp_header->width, bmp_header->height);
+    block = (byte *)malloc((size_t)rows * row_size);
+
+    /* Keep the rest of the header (it is written back unchanged) */
+    if (bmp_header->offset > BMP_HEADER_SIZE) {
+        bmp_header->extra = (byte *)malloc(bmp_header->offset - BMP_HEADER_SIZE);
+    }
+
+    /* Check if the memory was allocated and read the rest of the header */
+    if (!(*img) || !block || fseek(fp, BMP_HEADER_SIZE, SEEK_SET) != 0
+        || (bmp_header->offset > BMP_HEADER_SIZE
+            && (!bmp_header->extra || fread(bmp_header->extra, 1, bmp_header->offset - BMP_HEADER_SIZE, fp) != (size_t)(bmp_header->offset - BMP_HEADER_SIZE)))) {
 
-    /* Check if the memory was allocated */
-    if (!bmp_row_pointers) {
         fclose(fp);
+        free(block);
+        free_image(*img);
+        *img = NULL;
         printf("Error in read_bmp!\n");
         return FAILURE;
     }
 
 
     /* Read pixel data */
-    for (i = 0; i < bmp_header->height; i++) {
+    for (i = 0; i < bmp_header->height; i += rows) {
+
+        if (rows > bmp_header->height - i) rows = bmp_header->height - i;
 
-        /* Allocate memory for the row */
-        bmp_row_pointers[i] = (pixel *)malloc(sizeof(pixel) * (bmp_header->width));
+        /* Read the rows with the align bytes (they may be missing after the last row) */
+        got = fread(block, 1, (size_t)rows * row_size, fp);
 
-        /* Check if the memory was allocated */
-        if (!bmp_row_pointers[i]) {
+        if (got < (size_t)(rows - 1) * row_size + bmp_header->width * sizeof(pixel)) {
 
             fclose(fp);
+            free(block);
+            free_image(*img);
+            *img = NULL;
             printf("Error in read_bmp!\n");
             return FAILURE;
         }
 
-        for (j = 0; j < bmp_header->width; j++) {
+        /* Convert b, g, r to r, g, b */
+        for (j = 0; j < rows; j++) {
+            get_kernels()->swizzle(IMAGE_ROW(*img, i + j), block + (long)j * row_size, bmp_header->width);
+        }
+    }
 
-            /* Read pixel data b,g,r */
-            fread(&b, sizeof(byte), 1, fp);
-            (bmp_row_pointers[i][j]).b = b;
-            fread(&b, sizeof(byte), 1, fp);
-            (bmp_row_pointers[i][j]).g = b;
-            fread(&b, sizeof(byte), 1, fp);
-            (bmp_row_pointers[i][j]).r = b;
 
+    fclose(fp);
+    free(block);
 
+    return SUCCESS;
+}
 
-        }
 
-        /* Skip align bytes */
-        fseek(fp, align, SEEK_CUR);
+/**
+ * This function loads the rows of the picture from the mapped file (task of need_rows).
+ * 
+ * @param img Image
+ * @param from First row to be loaded
+ * @param to Row after the last one
+ * 
+ * @return SUCCESS
+*/
+static int load_mapped_rows(image *img, int from, int to){
+
+    /* Declaration and initialization of variables */
+    bmp_source *src = (bmp_source *)img->source;
+    int i;
+
+    /* Convert b, g, r to r, g, b (only these pages of the file are read) */
+    for (i = from; i < to; i++) {
+        get_kernels()->swizzle(IMAGE_ROW(img, i), src->map.data + src->offset + (long)i * src->row_size, img->width);
     }
 
+    return SUCCESS;
+}
 
-    fclose(fp);
 
+/**
+ * This function maps the BMP file for the image (the rows are loaded when they are needed).
+ * 
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param src Source to be filled
+ * @param writable TRUE to change the file through the map
+ * 
+ * @return Image (no row loaded) or NULL if error
+*/
+static image *map_bmp(BMP_HEAD *bmp_header, bmp_source *src, int writable){
 
-    /* Convert data in png_bytep */
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    int align = (ALIGN - ( (bmp_header->width * sizeof(pixel) ) % ALIGN) ) % ALIGN;
 
-    /* Allocate memory for PNG pixel data */
-    *png_row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * (bmp_header->height));
+    src->offset = bmp_header->offset;
+    src->row_size = bmp_header->width * sizeof(pixel) + align;
 
-    /* Check if the memory was allocated */
-    if (!(*png_row_pointers)) {
+    if (map_file(&src->map, bmp_header->path, writable) == FAILURE) {
+        return NULL;
+    }
+
+    /* Every row must be in the file (the align bytes may be missing after the last row) */
+    if (bmp_header->width <= 0 || bmp_header->height <= 0
+        || src->map.size < src->offset + (long)(bmp_header->height - 1) * src->row_size + bmp_header->width * (long)sizeof(pixel)) {
+        unmap_file(&src->map);
+        return NULL;
+    }
+
+    /* The pixels of rows which are never loaded are never touched */
+    img = create_image(bmp_header->width, bmp_header->height);
+
+    if (!img) {
+        unmap_file(&src->map);
+        return NULL;
+    }
+
+    img->loaded = 0;
+    img->load = load_mapped_rows;
+    img->source = src;
+
+    return img;
+}
+
+
+/**
+ * This function hides the payload by patching only the changed rows of the mapped BMP file.
+ * 
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param payload_path Path to the payload
+ * @param opts Options
+ * 
+ * @return 0 if success, 3 if picture is not big enough, 6 different error
+*/
+static int hide_in_place(BMP_HEAD *bmp_header, char *payload_path, options *opts){
+
+    /* Declaration and initialization of variables */
+    bmp_source src;
+    options patch = *opts;
+    image *img = NULL;
+    int i, first = -1, last = -1, ret;
+
+    img = map_bmp(bmp_header, &src, TRUE);
+
+    if (!img) {
         printf("Error in read_bmp!\n");
+        return 6;
+    }
+
+    /* The same payload is already hidden, nothing to compress, embed or write */
+    if (payload_hidden(img, payload_path, opts)) {
+
+        printf("Payload is already hidden in the picture!\n");
+        free_image(img);
+        unmap_file(&src.map);
+        return 0;
+    }
+
+    /* Only the pixels which differ are written, their rows are tracked */
+    patch.delta = TRUE;
+    ret = hide_in_image(img, payload_path, &patch);
+
+    /* Write the changed rows back (b, g, r) */
+    for (i = 0; ret == 0 && i < img->height; i++) {
+
+        if (!img->dirty || !img->dirty[i]) continue;
+
+        get_kernels()->swizzle(src.map.data + src.offset + (long)i * src.row_size, IMAGE_ROW(img, i), img->width);
+
+        if (first < 0) first = i;
+        last = i;
+    }
+
+    if (first >= 0 && flush_range(&src.map, src.offset + (long)first * src.row_size,
+                                  (long)(last - first) * src.row_size + img->width * (long)sizeof(pixel), opts->sync) == FAILURE) {
+        ret = 6;
+    }
+
+    if (ret == 0) {
+        printf("In place: %d row(s) written\n", count_dirty(img));
+    }
+
+    free_image(img);
+    unmap_file(&src.map);
+
+    return ret;
+}
+
+
+/**
+ * This function hides the payload in a copy of the BMP file (the picture itself is not changed).
+ * The copy shares the blocks of the picture if the file system can do it, then only the changed rows are patched.
+ * 
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param payload_path Path to the payload
+ * @param opts Options (the output path)
+ * 
+ * @return 0 if success, 3 if picture is not big enough, 6 different error
+*/
+static int hide_in_copy(BMP_HEAD *bmp_header, char *payload_path, options *opts){
+
+    /* Declaration and initialization of variables */
+    char *picture = bmp_header->path;
+    int ret;
+
+    ret = clone_file(picture, opts->output);
+
+    if (ret == FAILURE) {
+        return 6;
+    }
+
+    printf("Output: %s\n", ret == CLONE_REFLINK ? "blocks shared with the picture" : ret == CLONE_RANGE ? "copied by the kernel" : "copied");
+
+    /* The copy is patched in place */
+    bmp_header->path = opts->output;
+    ret = hide_in_place(bmp_header, payload_path, opts);
+    bmp_header->path = picture;
+
+    /* No half written picture is left */
+    if (ret != 0) {
+        remove(opts->output);
+    }
+
+    return ret;
+}
+
+
+/**
+ * This function extracts the payload from the mapped BMP file.
+ * Only the rows holding the header and the body are read (the pages of the other rows are never touched).
+ * 
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param to Path to the file where the payload will be written
+ * @param opts Options
+ * 
+ * @return 0 if success, 4 no hidden content, 5 damaged content, 6 different error, FAILURE if the file cannot be mapped
+*/
+static int extract_mapped(BMP_HEAD *bmp_header, char *to, options *opts){
+
+    /* Declaration and initialization of variables */
+    bmp_source src;
+    image *img = NULL;
+    int ret;
+
+    img = map_bmp(bmp_header, &src, FALSE);
+
+    if (!img) {
         return FAILURE;
     }
 
-    /* Convert data */
-    for (i = 0; i < bmp_header->height; i++) {
-        
-        /* Allocate memory for the row */
-        (*png_row_pointers)[i] = (png_byte *)malloc(3 * (bmp_header->width));
+    ret = extract_from_image(img, to, opts);
 
-        /* Check if the memory was allocated */
-        if (!(*png_row_pointers)[i]) {
-            printf("Error in read_bmp!\n");
+    free_image(img);
+    unmap_file(&src.map);
+
+    return ret;
+}
+
+
+/**
+ * This function copies count bytes (or everything up to the end of the file if count is negative) between the files.
+ * 
+ * @param in File to be read
+ * @param out File to be written
+ * @param count Count of bytes (negative for the rest of the file)
+ * @param block Buffer
+ * @param size Size of the buffer
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int copy_bytes(FILE *in, FILE *out, long count, byte *block, long size){
+
+    /* Declaration of variables */
+    size_t n;
+
+    while (count != 0) {
+
+        n = fread(block, 1, (size_t)(count > 0 && count < size ? count : size), in);
+
+        if (n == 0) {
+            return count > 0 ? FAILURE : SUCCESS;
+        }
+
+        if (fwrite(block, 1, n, out) != n) {
             return FAILURE;
         }
 
-        for (j = 0; j < bmp_header->width; j++) {
+        if (count > 0) count -= (long)n;
+    }
+
+    return SUCCESS;
+}
 
-            (*png_row_pointers)[i][3 * j] = bmp_row_pointers[i][j].r;
-            (*png_row_pointers)[i][3 * j + 1] = bmp_row_pointers[i][j].g;
-            (*png_row_pointers)[i][3 * j + 2] = bmp_row_pointers[i][j].b;
 
+/**
+ * This function hides the payload while the BMP file is copied to the output (window by window of rows).
+ * Only one window of rows and the payload are in memory, the rows after the body are copied in big blocks.
+ * The copy is written next to the output (or the picture) and replaces it when it is complete.
+ * 
+ * @param bmp_header Pointer to the BMP_HEAD structure
+ * @param payload_path Path to the payload
+ * @param opts Options (the output path, NULL to replace the picture)
+ * 
+ * @return 0 if success, 2 if the pixel data are missing, 3 if picture is not big enough, 6 different error
+*/
+static int hide_streamed(BMP_HEAD *bmp_header, char *payload_path, options *opts){
+
+    /* Declaration and initialization of variables */
+    int align = (ALIGN - ( (bmp_header->width * sizeof(pixel) ) % ALIGN) ) % ALIGN;
+    int row_size = bmp_header->width * sizeof(pixel) + align;
+    int window, body, pass, i, j, n, ret;
+    long start = bmp_header->offset;
+    char *target = opts->output ? opts->output : bmp_header->path, *part = NULL;
+    FILE *in = NULL, *out = NULL;
+    image *win = NULL;
+    byte *block = NULL;
+    hide_plan plan;
+    size_t got;
+
+    if (bmp_header->width <= 0 || bmp_header->height <= 0) {
+        return 2;
+    }
+
+    ret = make_hide_plan(&plan, payload_path, opts, bmp_header->width, bmp_header->height);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Rows of one window */
+    window = (int)(BMP_STREAM_WINDOW / row_size);
+    body = plan_rows(&plan);
+    if (window < 1) window = 1;
+    if (window > body) window = body;
+
+    in = fopen(bmp_header->path, "rb");
+    part = part_path(target);
+    out = part ? fopen(part, "wb") : NULL;
+    win = create_image(bmp_header->width, window);
+    block = (byte *)malloc((size_t)window * row_size);
+
+    if (!in || !out || !win || !block) {
+        printf("Error in hide_streamed!\n");
+        ret = 6;
+    }
+
+    if (ret == 0) {
+
+        /* The windows are moved in one call each */
+        setvbuf(in, NULL, _IONBF, 0);
+        setvbuf(out, NULL, _IONBF, 0);
+
+        /* Header (everything up to the pixel data) */
+        if (copy_bytes(in, out, start, block, (long)window * row_size) == FAILURE) {
+            printf("Error in hide_streamed!\n");
+            ret = 6;
         }
+    }
+
+    /* Matrix embedding reads the cover bits of every window first, then the windows are read again and written */
+    for (pass = plan.lay.matrix ? 0 : 1; ret == 0 && pass < 2; pass++) {
+
+        if (fseek(in, start, SEEK_SET) != 0) {
+            ret = 6;
+            break;
+        }
+
+        for (i = 0; ret == 0 && i < body; i += n) {
+
+            n = body - i < window ? body - i : window;
+
+            /* The align bytes may be missing after the last row */
+            got = fread(block, 1, (size_t)n * row_size, in);
+
+            if (got < (size_t)(n - 1) * row_size + bmp_header->width * sizeof(pixel)) {
+                printf("Error in read_bmp!\n");
+                ret = 2;
+                break;
+            }
 
+            /* Convert b, g, r to r, g, b */
+            for (j = 0; j < n; j++) {
+                get_kernels()->swizzle(IMAGE_ROW(win, j), block + (long)j * row_size, bmp_header->width);
+            }
+
+            if (pass == 0) {
+                plan_read_window(&plan, win, i, n);
+                continue;
+            }
+
+            plan_write_window(&plan, win, i, n);
+
+            /* Convert r, g, b back to b, g, r (the align bytes stay) */
+            for (j = 0; j < n; j++) {
+                get_kernels()->swizzle(block + (long)j * row_size, IMAGE_ROW(win, j), bmp_header->width);
+            }
+
+            if (fwrite(block, 1, got, out) != got) {
+                printf("Error in hide_streamed!\n");
+                ret = 6;
+            }
+        }
+
+        if (ret == 0 && pass == 0 && plan_encode(&plan, opts->threads) == FAILURE) {
+            ret = 6;
+        }
     }
 
+    /* Rows after the body and everything after the pixel data */
+    if (ret == 0 && copy_bytes(in, out, -1, block, (long)window * row_size) == FAILURE) {
+        printf("Error in hide_streamed!\n");
+        ret = 6;
+    }
 
-    /* Free the pixels */
-    for (i = 0; i < bmp_header->height; i++) {
-        free(bmp_row_pointers[i]);
+    if (out && fclose(out) != 0 && ret == 0) {
+        printf("Error in hide_streamed!\n");
+        ret = 6;
     }
 
-    /* Free the rows */
-    free(bmp_row_pointers);
+    if (in) fclose(in);
+    free(block);
+    free_image(win);
+    free_hide_plan(&plan);
 
-    return SUCCESS;
+    /* No half written picture is left */
+    if (ret == 0 && replace_file(part, target) == FAILURE) {
+        ret = 6;
+    } else if (ret != 0 && out) {
+        remove(part);
+    }
+
+    if (ret == 0) {
+        printf("Data hidden successfully!\nStream: %d of %d row(s) embedded in windows of %d row(s)\n", body, bmp_header->height, window);
+    }
+
+    free(part);
+
+    return ret;
 }
 
 
@@ -231,7 +683,8 @@ void free_bmp_header(BMP_HEAD *bmp_header){
         return;
     }
     
-    /* Free the path */
+    /* Free the rest of the header and the structure */
+    free(bmp_header->extra);
     free(bmp_header);
 
     /* Set the pointer to NULL */
@@ -244,10 +697,11 @@ void free_bmp_header(BMP_HEAD *bmp_header){
  * This checks the BMP file and returns the BMP_data structure.
  * 
  * @param path Path to the file
+ * @param code Set to 1 if the file cannot be opened (not changed otherwise)
  * 
  * @return Pointer to the BMP_data structure or NULL if error
 */
-BMP_HEAD *check_bmp(char *path){
+BMP_HEAD *check_bmp(char *path, int *code){
 
     /* Declaration and initialization of variables */
 
@@ -277,11 +731,12 @@ BMP_HEAD *check_bmp(char *path){
     file = fopen(path, "rb");
 
 
-    /* Check if the file was opened */
+    /* Check if the file was opened (the paths are not checked before) */
     if (!file ) {
 
-        printf("Error in check_bmp!\n");
+        printf("Invalid path: %s\n", path);
         free(bmp_header);
+        *code = 1;
         return NULL;
 
     }
@@ -297,8 +752,9 @@ BMP_HEAD *check_bmp(char *path){
     }
 
 
-    /* Check if the file is BMP and if it is 24-bit BMP */
-    if ( !( (bmp_header->id_field_1 == BMP_TYPE[0]) && (bmp_header->id_field_2 == BMP_TYPE[1]) ) || (bmp_header->bits_per_pixel != BIT_PER_PIXEL)) {
+    /* Check if the file is BMP and if it is 24-bit BMP (the pixel data follow the header) */
+    if ( !( (bmp_header->id_field_1 == BMP_TYPE[0]) && (bmp_header->id_field_2 == BMP_TYPE[1]) ) || (bmp_header->bits_per_pixel != BIT_PER_PIXEL)
+        || bmp_header->offset < BMP_HEADER_SIZE) {
        
         printf("Invalid BMP sub-format!\nPlease use a %d-bit BMP file.\n", BIT_PER_PIXEL);
         free(bmp_header);
@@ -311,6 +767,7 @@ BMP_HEAD *check_bmp(char *path){
     fclose(file);
 
     bmp_header->path = path;
+    bmp_header->extra = NULL;
 
     /* Return the pointer to the structure */
     return bmp_header;
@@ -322,14 +779,15 @@ BMP_HEAD *check_bmp(char *path){
  * 
  * @param paths Array of paths
  * @param sw Switch
+ * @param opts Options
  * 
  * @return 0 if success, 2 not in correct format, 3 if picture is not big enough, 4 no hidden content, 5 damaged content ,6 different error
 */
-int proceed_bmp(char **paths, char sw){
+int proceed_bmp(char **paths, char sw, options *opts){
 
     /* Declaration of variables */
 	BMP_HEAD *bmp_header;
-	png_bytep *row_pointers = NULL;
+	image *img = NULL;
 
     /* Sanity check */
     if (!paths) {
@@ -343,40 +801,86 @@ int proceed_bmp(char **paths, char sw){
 
 	/* Read bmp file */
 
-	bmp_header = check_bmp(paths[0]);
+	ret = 2;
+	bmp_header = check_bmp(paths[0], &ret);
 
-	/* If bmp_data is NULL, then the file is not bmp or not in correct format */
+	/* If bmp_data is NULL, then the file is missing, not bmp or not in correct format */
 	if (!bmp_header) {
     
-		return 2;
+		return ret;
 	}
 
-	ret = read_bmp(bmp_header, &row_pointers);
+	/* Patch the file in place */
+	if (sw == 'h' && opts->in_place) {
+
+		ret = hide_in_place(bmp_header, paths[1], opts);
+		free_bmp_header(bmp_header);
+		return ret;
+	}
+
+	/* Hide window by window into the output */
+	if (sw == 'h' && opts->stream) {
+
+		ret = hide_streamed(bmp_header, paths[1], opts);
+		free_bmp_header(bmp_header);
+		return ret;
+	}
+
+	/* Patch only the changed rows of a copy of the picture */
+	if (sw == 'h' && opts->output) {
+
+		ret = hide_in_copy(bmp_header, paths[1], opts);
+		free_bmp_header(bmp_header);
+		return ret;
+	}
+
+	/* Extract from the mapped file (read the whole file if it cannot be mapped) */
+	if (sw == 'x') {
+
+		ret = extract_mapped(bmp_header, paths[1], opts);
+
+		if (ret != FAILURE) {
+			free_bmp_header(bmp_header);
+			return ret;
+		}
+	}
+
+	ret = read_bmp(bmp_header, &img);
     
+    /* The pixel data are missing - not in correct format */
     if (ret == FAILURE) {
 
         free_bmp_header(bmp_header);
-        return ret;
+        return 2;
     }
 
 
 	/* Hide the payload in file*/
 	if (sw == 'h') {
 
-		ret = hide_in_image(bmp_header->width, bmp_header->height, &row_pointers, paths[1]);
+		/* The same payload is already hidden, nothing to compress, embed or write */
+		if (payload_hidden(img, paths[1], opts)) {
 
-        if (ret == 3 || ret == 6) {
+			printf("Payload is already hidden in the picture!\n");
+			free_image(img);
+			free_bmp_header(bmp_header);
+			return 0;
+		}
+
+		ret = hide_in_image(img, paths[1], opts);
+
+        if (ret != 0) {
             
-            free_row_pointers(row_pointers, bmp_header->height);
+            free_image(img);
             free_bmp_header(bmp_header);
             return ret;
         }
 
-		ret = write_bmp(&row_pointers, bmp_header);
+		ret = write_bmp(img, bmp_header);
 
         if (ret == FAILURE) {
 
-            free_row_pointers(row_pointers, bmp_header->height);
+            free_image(img);
             free_bmp_header(bmp_header);
             return ret;
         
@@ -385,21 +889,19 @@ int proceed_bmp(char **paths, char sw){
 
 	} else if (sw == 'x') {
 
-		ret = extract_from_image(bmp_header->width, &row_pointers, paths[1]);
+		ret = extract_from_image(img, paths[1], opts);
 
 
 	} else {
 
 		printf("Wrong switch\n");
-		free_row_pointers(row_pointers, bmp_header->height);
-		free_bmp_header(bmp_header);
 		ret = 1;
 	
 	}
 
     /* Free the memory */
 
-	free_row_pointers(row_pointers, bmp_header->height);
+	free_image(img);
 	free_bmp_header(bmp_header);
 	return ret;
 
@@ -6,6 +6,8 @@
 
 
 #include "my_defs.h"
+#include "input.h"
+#include "image.h"
 
 
 /* Defines */
@@ -14,6 +16,12 @@
 #define BMP_HEADER_SIZE 54
 #define ALIGN 4
 
+/* Bytes of the file moved by one read or write of the pixel data */
+#define BMP_IO_CHUNK (1L << 20)
+
+/* Bytes of the pixel data in one window of rows of --stream */
+#define BMP_STREAM_WINDOW (4L << 20)
+
 
 /* Structures */
 
@@ -54,6 +62,9 @@ typedef struct {
     int imp_colors;
     char *path;
 
+    /* Bytes between the fixed header and the pixel data (offset - BMP_HEADER_SIZE), NULL if none */
+    byte *extra;
+
 
 }  __attribute__((__packed__)) BMP_HEAD;
 
@@ -69,25 +80,48 @@ typedef struct {
 void free_bmp_header(BMP_HEAD *bmp_header);
 
 
+/**
+ * This checks the BMP file and returns the BMP_data structure.
+ * 
+ * @param path Path to the file
+ * @param code Set to 1 if the file cannot be opened (not changed otherwise)
+ * 
+ * @return Pointer to the BMP_data structure or NULL if error
+*/
+BMP_HEAD *check_bmp(char *path, int *code);
+
+
+/**
+ * This function reads the BMP file.
+ * 
+ * @param bmp_data Pointer to the BMP_data structure
+ * @param img Pointer to the image (allocated here)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int read_bmp(BMP_HEAD *bmp_header, image **img);
+
+
 /**
  * This function writes the BMP file.
  * 
- * @param png_row_pointers Array of png_bytep (pixels of image)
+ * @param img Image
  * @param bmp_data Pointer to the BMP_data structure
  * 
  * @return SUCCESS or FAILURE
 */
-int write_bmp(png_bytep **png_row_pointers, BMP_HEAD *bmp_header);
+int write_bmp(image *img, BMP_HEAD *bmp_header);
 
 /**
  * This function process the BMP file (hide / extract data).
  * 
  * @param paths Array of paths to files
  * @param sw Switch
+ * @param opts Options
  * 
  * @return return code (0 if success, 2 not in correct format, 3 if error)
 */
-int proceed_bmp(char **paths, char sw);
+int proceed_bmp(char **paths, char sw, options *opts);
 
 
 
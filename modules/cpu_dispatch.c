@@ -0,0 +1,172 @@
+/* CPU_DISPATCH.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_dispatch.h"
+#include "kernels.h"
+
+
+/* Names of the tiers (index is the tier) */
+static const char *tier_names[TIER_COUNT] = {"scalar", "ssse3", "avx2", "avx512"};
+
+/* Selected kernels */
+static kernels active;
+
+/* TRUE once the kernels were selected */
+static int initialized = FALSE;
+
+
+
+/**
+ * This function returns the best tier supported by the CPU.
+ *
+ * @return One of the TIER_* defines
+*/
+int detect_tier(void){
+
+#ifdef X86_KERNELS
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return TIER_AVX512;
+    if (__builtin_cpu_supports("avx2")) return TIER_AVX2;
+    if (__builtin_cpu_supports("ssse3")) return TIER_SSSE3;
+
+#endif
+
+    return TIER_SCALAR;
+}
+
+
+/**
+ * This function converts the name of the tier to the tier.
+ *
+ * @param name Name of the tier (auto, scalar, ssse3, avx2, avx512)
+ *
+ * @return One of the TIER_* defines or FAILURE if the name is unknown
+*/
+int parse_tier(const char *name){
+
+    /* Declaration of variables */
+    int i;
+
+    /* Sanity check */
+    if (!name) {
+        printf("Error in parse_tier!\n");
+        return FAILURE;
+    }
+
+    if (strcmp(name, "auto") == 0) return TIER_AUTO;
+
+    for (i = 0; i < TIER_COUNT; i++) {
+        if (strcmp(name, tier_names[i]) == 0) return i;
+    }
+
+    return FAILURE;
+}
+
+
+/**
+ * This function selects the kernels for the best tier supported by the CPU.
+ *
+ * @param tier TIER_AUTO to detect the tier, otherwise the tier to be forced
+ *
+ * @return SUCCESS or FAILURE if the forced tier is not supported by the CPU
+*/
+int init_kernels(int tier){
+
+    /* Declaration and initialization of variables */
+    int best = detect_tier();
+
+    /* Sanity check */
+    if (tier < 0 || tier > TIER_AUTO) {
+        printf("Error in init_kernels!\n");
+        return FAILURE;
+    }
+
+    if (tier == TIER_AUTO) {
+        tier = best;
+    }
+
+    /* Forced tier must be supported by the CPU */
+    if (tier > best) {
+        printf("CPU does not support %s kernels (best is %s)!\n", tier_names[tier], tier_names[best]);
+        return FAILURE;
+    }
+
+    init_kernel_tables();
+
+    /* Scalar kernels */
+    active.name = tier_names[tier];
+    active.embed_lsb = embed_lsb_scalar;
+    active.extract_lsb = extract_lsb_scalar;
+    active.crc32 = crc32_scalar;
+    active.swizzle = swizzle_scalar;
+    active.deinterleave = deinterleave_scalar;
+    active.interleave = interleave_scalar;
+    active.blend_plane = blend_plane_scalar;
+    active.mask_plane = mask_plane_scalar;
+
+#ifdef X86_KERNELS
+
+    switch (tier) {
+        case TIER_AVX512: {
+            active.embed_lsb = embed_lsb_avx512;
+            active.extract_lsb = extract_lsb_avx512;
+            active.swizzle = swizzle_avx512;
+            active.deinterleave = deinterleave_avx2;
+            active.interleave = interleave_avx2;
+            active.blend_plane = blend_plane_avx512;
+            active.mask_plane = mask_plane_avx512;
+            break;
+        }
+        case TIER_AVX2: {
+            active.embed_lsb = embed_lsb_avx2;
+            active.extract_lsb = extract_lsb_avx2;
+            active.swizzle = swizzle_avx2;
+            active.deinterleave = deinterleave_avx2;
+            active.interleave = interleave_avx2;
+            active.blend_plane = blend_plane_avx2;
+            active.mask_plane = mask_plane_avx2;
+            break;
+        }
+        case TIER_SSSE3: {
+            active.embed_lsb = embed_lsb_ssse3;
+            active.extract_lsb = extract_lsb_ssse3;
+            active.swizzle = swizzle_ssse3;
+            active.deinterleave = deinterleave_ssse3;
+            active.interleave = interleave_ssse3;
+            active.blend_plane = blend_plane_ssse3;
+            active.mask_plane = mask_plane_ssse3;
+            break;
+        }
+    }
+
+    /* Carry-less multiplication comes with every SIMD tier we target, but check it anyway */
+    if (tier >= TIER_SSSE3 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        active.crc32 = crc32_pclmul;
+    }
+
+#endif
+
+    initialized = TRUE;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function returns the table of the selected kernels.
+ * (init_kernels() is called with TIER_AUTO if it was not called yet)
+ *
+ * @return Pointer to the kernel table
+*/
+const kernels *get_kernels(void){
+
+    if (!initialized) {
+        init_kernels(TIER_AUTO);
+    }
+
+    return &active;
+}
@@ -0,0 +1,97 @@
+/* CPU_DISPATCH.H */
+
+/* Inclusion guard */
+#ifndef __CPU_DISPATCH_H__
+#define __CPU_DISPATCH_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Kernel tiers (ordered from the slowest to the fastest) */
+#define TIER_SCALAR 0
+#define TIER_SSSE3 1
+#define TIER_AVX2 2
+#define TIER_AVX512 3
+#define TIER_COUNT 4
+
+/* Pick the best tier supported by the CPU */
+#define TIER_AUTO 4
+
+
+/* Structures */
+
+/* Table of the hot kernels, filled once at startup for the selected tier */
+typedef struct {
+
+    /* Name of the tier */
+    const char *name;
+
+    /* Writes count bits (one per byte, 0 or 1) into the LSB of the blue channel of count RGB pixels */
+    void (*embed_lsb)(byte *pixels, const byte *bits, int count);
+
+    /* Reads the LSB of the blue channel of count RGB pixels into bits (one per byte) */
+    void (*extract_lsb)(const byte *pixels, byte *bits, int count);
+
+    /* Calculates the CRC32 of length words (same result as the reference bitwise crc32b) */
+    dword (*crc32)(const word *message, int length);
+
+    /* Swaps the first and the third byte of count pixels (BGR <-> RGB), dst may be equal to src */
+    void (*swizzle)(byte *dst, const byte *src, int count);
+
+    /* Splits count RGB pixels into the planes r, g and b */
+    void (*deinterleave)(byte *r, byte *g, byte *b, const byte *pixels, int count);
+
+    /* Joins the planes r, g and b into count RGB pixels */
+    void (*interleave)(byte *pixels, const byte *r, const byte *g, const byte *b, int count);
+
+    /* Replaces the bits of mask in count bytes of the plane by the bits of the values */
+    void (*blend_plane)(byte *plane, const byte *values, byte mask, int count);
+
+    /* Reads the bits of mask of count bytes of the plane into the values */
+    void (*mask_plane)(const byte *plane, byte *values, byte mask, int count);
+
+} kernels;
+
+
+/* Prototypes */
+
+/**
+ * This function selects the kernels for the best tier supported by the CPU.
+ *
+ * @param tier TIER_AUTO to detect the tier, otherwise the tier to be forced
+ *
+ * @return SUCCESS or FAILURE if the forced tier is not supported by the CPU
+*/
+int init_kernels(int tier);
+
+
+/**
+ * This function returns the table of the selected kernels.
+ * (init_kernels() is called with TIER_AUTO if it was not called yet)
+ *
+ * @return Pointer to the kernel table
+*/
+const kernels *get_kernels(void);
+
+
+/**
+ * This function returns the best tier supported by the CPU.
+ *
+ * @return One of the TIER_* defines
+*/
+int detect_tier(void);
+
+
+/**
+ * This function converts the name of the tier to the tier.
+ *
+ * @param name Name of the tier (auto, scalar, ssse3, avx2, avx512)
+ *
+ * @return One of the TIER_* defines or FAILURE if the name is unknown
+*/
+int parse_tier(const char *name);
+
+
+#endif
@@ -0,0 +1,538 @@
+/* FILE_MAP.C */
+
+/* mmap() and friends are POSIX, the rest of the build is plain C99 (copy_file_range() is GNU) */
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "file_map.h"
+
+#ifdef FILE_MAP_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+
+#ifdef FILE_MAP_MMAP
+
+/**
+ * This function maps the whole file.
+ * 
+ * @param map Map to be filled
+ * @param path Path to the file
+ * @param writable TRUE to change the file through the map
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int map_file(file_map *map, const char *path, int writable){
+
+    /* Declaration of variables */
+    struct stat st;
+    void *data;
+
+    /* Sanity check */
+    if (!map || !path) {
+        printf("Error in map_file!\n");
+        return FAILURE;
+    }
+
+    map->fd = open(path, writable ? O_RDWR : O_RDONLY);
+
+    if (map->fd < 0 || fstat(map->fd, &st) != 0 || st.st_size <= 0) {
+
+        printf("Error in map_file!\n");
+        if (map->fd >= 0) close(map->fd);
+        return FAILURE;
+    }
+
+    /* Only the pages which are touched are read */
+    data = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, map->fd, 0);
+
+    if (data == MAP_FAILED) {
+        printf("Error in map_file!\n");
+        close(map->fd);
+        return FAILURE;
+    }
+
+    map->data = (byte *)data;
+    map->size = (long)st.st_size;
+    map->writable = writable;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function maps the whole opened file for reading (nothing is printed, the file stays with the caller).
+ * 
+ * @param map Map to be filled
+ * @param fp Opened file (at its first byte)
+ * 
+ * @return SUCCESS or FAILURE if the file cannot be mapped (a pipe, an empty file)
+*/
+int map_stream(file_map *map, FILE *fp){
+
+    /* Declaration of variables */
+    struct stat st;
+    void *data;
+
+    /* Sanity check */
+    if (!map || !fp || fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return FAILURE;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+
+    if (data == MAP_FAILED) {
+        return FAILURE;
+    }
+
+    /* The descriptor is closed with the stream, not with the map */
+    map->data = (byte *)data;
+    map->size = (long)st.st_size;
+    map->writable = FALSE;
+    map->fd = -1;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function makes the changed range of the map reach the file.
+ * 
+ * @param map Writable map
+ * @param offset First changed byte
+ * @param length Count of changed bytes
+ * @param sync TRUE to wait until the range is on the disk
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int flush_range(file_map *map, long offset, long length, int sync){
+
+    /* Declaration and initialization of variables */
+    long page = sysconf(_SC_PAGESIZE), first;
+
+    /* Sanity check */
+    if (!map || !map->writable || offset < 0 || length < 0 || offset + length > map->size) {
+        printf("Error in flush_range!\n");
+        return FAILURE;
+    }
+
+    /* The shared mapping is the file, only syncing has something to do */
+    if (!sync || length == 0) {
+        return SUCCESS;
+    }
+
+    if (page <= 0) page = 4096;
+    first = offset / page * page;
+
+    if (msync(map->data + first, (size_t)(offset + length - first), MS_SYNC) != 0) {
+        printf("Error in flush_range!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function unmaps the file.
+ * 
+ * @param map Map
+ * 
+ * @return void
+*/
+void unmap_file(file_map *map){
+
+    /* Sanity check */
+    if (!map || !map->data) {
+        return;
+    }
+
+    munmap(map->data, (size_t)map->size);
+    if (map->fd >= 0) close(map->fd);
+    map->data = NULL;
+}
+
+
+/**
+ * This function creates the file to as a copy of the file from.
+ * The blocks are shared if the file system can do it (FICLONE), otherwise they are copied in the kernel
+ * (copy_file_range) and only as the last resort through a buffer.
+ * 
+ * @param from Path to the file to be copied
+ * @param to Path to the copy (created or truncated)
+ * 
+ * @return CLONE_REFLINK, CLONE_RANGE, CLONE_COPY or FAILURE
+*/
+int clone_file(const char *from, const char *to){
+
+    /* Declaration and initialization of variables */
+    int in = -1, out = -1, ret = CLONE_COPY;
+    struct stat st, old;
+    byte *buffer = NULL;
+    ssize_t n = 0;
+    long left;
+
+    /* Sanity check */
+    if (!from || !to) {
+        printf("Error in clone_file!\n");
+        return FAILURE;
+    }
+
+    in = open(from, O_RDONLY);
+
+    if (in < 0 || fstat(in, &st) != 0) {
+        printf("Error in clone_file!\n");
+        if (in >= 0) close(in);
+        return FAILURE;
+    }
+
+    /* The copy must not truncate the file it copies */
+    if (stat(to, &old) == 0 && old.st_dev == st.st_dev && old.st_ino == st.st_ino) {
+        printf("The output must be a different file!\n");
+        close(in);
+        return FAILURE;
+    }
+
+    out = open(to, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+
+    if (out < 0) {
+        printf("Error in clone_file!\n");
+        close(in);
+        return FAILURE;
+    }
+
+    left = (long)st.st_size;
+
+#ifdef FICLONE
+    /* Both files share the blocks until they are written */
+    if (ioctl(out, FICLONE, in) == 0) {
+        left = 0;
+        ret = CLONE_REFLINK;
+    }
+#endif
+
+#ifdef __linux__
+    /* The bytes do not pass through the user space (the offsets of both files move) */
+    while (left > 0 && (n = copy_file_range(in, NULL, out, NULL, (size_t)left, 0)) > 0) {
+        left -= (long)n;
+        ret = CLONE_RANGE;
+    }
+#endif
+
+    /* The rest goes through a buffer (another file system or no support in the kernel) */
+    if (left > 0) {
+
+        buffer = (byte *)malloc(FILE_COPY_CHUNK);
+        ret = buffer ? CLONE_COPY : FAILURE;
+
+        while (ret != FAILURE && left > 0 && (n = read(in, buffer, FILE_COPY_CHUNK)) > 0) {
+
+            if (write(out, buffer, (size_t)n) != n) ret = FAILURE;
+            left -= (long)n;
+        }
+
+        if (left > 0) ret = FAILURE;
+        free(buffer);
+    }
+
+    close(in);
+
+    if (close(out) != 0) ret = FAILURE;
+
+    if (ret == FAILURE) {
+        printf("Error in clone_file!\n");
+        remove(to);
+    }
+
+    return ret;
+}
+
+#else
+
+/**
+ * This function maps the whole file (reads it into memory).
+ * 
+ * @param map Map to be filled
+ * @param path Path to the file
+ * @param writable TRUE to change the file through the map
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int map_file(file_map *map, const char *path, int writable){
+
+    /* Sanity check */
+    if (!map || !path) {
+        printf("Error in map_file!\n");
+        return FAILURE;
+    }
+
+    map->fp = fopen(path, writable ? "r+b" : "rb");
+    map->data = NULL;
+
+    if (!map->fp || fseek(map->fp, 0, SEEK_END) != 0 || (map->size = ftell(map->fp)) <= 0
+        || fseek(map->fp, 0, SEEK_SET) != 0 || !(map->data = (byte *)malloc(map->size))
+        || fread(map->data, 1, map->size, map->fp) != (size_t)map->size) {
+
+        printf("Error in map_file!\n");
+        if (map->fp) fclose(map->fp);
+        free(map->data);
+        map->data = NULL;
+        return FAILURE;
+    }
+
+    map->writable = writable;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function maps the whole opened file for reading (without mmap() the file is read by the caller).
+ * 
+ * @param map Map to be filled
+ * @param fp Opened file (at its first byte)
+ * 
+ * @return FAILURE
+*/
+int map_stream(file_map *map, FILE *fp){
+
+    (void)map;
+    (void)fp;
+
+    return FAILURE;
+}
+
+
+/**
+ * This function makes the changed range of the map reach the file (writes it back).
+ * 
+ * @param map Writable map
+ * @param offset First changed byte
+ * @param length Count of changed bytes
+ * @param sync TRUE to wait until the range is on the disk
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int flush_range(file_map *map, long offset, long length, int sync){
+
+    /* Sanity check */
+    if (!map || !map->writable || offset < 0 || length < 0 || offset + length > map->size) {
+        printf("Error in flush_range!\n");
+        return FAILURE;
+    }
+
+    if (fseek(map->fp, offset, SEEK_SET) != 0 || fwrite(map->data + offset, 1, length, map->fp) != (size_t)length
+        || (sync && fflush(map->fp) != 0)) {
+        printf("Error in flush_range!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function unmaps the file.
+ * 
+ * @param map Map
+ * 
+ * @return void
+*/
+void unmap_file(file_map *map){
+
+    /* Sanity check */
+    if (!map || !map->data) {
+        return;
+    }
+
+    fclose(map->fp);
+    free(map->data);
+    map->data = NULL;
+}
+
+
+/**
+ * This function creates the file to as a copy of the file from (through a buffer).
+ * 
+ * @param from Path to the file to be copied
+ * @param to Path to the copy (created or truncated)
+ * 
+ * @return CLONE_COPY or FAILURE
+*/
+int clone_file(const char *from, const char *to){
+
+    /* Declaration and initialization of variables */
+    FILE *in = NULL, *out = NULL;
+    int ret = CLONE_COPY;
+    byte *buffer = NULL;
+    size_t n;
+
+    /* Sanity check (the copy must not truncate the file it copies) */
+    if (!from || !to || strcmp(from, to) == 0) {
+        printf("Error in clone_file!\n");
+        return FAILURE;
+    }
+
+    in = fopen(from, "rb");
+    out = in ? fopen(to, "wb") : NULL;
+    buffer = (byte *)malloc(FILE_COPY_CHUNK);
+
+    if (!in || !out || !buffer) {
+        ret = FAILURE;
+    }
+
+    while (ret != FAILURE && (n = fread(buffer, 1, FILE_COPY_CHUNK, in)) > 0) {
+
+        if (fwrite(buffer, 1, n, out) != n) ret = FAILURE;
+    }
+
+    if (in && ferror(in)) ret = FAILURE;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ret = FAILURE;
+    free(buffer);
+
+    if (ret == FAILURE) {
+        printf("Error in clone_file!\n");
+        if (out) remove(to);
+    }
+
+    return ret;
+}
+
+#endif
+
+
+/**
+ * This function returns the path of the file written before it replaces the target (path and PART_SUFFIX).
+ * 
+ * @param path Path to the target
+ * 
+ * @return Allocated path or NULL if error
+*/
+char *part_path(const char *path){
+
+    /* Declaration of variables */
+    char *part;
+
+    /* Sanity check */
+    if (!path) {
+        printf("Error in part_path!\n");
+        return NULL;
+    }
+
+    part = (char *)malloc(strlen(path) + strlen(PART_SUFFIX) + 1);
+
+    if (!part) {
+        printf("Error in part_path!\n");
+        return NULL;
+    }
+
+    strcpy(part, path);
+    strcat(part, PART_SUFFIX);
+
+    return part;
+}
+
+
+/**
+ * This function replaces the target by the written file.
+ * 
+ * @param part Path to the written file (removed if it cannot replace the target)
+ * @param path Path to the target
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int replace_file(const char *part, const char *path){
+
+    /* Sanity check */
+    if (!part || !path) {
+        printf("Error in replace_file!\n");
+        return FAILURE;
+    }
+
+#ifdef _WIN32
+    /* rename() does not replace an existing file here */
+    remove(path);
+#endif
+
+    if (rename(part, path) != 0) {
+        printf("Error in replace_file!\n");
+        remove(part);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function returns the standard input for binary data.
+ * 
+ * @return Stream of the standard input
+*/
+FILE *data_stdin(void){
+
+#ifdef _WIN32
+    /* No conversion of the line ends */
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+    return stdin;
+}
+
+
+/**
+ * This function takes the standard output for binary data, the messages printed later go to the standard error.
+ * 
+ * @return Stream of the standard output (closed by the caller) or NULL if error
+*/
+FILE *data_stdout(void){
+
+    /* Declaration and initialization of variables */
+    FILE *fp = NULL;
+    int fd = -1;
+
+    /* The messages printed so far stay where they were going */
+    fflush(stdout);
+
+#if defined(FILE_MAP_MMAP)
+    fd = dup(STDOUT_FILENO);
+    if (fd >= 0 && !(fp = fdopen(fd, "wb"))) close(fd);
+    if (fp && dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        fclose(fp);
+        fp = NULL;
+    }
+#elif defined(_WIN32)
+    fd = _dup(_fileno(stdout));
+    if (fd >= 0) _setmode(fd, _O_BINARY);
+    if (fd >= 0 && !(fp = _fdopen(fd, "wb"))) _close(fd);
+    if (fp && _dup2(_fileno(stderr), _fileno(stdout)) != 0) {
+        fclose(fp);
+        fp = NULL;
+    }
+#endif
+
+    if (!fp) {
+        printf("Error in data_stdout!\n");
+    }
+
+    return fp;
+}
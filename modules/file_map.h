@@ -0,0 +1,152 @@
+/* FILE_MAP.H */
+
+/* Inclusion guard */
+#ifndef __FILE_MAP_H__
+#define __FILE_MAP_H__
+
+#include <stdio.h>
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Files are mapped with mmap() on POSIX systems, elsewhere they are read into memory and written back by ranges */
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_MAP_MMAP 1
+#endif
+
+/* How clone_file made the copy (shared blocks, copied in the kernel, copied through a buffer) */
+#define CLONE_REFLINK 1
+#define CLONE_RANGE 2
+#define CLONE_COPY 3
+
+/* Bytes of the buffer of clone_file */
+#define FILE_COPY_CHUNK (1L << 20)
+
+/* Suffix of the file which is written before it replaces the target */
+#define PART_SUFFIX ".part"
+
+
+
+/* Structures */
+
+/* Bytes of a whole file */
+typedef struct {
+
+    /* Bytes of the file and their count */
+    byte *data;
+    long size;
+
+    /* TRUE if the bytes may be changed (written back to the file) */
+    int writable;
+
+#ifdef FILE_MAP_MMAP
+    /* Descriptor of the mapped file */
+    int fd;
+#else
+    /* Opened file (the bytes are a copy) */
+    FILE *fp;
+#endif
+
+} file_map;
+
+
+
+/* Prototypes */
+
+/**
+ * This function maps the whole file.
+ * 
+ * @param map Map to be filled
+ * @param path Path to the file
+ * @param writable TRUE to change the file through the map
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int map_file(file_map *map, const char *path, int writable);
+
+
+/**
+ * This function maps the whole opened file for reading (nothing is printed, the file stays with the caller).
+ * 
+ * @param map Map to be filled
+ * @param fp Opened file (at its first byte)
+ * 
+ * @return SUCCESS or FAILURE if the file cannot be mapped (a pipe, an empty file, no mmap())
+*/
+int map_stream(file_map *map, FILE *fp);
+
+
+/**
+ * This function makes the changed range of the map reach the file.
+ * 
+ * @param map Writable map
+ * @param offset First changed byte
+ * @param length Count of changed bytes
+ * @param sync TRUE to wait until the range is on the disk
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int flush_range(file_map *map, long offset, long length, int sync);
+
+
+/**
+ * This function creates the file to as a copy of the file from.
+ * The blocks are shared if the file system can do it, otherwise they are copied (in the kernel if possible).
+ * 
+ * @param from Path to the file to be copied
+ * @param to Path to the copy (created or truncated)
+ * 
+ * @return CLONE_REFLINK, CLONE_RANGE, CLONE_COPY or FAILURE
+*/
+int clone_file(const char *from, const char *to);
+
+
+/**
+ * This function returns the path of the file written before it replaces the target (path and PART_SUFFIX).
+ * 
+ * @param path Path to the target
+ * 
+ * @return Allocated path or NULL if error
+*/
+char *part_path(const char *path);
+
+
+/**
+ * This function replaces the target by the written file.
+ * 
+ * @param part Path to the written file (removed if it cannot replace the target)
+ * @param path Path to the target
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int replace_file(const char *part, const char *path);
+
+
+/**
+ * This function returns the standard input for binary data.
+ * 
+ * @return Stream of the standard input
+*/
+FILE *data_stdin(void);
+
+
+/**
+ * This function takes the standard output for binary data, the messages printed later go to the standard error.
+ * 
+ * @return Stream of the standard output (closed by the caller) or NULL if error
+*/
+FILE *data_stdout(void);
+
+
+/**
+ * This function unmaps the file.
+ * 
+ * @param map Map
+ * 
+ * @return void
+*/
+void unmap_file(file_map *map);
+
+
+#endif
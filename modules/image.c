@@ -0,0 +1,231 @@
+/* IMAGE.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "image.h"
+
+
+/**
+ * This function allocates the image.
+ * 
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * 
+ * @return Image or NULL if error
+*/
+image *create_image(int width, int height){
+
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    size_t size;
+    int y;
+
+    /* Sanity check */
+    if (width <= 0 || height <= 0) {
+        printf("Error in create_image!\n");
+        return NULL;
+    }
+
+    img = (image *)malloc(sizeof(image));
+
+    if (!img) {
+        printf("Error in create_image!\n");
+        return NULL;
+    }
+
+    img->width = width;
+    img->height = height;
+
+    /* Every row starts aligned (the gap also fits the align bytes of a BMP row) */
+    img->stride = ((long)width * IMAGE_CHANNELS + IMAGE_ALIGN - 1) / IMAGE_ALIGN * IMAGE_ALIGN;
+    size = (size_t)img->stride * height;
+
+    /* One block for all the rows */
+    img->block = (byte *)malloc(size + IMAGE_ALIGN);
+    img->rows = (png_bytep *)malloc(sizeof(png_bytep) * height);
+
+    if (!img->block || !img->rows) {
+        printf("Error in create_image!\n");
+        free(img->block);
+        free(img->rows);
+        free(img);
+        return NULL;
+    }
+
+    img->dirty = NULL;
+
+    /* The caller fills every row unless it sets a source */
+    img->loaded = height;
+    img->load = NULL;
+    img->source = NULL;
+    img->pixels = img->block + (IMAGE_ALIGN - (uintptr_t)img->block % IMAGE_ALIGN) % IMAGE_ALIGN;
+
+    for (y = 0; y < height; y++) {
+        img->rows[y] = IMAGE_ROW(img, y);
+    }
+
+    return img;
+}
+
+
+/**
+ * This function creates the image over pixels which it does not own (e.g. a mapped file), they are not freed with the image.
+ * 
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * @param pixels First pixel of the first row (r, g, b)
+ * @param stride Bytes between the starts of two rows
+ * 
+ * @return Image or NULL if error
+*/
+image *wrap_image(int width, int height, byte *pixels, long stride){
+
+    /* Declaration of variables */
+    image *img;
+    int y;
+
+    /* Sanity check */
+    if (width <= 0 || height <= 0 || !pixels || stride < (long)width * IMAGE_CHANNELS) {
+        printf("Error in wrap_image!\n");
+        return NULL;
+    }
+
+    img = (image *)malloc(sizeof(image));
+
+    if (!img) {
+        printf("Error in wrap_image!\n");
+        return NULL;
+    }
+
+    img->rows = (png_bytep *)malloc(sizeof(png_bytep) * height);
+
+    if (!img->rows) {
+        printf("Error in wrap_image!\n");
+        free(img);
+        return NULL;
+    }
+
+    img->width = width;
+    img->height = height;
+    img->stride = stride;
+    img->pixels = pixels;
+    img->block = NULL;
+    img->dirty = NULL;
+
+    /* Every row is already there */
+    img->loaded = height;
+    img->load = NULL;
+    img->source = NULL;
+
+    for (y = 0; y < height; y++) {
+        img->rows[y] = IMAGE_ROW(img, y);
+    }
+
+    return img;
+}
+
+
+/**
+ * This function frees the image.
+ * 
+ * @param img Image to be freed
+ * 
+ * @return void
+*/
+void free_image(image *img){
+
+    /* Sanity check */
+    if (!img) {
+        printf("Error in free_image!\n");
+        return;
+    }
+
+    free(img->block);
+    free(img->rows);
+    free(img->dirty);
+    free(img);
+}
+
+
+/**
+ * This function starts tracking of the changed rows (no row is changed yet).
+ * 
+ * @param img Image
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int track_dirty(image *img){
+
+    /* Sanity check */
+    if (!img) {
+        printf("Error in track_dirty!\n");
+        return FAILURE;
+    }
+
+    free(img->dirty);
+    img->dirty = (byte *)calloc(img->height, 1);
+
+    if (!img->dirty) {
+        printf("Error in track_dirty!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function returns the count of rows which must be written.
+ * 
+ * @param img Image
+ * 
+ * @return Count of changed rows (height if the rows are not tracked)
+*/
+int count_dirty(const image *img){
+
+    /* Declaration and initialization of variables */
+    int y, count = 0;
+
+    if (!img->dirty) {
+        return img->height;
+    }
+
+    for (y = 0; y < img->height; y++) {
+        count += img->dirty[y] != 0;
+    }
+
+    return count;
+}
+
+
+/**
+ * This function makes sure the first rows of the picture are in memory (loads them from the source).
+ * 
+ * @param img Image
+ * @param rows Count of the first rows needed (at most the height)
+ * 
+ * @return SUCCESS or FAILURE if the rows cannot be loaded
+*/
+int need_rows(image *img, int rows){
+
+    /* Sanity check */
+    if (!img) {
+        printf("Error in need_rows!\n");
+        return FAILURE;
+    }
+
+    if (rows > img->height) rows = img->height;
+
+    if (rows <= img->loaded) {
+        return SUCCESS;
+    }
+
+    if (!img->load || img->load(img, img->loaded, rows) == FAILURE) {
+        return FAILURE;
+    }
+
+    img->loaded = rows;
+
+    return SUCCESS;
+}
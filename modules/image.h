@@ -0,0 +1,124 @@
+/* IMAGE.H */
+
+/* Inclusion guard */
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Alignment of the pixels and of every row (bytes) */
+#define IMAGE_ALIGN 64
+
+/* Bytes of one RGB pixel in the image */
+#define IMAGE_CHANNELS 3
+
+/* First byte of the row y */
+#define IMAGE_ROW(img, y) ((img)->pixels + (long)(y) * (img)->stride)
+
+
+/* Structures */
+
+/* RGB pixels of the picture in one aligned allocation */
+typedef struct image_def {
+
+    /* Size of the picture */
+    int width;
+    int height;
+
+    /* Bytes between the starts of two rows (multiple of IMAGE_ALIGN unless the pixels are not owned) */
+    long stride;
+
+    /* First pixel of the first row (aligned to IMAGE_ALIGN) */
+    byte *pixels;
+
+    /* Pointers to the rows (for libpng) */
+    png_bytep *rows;
+
+    /* Allocated block (pixels points into it), NULL if the pixels are not owned by the image */
+    byte *block;
+
+    /* Rows changed since the picture was read (one flag per row), NULL if every row counts as changed */
+    byte *dirty;
+
+    /* Rows 0 .. loaded - 1 are in memory */
+    int loaded;
+
+    /* Loads the rows from .. to - 1 from the source (NULL if the rest of the rows cannot be loaded) */
+    int (*load)(struct image_def *img, int from, int to);
+    void *source;
+
+} image;
+
+
+
+/* Prototypes */
+
+/**
+ * This function allocates the image.
+ * 
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * 
+ * @return Image or NULL if error
+*/
+image *create_image(int width, int height);
+
+
+/**
+ * This function creates the image over pixels which it does not own (e.g. a mapped file), they are not freed with the image.
+ * 
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * @param pixels First pixel of the first row (r, g, b)
+ * @param stride Bytes between the starts of two rows
+ * 
+ * @return Image or NULL if error
+*/
+image *wrap_image(int width, int height, byte *pixels, long stride);
+
+
+/**
+ * This function frees the image.
+ * 
+ * @param img Image to be freed
+ * 
+ * @return void
+*/
+void free_image(image *img);
+
+
+/**
+ * This function starts tracking of the changed rows (no row is changed yet).
+ * 
+ * @param img Image
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int track_dirty(image *img);
+
+
+/**
+ * This function returns the count of rows which must be written.
+ * 
+ * @param img Image
+ * 
+ * @return Count of changed rows (height if the rows are not tracked)
+*/
+int count_dirty(const image *img);
+
+
+/**
+ * This function makes sure the first rows of the picture are in memory (loads them from the source).
+ * 
+ * @param img Image
+ * @param rows Count of the first rows needed (at most the height)
+ * 
+ * @return SUCCESS or FAILURE if the rows cannot be loaded
+*/
+int need_rows(image *img, int rows);
+
+
+#endif
@@ -3,58 +3,304 @@
 #include <string.h>
 #include <unistd.h>
 #include "input.h"
+#include "cpu_dispatch.h"
+#include "pixel_secrets.h"
+#include "parallel.h"
+#include "png_lib.h"
+#include "png_deflate.h"
 
 
 /**
- * This function checks if the filed exists and return paths to the files.
+ * This function prints how to use the program.
+ * 
+ * @param program Name of the program
+ * 
+ * @return void
+*/
+void print_usage(char *program){
+
+    printf("Use: %s <picture[.bmp]|[.png]|[.qoi]|[.ppm]|[.pam]|[.y4m]|-> -<h|x> <payload> [options]\n", program);
+    printf("Options:\n");
+    printf("  --cpu <auto|scalar|ssse3|avx2|avx512>  force the tier of the kernels\n");
+    printf("  --channels <r|g|b...>                  channels used for hiding (default b)\n");
+    printf("  --bits <1-%d|auto>                      LSBs used in each channel (default 1)\n", MAX_DEPTH);
+    printf("  --threads <1-%d|auto>                 threads for hiding, extracting and encoding PNG (default 1)\n", MAX_THREADS);
+    printf("  --matrix <%d-%d|auto|off>                matrix embedding, k bits in 2^k - 1 LSBs (default off)\n", MIN_MATRIX, MAX_MATRIX);
+    printf("  --key <text>                           spread the bits over the picture by the key\n");
+    printf("  --delta                                re-hide, write only the pixels and rows which differ\n");
+    printf("  --in-place                             patch only the changed rows of a BMP, PPM or PAM file in place\n");
+    printf("  --sync                                 with --in-place or --output, wait until the changed rows are on the disk\n");
+    printf("  --output <path>                        write the picture with the payload to the path (a BMP is cloned and patched, - for a Y4M on stdout)\n");
+    printf("  --stream                               hide window by window of rows (BMP) or row by row (PNG, drops its segments)\n");
+    printf("  --png-profile <fastest|fast|default|smallest>  encoding of a written PNG\n");
+    printf("  --png-segments <1-%d>               deflate a written PNG by segments of rows, a re-hide deflates only the changed ones (not with --stream)\n", MAX_SEGMENT_ROWS);
+    printf("  --plane <y|u|v>                        plane of a Y4M video which carries the payload (default y)\n");
+
+}
+
+
+/**
+ * This function parses one option (starting with --) and its value.
  * 
  * @param argc Number of arguments
  * @param argv Array of arguments
- * @param sw Switch
+ * @param i Index of the option (moved to the value if the option has one)
+ * @param opts Options to be filled
  * 
- * @return Array of paths or NULL if error
+ * @return SUCCESS or FAILURE if the option or its value is invalid
 */
-char **get_files(int argc, char *argv[], char *sw){
+static int parse_option(int argc, char *argv[], int *i, options *opts){
 
+    /* Declaration and initialization of variables */
+    char *name = argv[*i], *value = NULL, *end = NULL;
+    int bit;
+    long count;
 
-    /* Declaration and initialize variables */
-    int i, step = 0;
-    char **paths = NULL;
-    FILE *fp = NULL;
+    /* Flags have no value */
+    if (strcmp(name, "--delta") == 0) {
+        opts->delta = TRUE;
+        return SUCCESS;
+    }
 
-    /* Sanity check */
-    if (!argv || !sw) {
+    if (strcmp(name, "--in-place") == 0) {
+        opts->in_place = TRUE;
+        return SUCCESS;
+    }
 
-        printf("Error in get_files!\n");
-        return NULL;
+    if (strcmp(name, "--sync") == 0) {
+        opts->sync = TRUE;
+        return SUCCESS;
+    }
 
+    if (strcmp(name, "--stream") == 0) {
+        opts->stream = TRUE;
+        return SUCCESS;
     }
 
-    /* Check if the number of arguments is valid */
-    if (argc != 4) {
-		printf("Invalid usage!\nUse: %s <picture[.bmp]|[.png]> -<h|x> <payload>\n", argv[0]);
-		return NULL;
-	}
+    /* Every other option has a value */
+    if (*i + 1 >= argc) {
+        printf("Missing value of %s!\n", name);
+        return FAILURE;
+    }
 
+    value = argv[++(*i)];
 
-    /* Allocate memory for paths */
-    paths = (char **)malloc(sizeof(char *) * NUMBER_OF_PATHS);
+    if (strcmp(name, "--cpu") == 0) {
+
+        opts->tier = parse_tier(value);
+
+        if (opts->tier == FAILURE) {
+            printf("Invalid tier: %s\n", value);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--channels") == 0) {
+
+        for (opts->channels = 0; *value; value++) {
+
+            switch (*value) {
+                case 'r': case 'R': bit = CHANNEL_R; break;
+                case 'g': case 'G': bit = CHANNEL_G; break;
+                case 'b': case 'B': bit = CHANNEL_B; break;
+                default: bit = 0;
+            }
+
+            /* Unknown or repeated channel */
+            if (!bit || (opts->channels & bit)) {
+                printf("Invalid channels: %s\n", argv[*i]);
+                return FAILURE;
+            }
+
+            opts->channels |= bit;
+        }
+
+        if (!opts->channels) {
+            printf("Invalid channels: %s\n", argv[*i]);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--bits") == 0) {
+
+        if (strcmp(value, "auto") == 0) {
+            opts->depth = DEPTH_AUTO;
+        } else if (strlen(value) == 1 && value[0] >= '1' && value[0] <= '0' + MAX_DEPTH) {
+            opts->depth = value[0] - '0';
+        } else {
+            printf("Invalid count of bits: %s\n", value);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--threads") == 0) {
+
+        if (strcmp(value, "auto") == 0) {
+            opts->threads = THREADS_AUTO;
+            return SUCCESS;
+        }
+
+        count = strtol(value, &end, 10);
+
+        if (*end || count < 1 || count > MAX_THREADS) {
+            printf("Invalid count of threads: %s\n", value);
+            return FAILURE;
+        }
+
+        opts->threads = (int)count;
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--matrix") == 0) {
+
+        if (strcmp(value, "auto") == 0) {
+            opts->matrix = MATRIX_AUTO;
+        } else if (strcmp(value, "off") == 0) {
+            opts->matrix = MATRIX_OFF;
+        } else if (strlen(value) == 1 && value[0] >= '0' + MIN_MATRIX && value[0] <= '0' + MAX_MATRIX) {
+            opts->matrix = value[0] - '0';
+        } else {
+            printf("Invalid matrix embedding: %s\n", value);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--key") == 0) {
+
+        if (!*value) {
+            printf("Invalid key: the key is empty\n");
+            return FAILURE;
+        }
+
+        opts->key = value;
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--output") == 0) {
+
+        if (!*value) {
+            printf("Invalid output: the path is empty\n");
+            return FAILURE;
+        }
+
+        opts->output = value;
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--png-profile") == 0) {
+
+        opts->png_profile = parse_png_profile(value);
+
+        if (opts->png_profile == FAILURE) {
+            printf("Invalid PNG profile: %s\n", value);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--plane") == 0) {
+
+        if (strcmp(value, "y") == 0) {
+            opts->plane = PLANE_Y;
+        } else if (strcmp(value, "u") == 0) {
+            opts->plane = PLANE_U;
+        } else if (strcmp(value, "v") == 0) {
+            opts->plane = PLANE_V;
+        } else {
+            printf("Invalid plane: %s\n", value);
+            return FAILURE;
+        }
+
+        return SUCCESS;
+    }
+
+    if (strcmp(name, "--png-segments") == 0) {
+
+        count = strtol(value, &end, 10);
+
+        if (*end || count < 1 || count > MAX_SEGMENT_ROWS) {
+            printf("Invalid rows of a PNG segment: %s\n", value);
+            return FAILURE;
+        }
+
+        opts->png_segments = (int)count;
+        return SUCCESS;
+    }
+
+    printf("Invalid option: %s\n", name);
+    return FAILURE;
+
+}
+
+
+/**
+ * This function parses the arguments and returns paths to the files (they are not opened here).
+ * 
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ * @param sw Switch
+ * @param opts Parsed options
+ * 
+ * @return Array of paths or NULL if error
+*/
+char **get_files(int argc, char *argv[], char *sw, options *opts){
+
+
+    /* Declaration and initialize variables */
+    int i, count = 0;
+    char **paths = NULL, *args[NUMBER_OF_PATHS];
+
+    /* Sanity check */
+    if (!argv || !sw || !opts) {
 
-    /* Check if the memory was allocated */
-    if (!paths) {
         printf("Error in get_files!\n");
         return NULL;
-    }
 
+    }
 
-    /* Find the switch */
+    /* Default options */
+    opts->tier = TIER_AUTO;
+    opts->channels = 0;
+    opts->depth = 1;
+    opts->threads = 1;
+    opts->matrix = MATRIX_OFF;
+    opts->key = NULL;
+    opts->delta = FALSE;
+    opts->in_place = FALSE;
+    opts->sync = FALSE;
+    opts->output = NULL;
+    opts->stream = FALSE;
+    opts->png_profile = PNG_PROFILE_DEFAULT;
+    opts->png_segments = 0;
+    opts->plane = PLANE_Y;
+    *sw = '\0';
+
+
+    /* Find the switch, the options and the paths */
     for (i = 1; i < argc; i++) {
 
-        /* Check if the argument is a switch */
-        if (argv[i][0] == '-') {
+        /* Check if the argument is an option */
+        if (strncmp(argv[i], "--", 2) == 0) {
+
+            if (parse_option(argc, argv, &i, opts) == FAILURE) {
+                print_usage(argv[0]);
+                return NULL;
+            }
+
+        /* Check if the argument is a switch (a lone - is the standard input) */
+        } else if (argv[i][0] == '-' && argv[i][1]) {
             
             /* Check if the switch is valid */
-            if (argv[i][1] == 'h' || argv[i][1] == 'x') {
+            if (!*sw && (argv[i][1] == 'h' || argv[i][1] == 'x')) {
 
                 /* Save the switch */
                 *sw = argv[i][1];
@@ -62,62 +308,74 @@ char **get_files(int argc, char *argv[], char *sw){
 
             } else {
                     
-                printf("Invalid switch!\nUse: %s <picture[.bmp]|[.png]> -<h|x> <payload>\n", argv[0]);
-
-                for (i = 0; i < step; i++) {
-                    free(paths[i]);
-                }
-                
-                free(paths);
+                printf("Invalid switch!\n");
+                print_usage(argv[0]);
                 return NULL;
 
             }
-            
-            break;
-        }
-    }
-
-
 
+        } else {
 
+            /* Too many paths */
+            if (count == NUMBER_OF_PATHS) {
+                count++;
+                break;
+            }
 
+            args[count++] = argv[i];
+        }
+    }
 
-    /* Find the paths */
-    for (i = 1; i < argc; i++) {
+    /* Check if the number of arguments is valid */
+    if (count != NUMBER_OF_PATHS || !*sw) {
+		printf("Invalid usage!\n");
+        print_usage(argv[0]);
+		return NULL;
+	}
 
-        /* Skip the switch */
-        if (argv[i][0] == '-') continue;
+    /* Matrix embedding flips whole LSBs */
+    if (opts->matrix != MATRIX_OFF && opts->depth != 1 && opts->depth != DEPTH_AUTO) {
+        printf("Matrix embedding uses 1 bit per channel!\n");
+        print_usage(argv[0]);
+        return NULL;
+    }
 
-        /* If you want to extract, skip the second path (payload) (program will create it) */
-        if (*sw != 'x' || step != 1) {
+    /* The windows of the stream cannot find a spread body */
+    if (opts->stream && opts->key) {
+        printf("--stream cannot be used with --key!\n");
+        print_usage(argv[0]);
+        return NULL;
+    }
 
-            /* Open the file */
-            fp = fopen(argv[i], "rb");
+    /* In place means the picture itself is changed */
+    if (opts->in_place && opts->output) {
+        printf("--in-place cannot be used with --output!\n");
+        print_usage(argv[0]);
+        return NULL;
+    }
 
-            /* If the file does not exist, print an error and return NULL - free everything */
-            if (!fp) {
 
-                printf("Invalid path: %s\n", argv[i]);
+    /* Allocate memory for paths */
+    paths = (char **)malloc(sizeof(char *) * NUMBER_OF_PATHS);
 
-                for (i = 0; i < step; i++) {
-                    free(paths[i]);
-                }
-                free(paths);
+    /* Check if the memory was allocated */
+    if (!paths) {
+        printf("Error in get_files!\n");
+        return NULL;
+    }
 
-                return NULL;
-            }
 
-        }
+    /* Save the paths (the files are opened once, by the code which reads or writes them) */
+    for (i = 0; i < NUMBER_OF_PATHS; i++) {
 
-        /* Save the path */
-        paths[step] = (char *)malloc(sizeof(char) * (strlen(argv[i]) + 1));
+        paths[i] = (char *)malloc(sizeof(char) * (strlen(args[i]) + 1));
 
         /* Check if the memory was allocated */
-        if (!paths[step]) {
+        if (!paths[i]) {
 
             printf("Error in get_files!\n");
 
-            for (i = 0; i < step; i++) {
+            while (i-- > 0) {
                 free(paths[i]);
             }
 
@@ -128,17 +386,7 @@ char **get_files(int argc, char *argv[], char *sw){
         }
         
         /* Copy the path */
-        strcpy(paths[step], argv[i]);
-
-        /* Increment the step */
-        step++;
-
-        /* Close the file */
-        if (*sw != 'x' || step != 1) {
-
-            fclose(fp);
-
-        }
+        strcpy(paths[i], args[i]);
 
     }
 
@@ -151,11 +399,11 @@ char **get_files(int argc, char *argv[], char *sw){
 
 
 /**
- * This function checks if the file is bmp or png.
+ * This function checks if the file is bmp, png, qoi, ppm / pam or y4m (also the standard input).
  * 
  * @param path Path to the file
  * 
- * @return 0 if bmp, 1 if png, -1 if error
+ * @return 0 if bmp, 1 if png, 2 if qoi, 3 if ppm or pam, 4 if y4m, -1 if error
 */
 int check_picture(char *path){
     
@@ -170,15 +418,23 @@ int check_picture(char *path){
 
     }
 
+    /* Only a video is piped to the standard input */
+    if (strcmp(path, STDIO_PATH) == 0) return Y4M;
+
     /* Find last dot */
     suffix = strrchr(path, '.');
 
-    /* Check if the suffix is valid  and return 0 if bmp, 1 if png, -1 if error */
+    /* Check if the suffix is valid  and return 0 if bmp, 1 if png, 2 if qoi, 3 if ppm or pam, 4 if y4m, -1 if error */
+    if (!suffix) suffix = "";
+
     if (strcmp(suffix, suffix1) == 0) return BMP;    
     else if (strcmp(suffix, suffix2) == 0) return PNG;
+    else if (strcmp(suffix, suffix3) == 0) return QOI;
+    else if (strcmp(suffix, suffix4) == 0 || strcmp(suffix, suffix5) == 0) return PNM;
+    else if (strcmp(suffix, suffix6) == 0) return Y4M;
     else {
 
-        printf("Invalid image format!\n Use .bmp or .png (24-bit/px RGB)\n");
+        printf("Invalid image format!\n Use .bmp, .png, .qoi, .ppm or .pam (24-bit/px RGB) or .y4m\n");
         return FAILURE;
         
     }
@@ -186,6 +442,49 @@ int check_picture(char *path){
 }
 
 
+/**
+ * This function checks if the format can honour the options of the hide (--in-place, --stream, --png-segments).
+ * 
+ * @param format Format given by check_picture
+ * @param opts Options
+ * 
+ * @return SUCCESS or FAILURE if an option cannot be honoured
+*/
+int check_hide_options(int format, const options *opts){
+
+    /* Sanity check */
+    if (!opts) {
+        printf("Error in check_hide_options!\n");
+        return FAILURE;
+    }
+
+    /* A compressed picture or a video cannot be patched (a PPM / PAM is always patched) */
+    if (opts->in_place && format != BMP && format != PNM) {
+        printf("--in-place needs a BMP, PPM or PAM picture!\n");
+        return FAILURE;
+    }
+
+    /* A QOI is read whole, a PPM / PAM is patched (a video is always streamed) */
+    if (opts->stream && (format == QOI || format == PNM)) {
+        printf("--stream needs a BMP or PNG picture!\n");
+        return FAILURE;
+    }
+
+    if (opts->png_segments != 0 && format != PNG) {
+        printf("--png-segments needs a PNG picture!\n");
+        return FAILURE;
+    }
+
+    /* A streamed PNG is written by plain libpng without the stSG chunk */
+    if (opts->png_segments != 0 && opts->stream) {
+        printf("--png-segments cannot be used with --stream!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
 /**
  * This function frees the payload.
  * 
@@ -10,10 +10,32 @@
 
 #define suffix1 ".bmp"
 #define suffix2 ".png"
+#define suffix3 ".qoi"
+#define suffix4 ".ppm"
+#define suffix5 ".pam"
+#define suffix6 ".y4m"
 #define NUMBER_OF_PATHS 2
 
 #define BMP 0
 #define PNG 1
+#define QOI 2
+#define PNM 3
+#define Y4M 4
+
+/* Path of the standard input (a Y4M video) or output */
+#define STDIO_PATH "-"
+
+/* Pick the smallest depth which fits (--bits auto) */
+#define DEPTH_AUTO 0
+
+/* Plane of a Y4M video (--plane <y|u|v>) */
+#define PLANE_Y 0
+#define PLANE_U 1
+#define PLANE_V 2
+
+/* Matrix embedding off, or the biggest k which fits (k = 1 would be plain LSBs) */
+#define MATRIX_OFF 0
+#define MATRIX_AUTO 1
 
 
 
@@ -26,20 +48,77 @@ typedef struct{
 } payload;
 
 
+/* Command line options (after the image, the switch and the payload) */
+typedef struct{
+
+    /* Forced kernel tier (--cpu <auto|scalar|ssse3|avx2|avx512>) */
+    int tier;
+
+    /* Mask of the channels (--channels <r|g|b...>), 0 if not given */
+    int channels;
+
+    /* LSBs per channel (--bits <1-3|auto>) */
+    int depth;
+
+    /* Worker threads (--threads <n|auto>), THREADS_AUTO for every CPU */
+    int threads;
+
+    /* Matrix embedding (--matrix <2-8|auto|off>), k bits in 2^k - 1 LSBs */
+    int matrix;
+
+    /* Key spreading the pixels of the body (--key <text>), NULL for the order of the rows */
+    char *key;
+
+    /* Re-hide over the hidden content (--delta), only the differing pixels and rows are written */
+    int delta;
+
+    /* Patch the rows of a BMP file in place (--in-place) and wait for the disk (--sync) */
+    int in_place;
+    int sync;
+
+    /* Path of the picture with the hidden payload (--output <path>), NULL to overwrite the picture */
+    char *output;
+
+    /* Hide window by window of rows (--stream) */
+    int stream;
+
+    /* Encoding of a written PNG file (--png-profile <fastest|fast|default|smallest>) */
+    int png_profile;
+
+    /* Rows of one segment of a written PNG (--png-segments <rows>), 0 for no segments */
+    int png_segments;
+
+    /* Plane of a Y4M video which carries the payload (--plane <y|u|v>) */
+    int plane;
+
+} options;
+
+
 
 /* ----------Prototypes---------- */
 
 
 /**
- * This function checks if the filed exists and return paths to the files.
+ * This function parses the arguments and returns paths to the files (they are not opened here).
  * 
  * @param argc Number of arguments
  * @param argv Array of arguments
  * @param sw Switch
+ * @param opts Parsed options
  * 
  * @return Array of paths or NULL if error
 */
-char **get_files(int argc, char *argv[], char *sw);
+char **get_files(int argc, char *argv[], char *sw, options *opts);
+
+
+/**
+ * This function prints how to use the program.
+ * 
+ * @param program Name of the program
+ * 
+ * @return void
+*/
+void print_usage(char *program);
 
 
 /**
@@ -63,15 +142,26 @@ void free_payload(payload *payload);
 
 
 /**
- * This function checks if the file is bmp or png.
+ * This function checks if the file is bmp, png, qoi, ppm / pam or y4m (also the standard input).
  * 
  * @param path Path to the file
  * 
- * @return 0 if bmp, 1 if png, FAILURE if error
+ * @return 0 if bmp, 1 if png, 2 if qoi, 3 if ppm or pam, 4 if y4m, FAILURE if error
 */
 int check_picture(char *path);
 
 
+/**
+ * This function checks if the format can honour the options of the hide (--in-place, --stream, --png-segments).
+ * 
+ * @param format Format given by check_picture
+ * @param opts Options
+ * 
+ * @return SUCCESS or FAILURE if an option cannot be honoured
+*/
+int check_hide_options(int format, const options *opts);
+
+
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1167 @@
+/* KERNELS.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernels.h"
+#include "pixel_secrets.h"
+
+#ifdef X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+/* Lookup tables */
+
+/* CRC32 tables for slicing by 4 bytes */
+static dword crc_table[4][256];
+
+#ifdef X86_KERNELS
+
+/* Shuffle of 16 bits into the three 16 byte chunks of 16 RGB pixels (0x80 = zero) */
+static byte embed_shuffle[3][16];
+
+/* Masks which clear the LSB of the blue bytes in the three chunks */
+static byte embed_keep[3][16];
+
+/* Shuffle of the blue bytes of the three chunks into 16 bits */
+static byte extract_shuffle[3][16];
+
+/* Shuffle which swaps R and B of the five pixels in the first 15 bytes */
+static byte swizzle_shuffle[16];
+
+/* Shuffle of the bytes of one channel in the three chunks into 16 plane bytes */
+static byte plane_shuffle[BYTES_PER_PIXEL][3][16];
+
+/* Shuffle of 16 plane bytes of one channel into the three chunks */
+static byte merge_shuffle[BYTES_PER_PIXEL][3][16];
+
+/* Folding constants of the PCLMULQDQ CRC (by 16 and by 64 bytes) */
+static unsigned long long fold_16[2], fold_64[2];
+
+#endif
+
+
+
+/**
+ * This function updates the (reflected) CRC32 with bytes.
+ *
+ * @param crc Current value of the CRC
+ * @param data Bytes to be processed
+ * @param length Count of bytes
+ *
+ * @return New value of the CRC
+*/
+static dword crc32_bytes(dword crc, const byte *data, long length){
+
+    /* Declaration of variables */
+    long i;
+
+    for (i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ data[i]) & 0xFF];
+    }
+
+    return crc;
+}
+
+
+#ifdef X86_KERNELS
+
+/**
+ * This function calculates x^n mod P of the CRC polynomial and reflects it into 64 bits.
+ *
+ * @param n Exponent
+ *
+ * @return Reflected remainder (coefficient of x^d in the bit 63 - d)
+*/
+static unsigned long long crc32_xpow(int n){
+
+    /* Declaration and initialization of variables */
+    dword poly = 0, rem = 1;
+    unsigned long long reflected = 0;
+    int i;
+
+    /* The polynomial is stored reflected, the remainder is calculated in the normal order */
+    for (i = 0; i < CRC32_SIZE; i++) {
+        if ((CRC32_POLYNOMIAL >> i) & 1) poly |= 1u << (CRC32_SIZE - 1 - i);
+    }
+
+    for (i = 0; i < n; i++) {
+        rem = (rem & 0x80000000u) ? ((rem << 1) ^ poly) : (rem << 1);
+    }
+
+    for (i = 0; i < CRC32_SIZE; i++) {
+        if ((rem >> i) & 1) reflected |= 1ull << (63 - i);
+    }
+
+    return reflected;
+}
+
+#endif
+
+
+/**
+ * This function initializes the lookup tables used by the kernels.
+ *
+ * @return void
+*/
+void init_kernel_tables(void){
+
+    /* Declaration of variables */
+    dword crc;
+    int i, j;
+
+    /* Bitwise CRC of every byte, then the tables for the following bytes */
+    for (i = 0; i < 256; i++) {
+
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & -(crc & 1));
+        }
+        crc_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 4; j++) {
+            crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+        }
+    }
+
+#ifdef X86_KERNELS
+
+    /* Embed / extract shuffles of one block of 16 pixels (48 bytes) */
+    for (i = 0; i < 3; i++) {
+
+        for (j = 0; j < 16; j++) {
+
+            if ((16 * i + j) % BYTES_PER_PIXEL == COLUMN_START) {
+                embed_shuffle[i][j] = (byte)((16 * i + j) / BYTES_PER_PIXEL);
+                embed_keep[i][j] = mask_0;
+            } else {
+                embed_shuffle[i][j] = 0x80;
+                embed_keep[i][j] = 0xFF;
+            }
+
+            extract_shuffle[i][j] = 0x80;
+        }
+    }
+
+    for (j = 0; j < 16; j++) {
+        i = j * BYTES_PER_PIXEL + COLUMN_START;
+        extract_shuffle[i / 16][j] = (byte)(i % 16);
+    }
+
+    /* Planes of one block of 16 pixels */
+    for (i = 0; i < BYTES_PER_PIXEL; i++) {
+
+        for (j = 0; j < 16; j++) {
+            plane_shuffle[i][0][j] = plane_shuffle[i][1][j] = plane_shuffle[i][2][j] = 0x80;
+        }
+
+        for (j = 0; j < 48; j++) {
+            merge_shuffle[i][j / 16][j % 16] = (j % BYTES_PER_PIXEL == i) ? (byte)(j / BYTES_PER_PIXEL) : 0x80;
+        }
+
+        for (j = 0; j < 16; j++) {
+            plane_shuffle[i][(j * BYTES_PER_PIXEL + i) / 16][j] = (byte)((j * BYTES_PER_PIXEL + i) % 16);
+        }
+    }
+
+    /* R <-> B of five pixels, the 16th byte stays */
+    for (j = 0; j < 15; j++) {
+        swizzle_shuffle[j] = (byte)(j - (j % 3) + (2 - (j % 3)));
+    }
+    swizzle_shuffle[15] = 15;
+
+    /* Lane 0 holds the higher coefficients, so it is folded by the distance + 64 bits */
+    fold_16[0] = crc32_xpow(128 + 63);
+    fold_16[1] = crc32_xpow(128 - 1);
+    fold_64[0] = crc32_xpow(512 + 63);
+    fold_64[1] = crc32_xpow(512 - 1);
+
+#endif
+
+}
+
+
+
+/* ---------- Scalar ---------- */
+
+
+/**
+ * This function writes bits in the LSB of the blue channel.
+ *
+ * @param pixels First RGB pixel
+ * @param bits Bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+void embed_lsb_scalar(byte *pixels, const byte *bits, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++) {
+        pixels[i * BYTES_PER_PIXEL + COLUMN_START] = (pixels[i * BYTES_PER_PIXEL + COLUMN_START] & mask_0) | (bits[i] & mask_1);
+    }
+}
+
+
+/**
+ * This function reads bits from the LSB of the blue channel.
+ *
+ * @param pixels First RGB pixel
+ * @param bits Output bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+void extract_lsb_scalar(const byte *pixels, byte *bits, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++) {
+        bits[i] = pixels[i * BYTES_PER_PIXEL + COLUMN_START] & mask_1;
+    }
+}
+
+
+/**
+ * This function calculates the CRC32 with the tables (slicing by 4 bytes).
+ *
+ * @param message Words of the message
+ * @param length Count of words
+ *
+ * @return CRC32 of the message
+*/
+dword crc32_scalar(const word *message, int length){
+
+    /* Declaration and initialization of variables */
+    dword crc = 0xFFFFFFFF;
+    int i;
+
+    /* Two words at once (low byte of a word goes first) */
+    for (i = 0; i + 1 < length; i += 2) {
+
+        crc ^= (dword)message[i] | ((dword)message[i + 1] << 16);
+        crc = crc_table[3][crc & 0xFF] ^ crc_table[2][(crc >> 8) & 0xFF] ^ crc_table[1][(crc >> 16) & 0xFF] ^ crc_table[0][crc >> 24];
+    }
+
+    /* Last odd word */
+    if (i < length) {
+
+        crc ^= message[i];
+        crc = (crc >> 8) ^ crc_table[0][crc & 0xFF];
+        crc = (crc >> 8) ^ crc_table[0][crc & 0xFF];
+    }
+
+    return ~crc;
+}
+
+
+/**
+ * This function swaps the first and the third byte of pixels (BGR <-> RGB).
+ *
+ * @param dst Output pixels (may be equal to src)
+ * @param src Input pixels
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+void swizzle_scalar(byte *dst, const byte *src, int count){
+
+    /* Declaration of variables */
+    int i;
+    byte b;
+
+    for (i = 0; i < count * BYTES_PER_PIXEL; i += BYTES_PER_PIXEL) {
+
+        b = src[i];
+        dst[i + 1] = src[i + 1];
+        dst[i] = src[i + 2];
+        dst[i + 2] = b;
+    }
+}
+
+
+/**
+ * This function splits pixels into three planes.
+ *
+ * @param r Output plane of the first byte of the pixels
+ * @param g Output plane of the second byte
+ * @param b Output plane of the third byte
+ * @param pixels First pixel
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+void deinterleave_scalar(byte *r, byte *g, byte *b, const byte *pixels, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++, pixels += BYTES_PER_PIXEL) {
+
+        r[i] = pixels[0];
+        g[i] = pixels[1];
+        b[i] = pixels[2];
+    }
+}
+
+
+/**
+ * This function joins three planes into pixels.
+ *
+ * @param pixels First pixel
+ * @param r Plane of the first byte of the pixels
+ * @param g Plane of the second byte
+ * @param b Plane of the third byte
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+void interleave_scalar(byte *pixels, const byte *r, const byte *g, const byte *b, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++, pixels += BYTES_PER_PIXEL) {
+
+        pixels[0] = r[i];
+        pixels[1] = g[i];
+        pixels[2] = b[i];
+    }
+}
+
+
+/**
+ * This function replaces the masked bits of the plane by the values.
+ *
+ * @param plane Plane of one channel
+ * @param values Values (only the masked bits are used)
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+void blend_plane_scalar(byte *plane, const byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++) {
+        plane[i] = (plane[i] & ~mask) | (values[i] & mask);
+    }
+}
+
+
+/**
+ * This function reads the masked bits of the plane.
+ *
+ * @param plane Plane of one channel
+ * @param values Output values
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+void mask_plane_scalar(const byte *plane, byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < count; i++) {
+        values[i] = plane[i] & mask;
+    }
+}
+
+
+
+#ifdef X86_KERNELS
+
+/* ---------- SSSE3 ---------- */
+
+
+/**
+ * This function writes bits in the LSB of the blue channel (16 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void embed_lsb_ssse3(byte *pixels, const byte *bits, int count){
+
+    /* Declaration of variables */
+    __m128i b, v;
+    int i, t;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+
+        b = _mm_loadu_si128((const __m128i *)(bits + i));
+
+        for (t = 0; t < 3; t++) {
+
+            v = _mm_loadu_si128((const __m128i *)(pixels + i * BYTES_PER_PIXEL + 16 * t));
+            v = _mm_and_si128(v, _mm_loadu_si128((const __m128i *)embed_keep[t]));
+            v = _mm_or_si128(v, _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)embed_shuffle[t])));
+            _mm_storeu_si128((__m128i *)(pixels + i * BYTES_PER_PIXEL + 16 * t), v);
+        }
+    }
+
+    embed_lsb_scalar(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function reads bits from the LSB of the blue channel (16 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Output bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void extract_lsb_ssse3(const byte *pixels, byte *bits, int count){
+
+    /* Declaration of variables */
+    __m128i b;
+    int i, t;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+
+        b = _mm_setzero_si128();
+
+        for (t = 0; t < 3; t++) {
+            b = _mm_or_si128(b, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pixels + i * BYTES_PER_PIXEL + 16 * t)), _mm_loadu_si128((const __m128i *)extract_shuffle[t])));
+        }
+
+        _mm_storeu_si128((__m128i *)(bits + i), _mm_and_si128(b, _mm_set1_epi8(mask_1)));
+    }
+
+    extract_lsb_scalar(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function swaps R and B of pixels (5 pixels per 16 byte load).
+ *
+ * @param dst Output pixels (may be equal to src)
+ * @param src Input pixels
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void swizzle_ssse3(byte *dst, const byte *src, int count){
+
+    /* Declaration of variables */
+    __m128i mask = _mm_loadu_si128((const __m128i *)swizzle_shuffle);
+    int i;
+
+    /* The 16th byte is written back unchanged and fixed by the next store */
+    for (i = 0; i + 6 <= count; i += 5) {
+        _mm_storeu_si128((__m128i *)(dst + i * BYTES_PER_PIXEL), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * BYTES_PER_PIXEL)), mask));
+    }
+
+    swizzle_scalar(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, count - i);
+}
+
+
+/**
+ * This function splits pixels into three planes (16 pixels at once).
+ *
+ * @param r Output plane of the first byte of the pixels
+ * @param g Output plane of the second byte
+ * @param b Output plane of the third byte
+ * @param pixels First pixel
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void deinterleave_ssse3(byte *r, byte *g, byte *b, const byte *pixels, int count){
+
+    /* Declaration of variables */
+    byte *planes[BYTES_PER_PIXEL] = {r, g, b};
+    __m128i v[3], p;
+    int i, t, ch;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+
+        for (t = 0; t < 3; t++) {
+            v[t] = _mm_loadu_si128((const __m128i *)(pixels + i * BYTES_PER_PIXEL + 16 * t));
+        }
+
+        for (ch = 0; ch < BYTES_PER_PIXEL; ch++) {
+
+            p = _mm_shuffle_epi8(v[0], _mm_loadu_si128((const __m128i *)plane_shuffle[ch][0]));
+            p = _mm_or_si128(p, _mm_shuffle_epi8(v[1], _mm_loadu_si128((const __m128i *)plane_shuffle[ch][1])));
+            p = _mm_or_si128(p, _mm_shuffle_epi8(v[2], _mm_loadu_si128((const __m128i *)plane_shuffle[ch][2])));
+            _mm_storeu_si128((__m128i *)(planes[ch] + i), p);
+        }
+    }
+
+    deinterleave_scalar(r + i, g + i, b + i, pixels + i * BYTES_PER_PIXEL, count - i);
+}
+
+
+/**
+ * This function joins three planes into pixels (16 pixels at once).
+ *
+ * @param pixels First pixel
+ * @param r Plane of the first byte of the pixels
+ * @param g Plane of the second byte
+ * @param b Plane of the third byte
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void interleave_ssse3(byte *pixels, const byte *r, const byte *g, const byte *b, int count){
+
+    /* Declaration of variables */
+    __m128i p[3], v;
+    int i, t;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+
+        p[0] = _mm_loadu_si128((const __m128i *)(r + i));
+        p[1] = _mm_loadu_si128((const __m128i *)(g + i));
+        p[2] = _mm_loadu_si128((const __m128i *)(b + i));
+
+        for (t = 0; t < 3; t++) {
+
+            v = _mm_shuffle_epi8(p[0], _mm_loadu_si128((const __m128i *)merge_shuffle[0][t]));
+            v = _mm_or_si128(v, _mm_shuffle_epi8(p[1], _mm_loadu_si128((const __m128i *)merge_shuffle[1][t])));
+            v = _mm_or_si128(v, _mm_shuffle_epi8(p[2], _mm_loadu_si128((const __m128i *)merge_shuffle[2][t])));
+            _mm_storeu_si128((__m128i *)(pixels + i * BYTES_PER_PIXEL + 16 * t), v);
+        }
+    }
+
+    interleave_scalar(pixels + i * BYTES_PER_PIXEL, r + i, g + i, b + i, count - i);
+}
+
+
+/**
+ * This function replaces the masked bits of the plane by the values (16 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Values (only the masked bits are used)
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void blend_plane_ssse3(byte *plane, const byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m128i m = _mm_set1_epi8((char)mask), v;
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+
+        v = _mm_andnot_si128(m, _mm_loadu_si128((const __m128i *)(plane + i)));
+        v = _mm_or_si128(v, _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(values + i))));
+        _mm_storeu_si128((__m128i *)(plane + i), v);
+    }
+
+    blend_plane_scalar(plane + i, values + i, mask, count - i);
+}
+
+
+/**
+ * This function reads the masked bits of the plane (16 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Output values
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("ssse3")))
+void mask_plane_ssse3(const byte *plane, byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m128i m = _mm_set1_epi8((char)mask);
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        _mm_storeu_si128((__m128i *)(values + i), _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(plane + i))));
+    }
+
+    mask_plane_scalar(plane + i, values + i, mask, count - i);
+}
+
+
+
+/* ---------- AVX2 ---------- */
+
+
+/**
+ * This function joins two 16 byte tables into one 32 byte vector.
+ *
+ * @param lo Table of the low lane
+ * @param hi Table of the high lane
+ *
+ * @return Vector
+*/
+__attribute__((target("avx2")))
+static inline __m256i lanes_avx2(const byte *lo, const byte *hi){
+
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)lo)), _mm_loadu_si128((const __m128i *)hi), 1);
+}
+
+
+/**
+ * This function writes bits in the LSB of the blue channel (32 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void embed_lsb_avx2(byte *pixels, const byte *bits, int count){
+
+    /* Declaration of variables */
+    __m256i shuffle[3], keep[3], b, w[3], v;
+    int i, q;
+
+    /* Vector q holds the 16 byte chunks 2q and 2q + 1 of two blocks of 16 pixels */
+    shuffle[0] = lanes_avx2(embed_shuffle[0], embed_shuffle[1]);
+    shuffle[1] = lanes_avx2(embed_shuffle[2], embed_shuffle[0]);
+    shuffle[2] = lanes_avx2(embed_shuffle[1], embed_shuffle[2]);
+    keep[0] = lanes_avx2(embed_keep[0], embed_keep[1]);
+    keep[1] = lanes_avx2(embed_keep[2], embed_keep[0]);
+    keep[2] = lanes_avx2(embed_keep[1], embed_keep[2]);
+
+    for (i = 0; i + 32 <= count; i += 32) {
+
+        /* Bits of the block used by each lane */
+        b = _mm256_loadu_si256((const __m256i *)(bits + i));
+        w[0] = _mm256_permute2x128_si256(b, b, 0x00);
+        w[1] = b;
+        w[2] = _mm256_permute2x128_si256(b, b, 0x11);
+
+        for (q = 0; q < 3; q++) {
+
+            v = _mm256_loadu_si256((const __m256i *)(pixels + i * BYTES_PER_PIXEL + 32 * q));
+            v = _mm256_or_si256(_mm256_and_si256(v, keep[q]), _mm256_shuffle_epi8(w[q], shuffle[q]));
+            _mm256_storeu_si256((__m256i *)(pixels + i * BYTES_PER_PIXEL + 32 * q), v);
+        }
+    }
+
+    embed_lsb_ssse3(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function reads bits from the LSB of the blue channel (32 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Output bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void extract_lsb_avx2(const byte *pixels, byte *bits, int count){
+
+    /* Declaration of variables */
+    __m256i shuffle[3], v[3], b;
+    int i, t;
+
+    for (t = 0; t < 3; t++) {
+        shuffle[t] = lanes_avx2(extract_shuffle[t], extract_shuffle[t]);
+    }
+
+    for (i = 0; i + 32 <= count; i += 32) {
+
+        for (t = 0; t < 3; t++) {
+            v[t] = _mm256_loadu_si256((const __m256i *)(pixels + i * BYTES_PER_PIXEL + 32 * t));
+        }
+
+        /* Lane m of the shuffled vector t is the chunk 3m + t */
+        b = _mm256_shuffle_epi8(_mm256_permute2x128_si256(v[0], v[1], 0x30), shuffle[0]);
+        b = _mm256_or_si256(b, _mm256_shuffle_epi8(_mm256_permute2x128_si256(v[0], v[2], 0x21), shuffle[1]));
+        b = _mm256_or_si256(b, _mm256_shuffle_epi8(_mm256_permute2x128_si256(v[1], v[2], 0x30), shuffle[2]));
+
+        _mm256_storeu_si256((__m256i *)(bits + i), _mm256_and_si256(b, _mm256_set1_epi8(mask_1)));
+    }
+
+    extract_lsb_ssse3(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function swaps R and B of pixels (10 pixels per iteration).
+ *
+ * @param dst Output pixels (may be equal to src)
+ * @param src Input pixels
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void swizzle_avx2(byte *dst, const byte *src, int count){
+
+    /* Declaration of variables */
+    __m256i mask = lanes_avx2(swizzle_shuffle, swizzle_shuffle), v;
+    int i;
+
+    for (i = 0; i + 11 <= count; i += 10) {
+
+        v = lanes_avx2(src + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL + 15);
+        v = _mm256_shuffle_epi8(v, mask);
+
+        /* Low lane first, its 16th byte is overwritten by the high lane */
+        _mm_storeu_si128((__m128i *)(dst + i * BYTES_PER_PIXEL), _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(dst + i * BYTES_PER_PIXEL + 15), _mm256_extracti128_si256(v, 1));
+    }
+
+    swizzle_ssse3(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, count - i);
+}
+
+
+/**
+ * This function splits pixels into three planes (32 pixels at once).
+ *
+ * @param r Output plane of the first byte of the pixels
+ * @param g Output plane of the second byte
+ * @param b Output plane of the third byte
+ * @param pixels First pixel
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void deinterleave_avx2(byte *r, byte *g, byte *b, const byte *pixels, int count){
+
+    /* Declaration of variables */
+    byte *planes[BYTES_PER_PIXEL] = {r, g, b};
+    __m256i shuffle[BYTES_PER_PIXEL][3], v[3], x[3], p;
+    int i, t, ch;
+
+    for (ch = 0; ch < BYTES_PER_PIXEL; ch++) {
+        for (t = 0; t < 3; t++) {
+            shuffle[ch][t] = lanes_avx2(plane_shuffle[ch][t], plane_shuffle[ch][t]);
+        }
+    }
+
+    for (i = 0; i + 32 <= count; i += 32) {
+
+        for (t = 0; t < 3; t++) {
+            v[t] = _mm256_loadu_si256((const __m256i *)(pixels + i * BYTES_PER_PIXEL + 32 * t));
+        }
+
+        /* Lane m of the vector t is the chunk 3m + t */
+        x[0] = _mm256_permute2x128_si256(v[0], v[1], 0x30);
+        x[1] = _mm256_permute2x128_si256(v[0], v[2], 0x21);
+        x[2] = _mm256_permute2x128_si256(v[1], v[2], 0x30);
+
+        for (ch = 0; ch < BYTES_PER_PIXEL; ch++) {
+
+            p = _mm256_shuffle_epi8(x[0], shuffle[ch][0]);
+            p = _mm256_or_si256(p, _mm256_shuffle_epi8(x[1], shuffle[ch][1]));
+            p = _mm256_or_si256(p, _mm256_shuffle_epi8(x[2], shuffle[ch][2]));
+            _mm256_storeu_si256((__m256i *)(planes[ch] + i), p);
+        }
+    }
+
+    deinterleave_ssse3(r + i, g + i, b + i, pixels + i * BYTES_PER_PIXEL, count - i);
+}
+
+
+/**
+ * This function joins three planes into pixels (32 pixels at once).
+ *
+ * @param pixels First pixel
+ * @param r Plane of the first byte of the pixels
+ * @param g Plane of the second byte
+ * @param b Plane of the third byte
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void interleave_avx2(byte *pixels, const byte *r, const byte *g, const byte *b, int count){
+
+    /* Declaration of variables */
+    __m256i shuffle[BYTES_PER_PIXEL][3], p[3], x[3];
+    int i, t, ch;
+
+    for (ch = 0; ch < BYTES_PER_PIXEL; ch++) {
+        for (t = 0; t < 3; t++) {
+            shuffle[ch][t] = lanes_avx2(merge_shuffle[ch][t], merge_shuffle[ch][t]);
+        }
+    }
+
+    for (i = 0; i + 32 <= count; i += 32) {
+
+        p[0] = _mm256_loadu_si256((const __m256i *)(r + i));
+        p[1] = _mm256_loadu_si256((const __m256i *)(g + i));
+        p[2] = _mm256_loadu_si256((const __m256i *)(b + i));
+
+        /* Lane m of the vector t is the chunk 3m + t */
+        for (t = 0; t < 3; t++) {
+
+            x[t] = _mm256_shuffle_epi8(p[0], shuffle[0][t]);
+            x[t] = _mm256_or_si256(x[t], _mm256_shuffle_epi8(p[1], shuffle[1][t]));
+            x[t] = _mm256_or_si256(x[t], _mm256_shuffle_epi8(p[2], shuffle[2][t]));
+        }
+
+        /* Chunks 0 1, 2 3 and 4 5 */
+        _mm256_storeu_si256((__m256i *)(pixels + i * BYTES_PER_PIXEL), _mm256_permute2x128_si256(x[0], x[1], 0x20));
+        _mm256_storeu_si256((__m256i *)(pixels + i * BYTES_PER_PIXEL + 32), _mm256_permute2x128_si256(x[2], x[0], 0x30));
+        _mm256_storeu_si256((__m256i *)(pixels + i * BYTES_PER_PIXEL + 64), _mm256_permute2x128_si256(x[1], x[2], 0x31));
+    }
+
+    interleave_ssse3(pixels + i * BYTES_PER_PIXEL, r + i, g + i, b + i, count - i);
+}
+
+
+/**
+ * This function replaces the masked bits of the plane by the values (32 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Values (only the masked bits are used)
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void blend_plane_avx2(byte *plane, const byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m256i m = _mm256_set1_epi8((char)mask), v;
+    int i;
+
+    for (i = 0; i + 32 <= count; i += 32) {
+
+        v = _mm256_andnot_si256(m, _mm256_loadu_si256((const __m256i *)(plane + i)));
+        v = _mm256_or_si256(v, _mm256_and_si256(m, _mm256_loadu_si256((const __m256i *)(values + i))));
+        _mm256_storeu_si256((__m256i *)(plane + i), v);
+    }
+
+    blend_plane_ssse3(plane + i, values + i, mask, count - i);
+}
+
+
+/**
+ * This function reads the masked bits of the plane (32 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Output values
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("avx2")))
+void mask_plane_avx2(const byte *plane, byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m256i m = _mm256_set1_epi8((char)mask);
+    int i;
+
+    for (i = 0; i + 32 <= count; i += 32) {
+        _mm256_storeu_si256((__m256i *)(values + i), _mm256_and_si256(m, _mm256_loadu_si256((const __m256i *)(plane + i))));
+    }
+
+    mask_plane_ssse3(plane + i, values + i, mask, count - i);
+}
+
+
+
+/* ---------- AVX-512 ---------- */
+
+
+/**
+ * This function joins four 16 byte tables into one 64 byte vector.
+ *
+ * @param l0 Table of the lane 0
+ * @param l1 Table of the lane 1
+ * @param l2 Table of the lane 2
+ * @param l3 Table of the lane 3
+ *
+ * @return Vector
+*/
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i lanes_avx512(const byte *l0, const byte *l1, const byte *l2, const byte *l3){
+
+    /* Declaration of variables */
+    __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)l0));
+
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)l1), 1);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)l2), 2);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)l3), 3);
+
+    return v;
+}
+
+
+/**
+ * This function writes bits in the LSB of the blue channel (64 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx512f,avx512bw")))
+void embed_lsb_avx512(byte *pixels, const byte *bits, int count){
+
+    /* Declaration of variables */
+    __m512i shuffle[3], keep[3], b, w[3], v;
+    int i, q;
+
+    /* Vector q holds the 16 byte chunks 4q .. 4q + 3 of four blocks of 16 pixels */
+    shuffle[0] = lanes_avx512(embed_shuffle[0], embed_shuffle[1], embed_shuffle[2], embed_shuffle[0]);
+    shuffle[1] = lanes_avx512(embed_shuffle[1], embed_shuffle[2], embed_shuffle[0], embed_shuffle[1]);
+    shuffle[2] = lanes_avx512(embed_shuffle[2], embed_shuffle[0], embed_shuffle[1], embed_shuffle[2]);
+    keep[0] = lanes_avx512(embed_keep[0], embed_keep[1], embed_keep[2], embed_keep[0]);
+    keep[1] = lanes_avx512(embed_keep[1], embed_keep[2], embed_keep[0], embed_keep[1]);
+    keep[2] = lanes_avx512(embed_keep[2], embed_keep[0], embed_keep[1], embed_keep[2]);
+
+    for (i = 0; i + 64 <= count; i += 64) {
+
+        /* Bits of the block used by each lane (blocks 0001, 1122, 2333) */
+        b = _mm512_loadu_si512((const void *)(bits + i));
+        w[0] = _mm512_shuffle_i32x4(b, b, 0x40);
+        w[1] = _mm512_shuffle_i32x4(b, b, 0xA5);
+        w[2] = _mm512_shuffle_i32x4(b, b, 0xFE);
+
+        for (q = 0; q < 3; q++) {
+
+            v = _mm512_loadu_si512((const void *)(pixels + i * BYTES_PER_PIXEL + 64 * q));
+            v = _mm512_or_si512(_mm512_and_si512(v, keep[q]), _mm512_shuffle_epi8(w[q], shuffle[q]));
+            _mm512_storeu_si512((void *)(pixels + i * BYTES_PER_PIXEL + 64 * q), v);
+        }
+    }
+
+    embed_lsb_avx2(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function reads bits from the LSB of the blue channel (64 pixels at once).
+ *
+ * @param pixels First RGB pixel
+ * @param bits Output bits (one per byte)
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx512f,avx512bw")))
+void extract_lsb_avx512(const byte *pixels, byte *bits, int count){
+
+    /* Declaration of variables */
+    __m512i shuffle[3], v[3], x, b;
+    int i, t;
+
+    for (t = 0; t < 3; t++) {
+        shuffle[t] = lanes_avx512(extract_shuffle[t], extract_shuffle[t], extract_shuffle[t], extract_shuffle[t]);
+    }
+
+    for (i = 0; i + 64 <= count; i += 64) {
+
+        for (t = 0; t < 3; t++) {
+            v[t] = _mm512_loadu_si512((const void *)(pixels + i * BYTES_PER_PIXEL + 64 * t));
+        }
+
+        /* Lane m of the gathered vector t is the chunk 3m + t (chunk c is the lane c % 4 of v[c / 4]) */
+        x = _mm512_permutex2var_epi64(v[0], _mm512_set_epi64(0, 0, 13, 12, 7, 6, 1, 0), v[1]);
+        x = _mm512_mask_permutexvar_epi64(x, 0xC0, _mm512_set_epi64(3, 2, 0, 0, 0, 0, 0, 0), v[2]);
+        b = _mm512_shuffle_epi8(x, shuffle[0]);
+
+        x = _mm512_permutex2var_epi64(v[0], _mm512_set_epi64(0, 0, 15, 14, 9, 8, 3, 2), v[1]);
+        x = _mm512_mask_permutexvar_epi64(x, 0xC0, _mm512_set_epi64(5, 4, 0, 0, 0, 0, 0, 0), v[2]);
+        b = _mm512_or_si512(b, _mm512_shuffle_epi8(x, shuffle[1]));
+
+        x = _mm512_permutex2var_epi64(v[0], _mm512_set_epi64(0, 0, 0, 0, 11, 10, 5, 4), v[1]);
+        x = _mm512_mask_permutexvar_epi64(x, 0xF0, _mm512_set_epi64(7, 6, 1, 0, 0, 0, 0, 0), v[2]);
+        b = _mm512_or_si512(b, _mm512_shuffle_epi8(x, shuffle[2]));
+
+        _mm512_storeu_si512((void *)(bits + i), _mm512_and_si512(b, _mm512_set1_epi8(mask_1)));
+    }
+
+    extract_lsb_avx2(pixels + i * BYTES_PER_PIXEL, bits + i, count - i);
+}
+
+
+/**
+ * This function swaps R and B of pixels (20 pixels per iteration).
+ *
+ * @param dst Output pixels (may be equal to src)
+ * @param src Input pixels
+ * @param count Count of pixels
+ *
+ * @return void
+*/
+__attribute__((target("avx512f,avx512bw")))
+void swizzle_avx512(byte *dst, const byte *src, int count){
+
+    /* Declaration of variables */
+    __m512i mask = lanes_avx512(swizzle_shuffle, swizzle_shuffle, swizzle_shuffle, swizzle_shuffle), v;
+    int i;
+    const byte *s;
+    byte *d;
+
+    for (i = 0; i + 21 <= count; i += 20) {
+
+        s = src + i * BYTES_PER_PIXEL;
+        d = dst + i * BYTES_PER_PIXEL;
+
+        v = _mm512_shuffle_epi8(lanes_avx512(s, s + 15, s + 30, s + 45), mask);
+
+        /* In order, the 16th byte of each lane is overwritten by the next one */
+        _mm_storeu_si128((__m128i *)d, _mm512_castsi512_si128(v));
+        _mm_storeu_si128((__m128i *)(d + 15), _mm512_extracti32x4_epi32(v, 1));
+        _mm_storeu_si128((__m128i *)(d + 30), _mm512_extracti32x4_epi32(v, 2));
+        _mm_storeu_si128((__m128i *)(d + 45), _mm512_extracti32x4_epi32(v, 3));
+    }
+
+    swizzle_avx2(dst + i * BYTES_PER_PIXEL, src + i * BYTES_PER_PIXEL, count - i);
+}
+
+
+/**
+ * This function replaces the masked bits of the plane by the values (64 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Values (only the masked bits are used)
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("avx512f,avx512bw")))
+void blend_plane_avx512(byte *plane, const byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m512i m = _mm512_set1_epi8((char)mask);
+    int i;
+
+    /* Bit select: mask ? values : plane */
+    for (i = 0; i + 64 <= count; i += 64) {
+        _mm512_storeu_si512((void *)(plane + i), _mm512_ternarylogic_epi32(m, _mm512_loadu_si512((const void *)(values + i)), _mm512_loadu_si512((const void *)(plane + i)), 0xCA));
+    }
+
+    blend_plane_avx2(plane + i, values + i, mask, count - i);
+}
+
+
+/**
+ * This function reads the masked bits of the plane (64 bytes at once).
+ *
+ * @param plane Plane of one channel
+ * @param values Output values
+ * @param mask Mask of the LSBs
+ * @param count Count of bytes
+ *
+ * @return void
+*/
+__attribute__((target("avx512f,avx512bw")))
+void mask_plane_avx512(const byte *plane, byte *values, byte mask, int count){
+
+    /* Declaration of variables */
+    __m512i m = _mm512_set1_epi8((char)mask);
+    int i;
+
+    for (i = 0; i + 64 <= count; i += 64) {
+        _mm512_storeu_si512((void *)(values + i), _mm512_and_si512(m, _mm512_loadu_si512((const void *)(plane + i))));
+    }
+
+    mask_plane_avx2(plane + i, values + i, mask, count - i);
+}
+
+
+
+/* ---------- PCLMULQDQ ---------- */
+
+
+/**
+ * This function folds 128 bits forward (the distance is given by the constants).
+ *
+ * @param x Folded value
+ * @param k Folding constants
+ *
+ * @return Value congruent with x moved by the distance
+*/
+__attribute__((target("sse4.1,pclmul")))
+static inline __m128i crc32_fold(__m128i x, __m128i k){
+
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+
+/**
+ * This function calculates the CRC32 by folding 64 bytes at once with carry-less multiplication.
+ *
+ * @param message Words of the message
+ * @param length Count of words
+ *
+ * @return CRC32 of the message
+*/
+__attribute__((target("sse4.1,pclmul")))
+dword crc32_pclmul(const word *message, int length){
+
+    /* Declaration and initialization of variables */
+    const byte *data = (const byte *)message;
+    long size = (long)length * (long)sizeof(word), i = 0;
+    __m128i k16, k64, x0, x1, x2, x3;
+    byte rest[16];
+
+    /* Too short to fold */
+    if (size < 16) {
+        return ~crc32_bytes(0xFFFFFFFF, data, size);
+    }
+
+    k16 = _mm_set_epi64x((long long)fold_16[1], (long long)fold_16[0]);
+    k64 = _mm_set_epi64x((long long)fold_64[1], (long long)fold_64[0]);
+
+    /* Initial value of the CRC is xored into the first bytes */
+    x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), _mm_cvtsi32_si128((int)0xFFFFFFFF));
+    i = 16;
+
+    if (size >= 64) {
+
+        x1 = _mm_loadu_si128((const __m128i *)(data + 16));
+        x2 = _mm_loadu_si128((const __m128i *)(data + 32));
+        x3 = _mm_loadu_si128((const __m128i *)(data + 48));
+        i = 64;
+
+        for (; i + 64 <= size; i += 64) {
+            x0 = _mm_xor_si128(crc32_fold(x0, k64), _mm_loadu_si128((const __m128i *)(data + i)));
+            x1 = _mm_xor_si128(crc32_fold(x1, k64), _mm_loadu_si128((const __m128i *)(data + i + 16)));
+            x2 = _mm_xor_si128(crc32_fold(x2, k64), _mm_loadu_si128((const __m128i *)(data + i + 32)));
+            x3 = _mm_xor_si128(crc32_fold(x3, k64), _mm_loadu_si128((const __m128i *)(data + i + 48)));
+        }
+
+        x1 = _mm_xor_si128(crc32_fold(x0, k16), x1);
+        x2 = _mm_xor_si128(crc32_fold(x1, k16), x2);
+        x0 = _mm_xor_si128(crc32_fold(x2, k16), x3);
+    }
+
+    for (; i + 16 <= size; i += 16) {
+        x0 = _mm_xor_si128(crc32_fold(x0, k16), _mm_loadu_si128((const __m128i *)(data + i)));
+    }
+
+    /* The remainder is congruent with everything before it, finish with the tables */
+    _mm_storeu_si128((__m128i *)rest, x0);
+
+    return ~crc32_bytes(crc32_bytes(0, rest, 16), data + i, size - i);
+}
+
+#endif
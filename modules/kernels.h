@@ -0,0 +1,73 @@
+/* KERNELS.H */
+
+/* Inclusion guard */
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* x86 variants are compiled with target attributes, so the baseline flags stay -std=c99 */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define X86_KERNELS 1
+#endif
+
+
+
+/* Prototypes */
+
+/**
+ * This function initializes the lookup tables used by the kernels.
+ *
+ * @return void
+*/
+void init_kernel_tables(void);
+
+
+/* Scalar variants (every CPU) */
+void embed_lsb_scalar(byte *pixels, const byte *bits, int count);
+void extract_lsb_scalar(const byte *pixels, byte *bits, int count);
+dword crc32_scalar(const word *message, int length);
+void swizzle_scalar(byte *dst, const byte *src, int count);
+void deinterleave_scalar(byte *r, byte *g, byte *b, const byte *pixels, int count);
+void interleave_scalar(byte *pixels, const byte *r, const byte *g, const byte *b, int count);
+void blend_plane_scalar(byte *plane, const byte *values, byte mask, int count);
+void mask_plane_scalar(const byte *plane, byte *values, byte mask, int count);
+
+
+#ifdef X86_KERNELS
+
+/* SSSE3 variants */
+void embed_lsb_ssse3(byte *pixels, const byte *bits, int count);
+void extract_lsb_ssse3(const byte *pixels, byte *bits, int count);
+void swizzle_ssse3(byte *dst, const byte *src, int count);
+void deinterleave_ssse3(byte *r, byte *g, byte *b, const byte *pixels, int count);
+void interleave_ssse3(byte *pixels, const byte *r, const byte *g, const byte *b, int count);
+void blend_plane_ssse3(byte *plane, const byte *values, byte mask, int count);
+void mask_plane_ssse3(const byte *plane, byte *values, byte mask, int count);
+
+/* AVX2 variants */
+void embed_lsb_avx2(byte *pixels, const byte *bits, int count);
+void extract_lsb_avx2(const byte *pixels, byte *bits, int count);
+void swizzle_avx2(byte *dst, const byte *src, int count);
+void deinterleave_avx2(byte *r, byte *g, byte *b, const byte *pixels, int count);
+void interleave_avx2(byte *pixels, const byte *r, const byte *g, const byte *b, int count);
+void blend_plane_avx2(byte *plane, const byte *values, byte mask, int count);
+void mask_plane_avx2(const byte *plane, byte *values, byte mask, int count);
+
+/* AVX-512 (F + BW) variants (the AVX2 deinterleave / interleave are used with them) */
+void embed_lsb_avx512(byte *pixels, const byte *bits, int count);
+void extract_lsb_avx512(const byte *pixels, byte *bits, int count);
+void swizzle_avx512(byte *dst, const byte *src, int count);
+void blend_plane_avx512(byte *plane, const byte *values, byte mask, int count);
+void mask_plane_avx512(const byte *plane, byte *values, byte mask, int count);
+
+/* Carry-less multiplication CRC (PCLMULQDQ) */
+dword crc32_pclmul(const word *message, int length);
+
+#endif
+
+
+#endif
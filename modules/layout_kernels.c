@@ -0,0 +1,141 @@
+/* LAYOUT_KERNELS.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "layout_kernels.h"
+
+
+/*
+ * Every kernel is generated from one template, so the count of channels, the depth and the code
+ * width are constants: the shifts and masks are folded and the loop over the channels is unrolled.
+ * Data must have one spare byte after the last bit (bitstream_init allocates it).
+*/
+
+
+/* Splitting and joining the bits of N channels with D LSBs (N * D is at most 9 bits, two bytes are enough) */
+#define DEFINE_LAYOUT_KERNEL(N, D) \
+static void split_##N##_##D(const byte *data, long position, byte *const values[], int count){ \
+\
+    /* Declaration of variables */ \
+    dword window; \
+    int p, c; \
+\
+    for (p = 0; p < count; p++, position += (N) * (D)) { \
+\
+        window = (((dword)data[position >> 3] << 8) | data[(position >> 3) + 1]) >> (16 - (position & 7) - (N) * (D)); \
+\
+        /* The last channel has the lowest bits */ \
+        for (c = (N) - 1; c >= 0; c--, window >>= (D)) { \
+            values[c][p] = (byte)(window & ((1u << (D)) - 1)); \
+        } \
+    } \
+} \
+\
+static void join_##N##_##D(byte *data, long position, byte *const values[], int count){ \
+\
+    /* Declaration of variables */ \
+    dword value; \
+    int p, c; \
+\
+    for (p = 0; p < count; p++, position += (N) * (D)) { \
+\
+        for (value = 0, c = 0; c < (N); c++) { \
+            value = (value << (D)) | (values[c][p] & ((1u << (D)) - 1)); \
+        } \
+\
+        value <<= 16 - (position & 7) - (N) * (D); \
+        data[position >> 3] |= (byte)(value >> 8); \
+        data[(position >> 3) + 1] |= (byte)value; \
+    } \
+}
+
+LAYOUT_KERNELS(DEFINE_LAYOUT_KERNEL)
+
+
+/* Writing and reading codes of W bits (W is at most 17 bits, three bytes are enough) */
+#define DEFINE_CODE_KERNEL(W) \
+static void put_codes_##W(byte *data, long position, const word *codes, int count){ \
+\
+    /* Declaration of variables */ \
+    dword window; \
+    int i; \
+\
+    for (i = 0; i < count; i++, position += (W)) { \
+\
+        window = ((dword)codes[i] & ((1u << (W)) - 1)) << (24 - (position & 7) - (W)); \
+        data[position >> 3] |= (byte)(window >> 16); \
+        data[(position >> 3) + 1] |= (byte)(window >> 8); \
+        data[(position >> 3) + 2] |= (byte)window; \
+    } \
+} \
+\
+static void get_codes_##W(const byte *data, long position, word *codes, int count){ \
+\
+    /* Declaration of variables */ \
+    dword window; \
+    int i; \
+\
+    for (i = 0; i < count; i++, position += (W)) { \
+\
+        window = ((dword)data[position >> 3] << 16) | ((dword)data[(position >> 3) + 1] << 8) | data[(position >> 3) + 2]; \
+        codes[i] = (word)((window >> (24 - (position & 7) - (W))) & ((1u << (W)) - 1)); \
+    } \
+}
+
+CODE_KERNELS(DEFINE_CODE_KERNEL)
+
+
+/* Tables of the kernels */
+#define LAYOUT_ENTRY(N, D) {N, D, split_##N##_##D, join_##N##_##D},
+#define CODE_ENTRY(W) {W, put_codes_##W, get_codes_##W},
+
+static const layout_kernel layout_table[] = { LAYOUT_KERNELS(LAYOUT_ENTRY) };
+static const code_kernel code_table[] = { CODE_KERNELS(CODE_ENTRY) };
+
+
+
+/**
+ * This function finds the specialised kernel of the layout.
+ * 
+ * @param count Count of channels
+ * @param depth LSBs per channel
+ * 
+ * @return Kernel or NULL if the layout has none
+*/
+const layout_kernel *find_layout_kernel(int count, int depth){
+
+    /* Declaration of variables */
+    size_t i;
+
+    for (i = 0; i < sizeof(layout_table) / sizeof(layout_table[0]); i++) {
+
+        if (layout_table[i].count == count && layout_table[i].depth == depth) {
+            return &layout_table[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * This function finds the specialised kernel of the code width.
+ * 
+ * @param width Bits of one code
+ * 
+ * @return Kernel or NULL if the width has none
+*/
+const code_kernel *find_code_kernel(int width){
+
+    /* Declaration of variables */
+    size_t i;
+
+    for (i = 0; i < sizeof(code_table) / sizeof(code_table[0]); i++) {
+
+        if (code_table[i].width == width) {
+            return &code_table[i];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,81 @@
+/* LAYOUT_KERNELS.H */
+
+/* Inclusion guard */
+#ifndef __LAYOUT_KERNELS_H__
+#define __LAYOUT_KERNELS_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Layouts with a specialised kernel: X(count of channels, LSBs per channel) */
+#define LAYOUT_KERNELS(X) \
+    X(1, 1) X(1, 2) X(1, 3) \
+    X(2, 1) X(2, 2) X(2, 3) \
+    X(3, 1) X(3, 2) X(3, 3)
+
+/* Code widths with a specialised kernel (COMPRESSED_SIZE of the LZW is one of them) */
+#define CODE_KERNELS(X) \
+    X(9) X(10) X(11) X(12) X(16)
+
+
+
+/* Structures */
+
+/* Kernels of one layout (bits of whole pixels <-> values of the channels) */
+typedef struct {
+
+    /* Count of channels and LSBs per channel */
+    int count;
+    int depth;
+
+    /* Splits the bits (MSB first, from the position) of count pixels into the values of the channels */
+    void (*split)(const byte *data, long position, byte *const values[], int count);
+
+    /* Joins the values of the channels of count pixels into the bits (ORed in from the position) */
+    void (*join)(byte *data, long position, byte *const values[], int count);
+
+} layout_kernel;
+
+
+/* Kernels of one code width (codes <-> bits) */
+typedef struct {
+
+    /* Bits of one code */
+    int width;
+
+    /* Writes count codes (ORed in from the position, MSB first) */
+    void (*put)(byte *data, long position, const word *codes, int count);
+
+    /* Reads count codes from the position */
+    void (*get)(const byte *data, long position, word *codes, int count);
+
+} code_kernel;
+
+
+
+/* Prototypes */
+
+/**
+ * This function finds the specialised kernel of the layout.
+ * 
+ * @param count Count of channels
+ * @param depth LSBs per channel
+ * 
+ * @return Kernel or NULL if the layout has none
+*/
+const layout_kernel *find_layout_kernel(int count, int depth);
+
+
+/**
+ * This function finds the specialised kernel of the code width.
+ * 
+ * @param width Bits of one code
+ * 
+ * @return Kernel or NULL if the width has none
+*/
+const code_kernel *find_code_kernel(int width);
+
+
+#endif
@@ -0,0 +1,145 @@
+/* PARALLEL.C */
+
+/* sysconf() is POSIX, the rest of the build is plain C99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+
+
+/* Shared state of the workers */
+typedef struct {
+
+    /* Task function and its argument */
+    void (*task)(void *arg, int index);
+    void *arg;
+
+    /* Next task to be taken and count of tasks */
+    int next;
+    int tasks;
+
+    /* Lock of next */
+    pthread_mutex_t lock;
+
+} work;
+
+
+
+/**
+ * This function returns the count of online CPUs.
+ *
+ * @return Count of CPUs (at least 1)
+*/
+int cpu_count(void){
+
+    /* Declaration and initialization of variables */
+    long count = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count < 1) count = 1;
+    if (count > MAX_THREADS) count = MAX_THREADS;
+
+    return (int)count;
+}
+
+
+/**
+ * This function takes tasks until there are none left.
+ *
+ * @param arg Pointer to the shared work
+ *
+ * @return NULL
+*/
+static void *worker(void *arg){
+
+    /* Declaration and initialization of variables */
+    work *w = (work *)arg;
+    int index;
+
+    for (;;) {
+
+        pthread_mutex_lock(&w->lock);
+        index = w->next++;
+        pthread_mutex_unlock(&w->lock);
+
+        if (index >= w->tasks) break;
+
+        w->task(w->arg, index);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * This function runs tasks 0 .. tasks - 1 on up to threads worker threads.
+ * Tasks are taken in order, so neighbouring tasks run at the same time.
+ *
+ * @param threads Count of threads (THREADS_AUTO for every CPU, 1 runs the tasks in this thread)
+ * @param tasks Count of tasks
+ * @param task Function called for every task
+ * @param arg Argument passed to every task
+ *
+ * @return SUCCESS or FAILURE if the threads could not be joined
+*/
+int parallel_for(int threads, int tasks, void (*task)(void *arg, int index), void *arg){
+
+    /* Declaration and initialization of variables */
+    pthread_t ids[MAX_THREADS];
+    int i, started = 0, ret = SUCCESS;
+    work w;
+
+    /* Sanity check */
+    if (!task || tasks < 0) {
+        printf("Error in parallel_for!\n");
+        return FAILURE;
+    }
+
+    if (threads == THREADS_AUTO) threads = cpu_count();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads > tasks) threads = tasks;
+
+    w.task = task;
+    w.arg = arg;
+    w.next = 0;
+    w.tasks = tasks;
+
+    /* Nothing to share */
+    if (threads <= 1) {
+
+        for (i = 0; i < tasks; i++) {
+            task(arg, i);
+        }
+
+        return SUCCESS;
+    }
+
+    if (pthread_mutex_init(&w.lock, NULL) != 0) {
+        printf("Error in parallel_for!\n");
+        return FAILURE;
+    }
+
+    /* This thread is the last worker */
+    for (i = 0; i < threads - 1; i++) {
+
+        if (pthread_create(&ids[i], NULL, worker, &w) != 0) break;
+        started++;
+    }
+
+    worker(&w);
+
+    for (i = 0; i < started; i++) {
+
+        if (pthread_join(ids[i], NULL) != 0) ret = FAILURE;
+    }
+
+    pthread_mutex_destroy(&w.lock);
+
+    return ret;
+}
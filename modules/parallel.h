@@ -0,0 +1,43 @@
+/* PARALLEL.H */
+
+/* Inclusion guard */
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Use every online CPU (--threads auto) */
+#define THREADS_AUTO 0
+
+/* Upper bound of the worker threads */
+#define MAX_THREADS 256
+
+
+/* Prototypes */
+
+/**
+ * This function returns the count of online CPUs.
+ *
+ * @return Count of CPUs (at least 1)
+*/
+int cpu_count(void);
+
+
+/**
+ * This function runs tasks 0 .. tasks - 1 on up to threads worker threads.
+ * Tasks are taken in order, so neighbouring tasks run at the same time.
+ *
+ * @param threads Count of threads (THREADS_AUTO for every CPU, 1 runs the tasks in this thread)
+ * @param tasks Count of tasks
+ * @param task Function called for every task
+ * @param arg Argument passed to every task
+ *
+ * @return SUCCESS or FAILURE if the threads could not be joined
+*/
+int parallel_for(int threads, int tasks, void (*task)(void *arg, int index), void *arg);
+
+
+#endif
@@ -4,481 +4,2630 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <png.h>
 #include "lzw.h"
 #include "pixel_secrets.h"
 #include "input.h"
+#include "cpu_dispatch.h"
+#include "parallel.h"
 
 
 /**
- * This function frees the memory allocated for the row_pointers.
+ * This function allocates the bitstream.
  * 
- * @param row_pointers Array of png_bytep
- * @param row_count Number of rows
+ * @param bs Bitstream to be initialized
+ * @param capacity Count of bits to be stored
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int bitstream_init(bitstream *bs, long capacity){
+
+    /* Sanity check */
+    if (!bs || capacity < 0) {
+        printf("Error in bitstream_init!\n");
+        return FAILURE;
+    }
+
+    /* One spare byte for appending at a bit offset */
+    bs->data = (byte *)calloc(capacity / 8 + 2, 1);
+
+    /* Check if the memory was allocated */
+    if (!bs->data) {
+        printf("Error in bitstream_init!\n");
+        return FAILURE;
+    }
+
+    bs->length = 0;
+    bs->capacity = capacity;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function appends the lowest count bits of value (MSB first).
+ * 
+ * @param bs Bitstream
+ * @param value Value to be written
+ * @param count Count of bits (at most 32)
  * 
  * @return void
 */
-void free_row_pointers(png_bytep *row_pointers, int row_count){
+void bitstream_put(bitstream *bs, dword value, int count){
 
-    /* Declaration variables */
+    /* Declaration of variables */
     int i;
 
-    /* Sanity check */
-    if (!row_pointers || row_count < 0) {
-        printf("Error in free_row_pointers\n");
-        return;
-    }
+    for (i = count - 1; i >= 0 && bs->length < bs->capacity; i--) {
 
-    for (i = 0 ; i < row_count ; i++) {
+        if ((value >> i) & 1) {
+            bs->data[bs->length >> 3] |= 0x80 >> (bs->length & 7);
+        }
 
-        if (row_pointers[i]) free(row_pointers[i]);
-        
+        bs->length++;
     }
+}
+
+
+/**
+ * This function reads count bits (MSB first) from the position.
+ * 
+ * @param bs Bitstream
+ * @param position Index of the first bit
+ * @param count Count of bits (at most 32)
+ * 
+ * @return Read value
+*/
+dword bitstream_get(const bitstream *bs, long position, int count){
+
+    /* Declaration and initialization of variables */
+    dword value = 0;
+    int i;
 
-    free(row_pointers);
+    for (i = 0; i < count; i++, position++) {
+        value = (value << 1) | ((bs->data[position >> 3] >> (7 - (position & 7))) & 1);
+    }
 
+    return value;
 }
 
 
+/**
+ * This function frees the data of the bitstream.
+ * 
+ * @param bs Bitstream
+ * 
+ * @return void
+*/
+void bitstream_free(bitstream *bs){
+
+    /* Sanity check */
+    if (!bs) {
+        printf("Error in bitstream_free!\n");
+        return;
+    }
+
+    free(bs->data);
+    bs->data = NULL;
+    bs->length = bs->capacity = 0;
+}
+
 
 /**
- * This function hides the compressed data in the pixels in BLUE channel (LSB).
+ * This function spreads bits of the bitstream into bytes (one bit per byte) for the kernels.
  * 
- * @param compressed Array of words
- * @param compressed_size Size of the compressed data
- * @param row_pointers_pt Pointer to the array of png_bytep
- * @param width Width of the picture
- * @param height Height of the picture
+ * @param bs Bitstream
+ * @param position Index of the first bit
+ * @param count Count of bits
+ * @param bits Output bytes
  * 
- * @return SUCCESS if success, FAILURE if error
+ * @return void
 */
-int hide_mechanism(word *compressed, int compressed_size, png_bytep **row_pointers_pt, int width, int height){
+static void unpack_bits(const bitstream *bs, long position, int count, byte *bits){
 
     /* Declaration of variables */
-	int i, j, w_row_end = 0, w_col_end = COLUMN_START;
-    dword crc32;
-    char *watermark = WATERMARK;
-    png_bytep *row_pointers = *row_pointers_pt;
+    int i;
 
+    for (i = 0; i < count; i++, position++) {
+        bits[i] = (bs->data[position >> 3] >> (7 - (position & 7))) & 1;
+    }
+}
 
-	/* Check if the picture file is big enough */
-	if ((width * height) < (compressed_size * COMPRESSED_SIZE) + WATERMARK_SIZE + CRC32_SIZE + ((int)sizeof(int) * 8)) {
-		printf("Picture file is too small!\n");
-		return 1;
-	}
 
+/**
+ * This function appends bytes (one bit per byte) from the kernels to the bitstream.
+ * 
+ * @param bs Bitstream
+ * @param bits Bits
+ * @param count Count of bits
+ * 
+ * @return void
+*/
+static void pack_bits(bitstream *bs, const byte *bits, int count){
 
-     /* Write the watermark */
-    for (i = 0; i < 2; i++) {
+    /* Declaration of variables */
+    int i;
 
-        for (j = (sizeof(char) * 8) - 1 ; j >= 0; j--) {
+    for (i = 0; i < count && bs->length < bs->capacity; i++, bs->length++) {
 
-            if (w_col_end == ( ((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL) ) {
-                w_col_end = COLUMN_START;
-                w_row_end++;
-            }
-            
-            if ((watermark[i] >> j) & 1) {
-                row_pointers[w_row_end][w_col_end] |= mask_1;
+        if (bits[i]) {
+            bs->data[bs->length >> 3] |= 0x80 >> (bs->length & 7);
+        }
+    }
+}
 
 
-            }
-            else {
-                row_pointers[w_row_end][w_col_end] &= mask_0;
-            }
+/**
+ * This function fills the layout.
+ * 
+ * @param lay Layout to be filled
+ * @param channels Mask of the channels (CHANNEL_*)
+ * @param depth Count of LSBs per channel (1 - MAX_DEPTH)
+ * 
+ * @return SUCCESS or FAILURE if the combination is invalid
+*/
+int make_layout(layout *lay, int channels, int depth){
 
-            w_col_end += BYTES_PER_PIXEL;
+    /* Declaration of variables */
+    int i;
 
-        }
+    /* Sanity check */
+    if (!lay || channels <= 0 || channels > CHANNEL_MASK || depth < 1 || depth > MAX_DEPTH) {
+        return FAILURE;
     }
 
-    /* Write the size of the compressed data */
-    for (i = (sizeof(int) * 8 ) - 1; i >= 0; i--) {
+    lay->channels = channels;
+    lay->depth = depth;
+    lay->count = 0;
 
-        if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-            w_col_end = COLUMN_START;
-            w_row_end++;
-        }
-        if ((compressed_size >> i) & 1) {
-            row_pointers[w_row_end][w_col_end] |= mask_1;
-        }
-        else {
-            row_pointers[w_row_end][w_col_end] &= mask_0;
+    /* Channels are stored in R, G, B order (bit i of the mask is the byte i of the pixel) */
+    for (i = 0; i < BYTES_PER_PIXEL; i++) {
+
+        if (channels & (1 << i)) {
+            lay->offsets[lay->count++] = i;
         }
+    }
+
+    lay->bits_per_pixel = lay->count * depth;
+    lay->matrix = 0;
+    lay->spread = NULL;
+    lay->digest = FALSE;
+    lay->kernel = find_layout_kernel(lay->count, depth);
+
+    return lay->kernel ? SUCCESS : FAILURE;
+}
+
+
+/**
+ * This function turns on matrix embedding of the layout.
+ * 
+ * @param lay Layout (one LSB per channel)
+ * @param k Bits carried by one group of 2^k - 1 LSBs (0 turns it off)
+ * 
+ * @return SUCCESS or FAILURE if the combination is invalid
+*/
+int set_matrix(layout *lay, int k){
 
-        w_col_end += BYTES_PER_PIXEL;
-       
+    /* Sanity check */
+    if (!lay || (k && (k < MIN_MATRIX || k > MAX_MATRIX || lay->depth != 1))) {
+        return FAILURE;
     }
 
+    lay->matrix = k;
 
-    /* Write the compressed data */
-    for (i = 0; i < compressed_size; i++) {
+    return SUCCESS;
+}
 
-        for (j = COMPRESSED_SIZE - 1; j >= 0; j--) {
 
-            if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-                w_col_end = COLUMN_START;
-                w_row_end++;
-            }
-            
-            if ((compressed[i] >> j) & 1) {
-                row_pointers[w_row_end][w_col_end] |= mask_1;
-            }
-            else {
-                row_pointers[w_row_end][w_col_end] &= mask_0;
-            }
+/**
+ * This function checks if the layout is the original one (LSB of the BLUE channel).
+ * 
+ * @param lay Layout
+ * 
+ * @return TRUE or FALSE
+*/
+static int is_legacy(const layout *lay){
 
-            w_col_end += BYTES_PER_PIXEL;
+    return lay->channels == CHANNEL_B && lay->depth == 1 && !lay->matrix && !lay->spread && !lay->digest;
+}
 
-        }
+
+/**
+ * This function returns the first pixel of the body (size, data and crc32) for the layout.
+ * 
+ * @param lay Layout
+ * 
+ * @return Index of the pixel
+*/
+static long body_start(const layout *lay){
+
+    /* The original format has no config after the watermark */
+    if (is_legacy(lay)) {
+        return WATERMARK_SIZE;
     }
 
+    return PREFIX_PIXELS + (lay->digest ? DIGEST_SIZE : 0);
+}
 
-    /* Write the crc32 */
-    crc32 = crc32b(compressed, compressed_size);
 
-    for (i = CRC32_SIZE- 1; i >= 0; i--) {
-        if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-            w_col_end = COLUMN_START;
-            w_row_end++;
-        }
-        if ((crc32 >> i) & 1) {
+/**
+ * This function returns the count of bits of the body for the compressed size.
+ * 
+ * @param compressed_size Count of compressed words
+ * 
+ * @return Count of bits
+*/
+static long body_bits(int compressed_size){
 
-            row_pointers[w_row_end][w_col_end] |= mask_1;
-        }
-        else {
-            row_pointers[w_row_end][w_col_end] &= mask_0;
-        }
+    return (long)compressed_size * COMPRESSED_SIZE + (long)sizeof(int) * 8 + CRC32_SIZE;
+}
 
-        w_col_end += BYTES_PER_PIXEL;
-       
-    }
 
+/**
+ * This function returns the count of cover bits (slots) used for the bits of the body.
+ * 
+ * @param lay Layout of the bits
+ * @param bits Count of bits of the body
+ * 
+ * @return Count of slots
+*/
+static long cover_slots(const layout *lay, long bits){
 
-    return 0;
+    /* k bits of the body in every group of 2^k - 1 slots */
+    if (lay->matrix) {
+        return (bits + lay->matrix - 1) / lay->matrix * ((1L << lay->matrix) - 1);
+    }
+
+    return bits;
 }
 
+
 /**
- * This function extracts the compressed data in the pixels in BLUE channel (LSB).
+ * This function checks if the body fits in the picture with the layout.
  * 
- * @param row_pointers_pt Pointer to the array of png_bytep 
- * @param size Size of the extracted data
+ * @param lay Layout
+ * @param bits Count of bits of the body
  * @param width Width of the picture
  * @param height Height of the picture
- * @param returns Code of return to check what happened (SUCCESS, FAILURE, 4 - NO HIDDEN CONTENT, 5 - INVALID CRC32)
  * 
- * @return NULL if error, otherwise extracted data
+ * @return TRUE or FALSE
 */
-word *extract_mechanism(png_bytep **row_pointers_pt, int *size ,int width, int *returns){
+static int body_fits(const layout *lay, long bits, int width, int height){
 
     /* Declaration and initialization of variables */
-	int i, j,
-    w_row_end = 0,
-    w_col_end = COLUMN_START,
-    w_size = 0;
+    long pixels = (long)width * height - body_start(lay);
 
-    word *compressed = NULL, temp = 0;
+    return pixels > 0 && pixels * lay->bits_per_pixel >= cover_slots(lay, bits);
+}
 
-	png_bytep *row_pointers = *row_pointers_pt;
 
-    dword crc32, w_crc32 = 0;
+/**
+ * This function returns the count of the first rows which hold the body (and everything before it).
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param bits Count of bits of the body
+ * 
+ * @return Count of rows
+*/
+static int body_rows(const image *img, const layout *lay, long bits){
 
-    char *watermark;
+    /* Declaration of variables */
+    long pixels;
 
+    /* A spread body may be anywhere */
+    if (lay->spread) {
+        return img->height;
+    }
 
-    /* Allocate memory for watermark */
-    watermark = (char *)malloc(sizeof(char) * 3);
+    pixels = body_start(lay) + (cover_slots(lay, bits) + lay->bits_per_pixel - 1) / lay->bits_per_pixel;
 
-    if (!watermark) {
-        printf("Error in extract_mechanism!\n");
-        *returns = FAILURE;
-        return NULL;
-    }
+    return pixels >= (long)img->width * img->height ? img->height : (int)((pixels + img->width - 1) / img->width);
+}
 
 
-    watermark[2] = '\0';
+/**
+ * This function finds where the bit of the body is stored (closed form, no cursor is needed).
+ * 
+ * @param lay Layout of the bits
+ * @param width Width of the picture
+ * @param start Index of the first pixel of the body (row by row)
+ * @param bit Index of the bit in the body
+ * @param row Row of the pixel
+ * @param col Column of the pixel
+ * @param slot Index of the bit in the pixel (0 - bits_per_pixel - 1)
+ * 
+ * @return void
+*/
+void locate_bit(const layout *lay, int width, long start, long bit, int *row, int *col, int *slot){
 
+    /* Declaration and initialization of variables */
+    long pixel = start + bit / lay->bits_per_pixel;
 
+    *row = (int)(pixel / width);
+    *col = (int)(pixel % width);
+    *slot = (int)(bit % lay->bits_per_pixel);
+}
 
-    /* Read the watermark */
-    for (i = 0; i < 2; i++) {
 
-        for (j = (sizeof(char)*8) - 1 ; j >= 0; j--) {
+/**
+ * This function reads up to 9 bits (MSB first) of the bitstream from the position.
+ * 
+ * @param bs Bitstream
+ * @param position Index of the first bit
+ * @param count Count of bits (at most 9)
+ * 
+ * @return Read value
+*/
+static dword peek_bits(const bitstream *bs, long position, int count){
 
-            if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-                w_col_end = COLUMN_START;
-                w_row_end++;
-            }
-            
-            if (row_pointers[w_row_end][w_col_end] & mask_1) {
-                watermark[i] |= 1 << j;
-            }
-            else {
-                watermark[i] &= ~(1 << j);
-            }
+    /* Declaration and initialization of variables */
+    dword window = ((dword)bs->data[position >> 3] << 8) | bs->data[(position >> 3) + 1];
 
-            w_col_end += BYTES_PER_PIXEL;
+    return (window >> (16 - (position & 7) - count)) & ((1u << count) - 1);
+}
 
-        }
-    }
 
-    if (strcmp(watermark, WATERMARK)) {
+/**
+ * This function appends up to 9 bits (MSB first) to the bitstream.
+ * 
+ * @param bs Bitstream (enough capacity)
+ * @param value Value to be written
+ * @param count Count of bits (at most 9)
+ * 
+ * @return void
+*/
+static void push_bits(bitstream *bs, dword value, int count){
+
+    /* Declaration and initialization of variables */
+    dword window = value << (16 - (bs->length & 7) - count);
+
+    bs->data[bs->length >> 3] |= (byte)(window >> 8);
+    bs->data[(bs->length >> 3) + 1] |= (byte)window;
+    bs->length += count;
+}
 
-        free(watermark);
 
-        /* NO HIDDEN CONTENT - 4 */
-        *returns = 4;
-        return NULL;
+/**
+ * This function writes bits of the body into the slots of one pixel (from the slot on).
+ * 
+ * @param px Pixel
+ * @param lay Layout of the bits
+ * @param slot Index of the first slot
+ * @param bs Bitstream
+ * @param position Index of the bit (moved after the written bits)
+ * @param end Index after the last bit
+ * 
+ * @return void
+*/
+static void write_slots(byte *px, const layout *lay, int slot, const bitstream *bs, long *position, long end){
+
+    /* Declaration of variables */
+    int c, j, bit;
+
+    for (; slot < lay->bits_per_pixel && *position < end; slot++, (*position)++) {
+
+        /* The first bit of the channel goes to the highest of the used LSBs */
+        c = lay->offsets[slot / lay->depth];
+        j = lay->depth - 1 - slot % lay->depth;
+
+        bit = (bs->data[*position >> 3] >> (7 - (*position & 7))) & 1;
+        px[c] = (px[c] & ~(1 << j)) | (bit << j);
     }
+}
+
 
+/**
+ * This function reads bits from the slots of one pixel (from the slot on).
+ * 
+ * @param px Pixel
+ * @param lay Layout of the bits
+ * @param slot Index of the first slot
+ * @param count Count of bits to be read (moved after the read bits)
+ * @param bs Bitstream where the bits are appended
+ * 
+ * @return void
+*/
+static void read_slots(const byte *px, const layout *lay, int slot, long *count, bitstream *bs){
 
-    /* Free watermark */
-    free(watermark);
+    /* Declaration of variables */
+    int c, j;
 
-    /* Read the size of the compressed data */
-    for (i = (sizeof(int) * 8 ) - 1; i >= 0; i--) {
+    for (; slot < lay->bits_per_pixel && *count > 0; slot++, (*count)--) {
 
-        if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-            w_col_end = COLUMN_START;
-            w_row_end++;
-        }
-        
-        if (row_pointers[w_row_end][w_col_end] & mask_1) {
-            w_size |= 1 << i;
-        }
-        else {
-            w_size &= ~(1 << i);
-        }
+        c = lay->offsets[slot / lay->depth];
+        j = lay->depth - 1 - slot % lay->depth;
 
-        w_col_end += BYTES_PER_PIXEL;
-       
+        push_bits(bs, (px[c] >> j) & 1, 1);
     }
+}
 
-    compressed = (word *)malloc(sizeof(word) * w_size);
-	*size = w_size;
 
-    if (compressed == NULL) {
-        printf("Error in extract_mechanism!\n");
-        *returns = FAILURE;
-        return NULL;
+/**
+ * This function writes the bits from .. to - 1 of the body into the pixels.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body (row by row)
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream
+ * @param from Index of the first bit to be written
+ * @param to Index after the last bit to be written
+ * @param scratch Buffer for one row (SCRATCH_PER_PIXEL bytes per pixel)
+ * 
+ * @return void
+*/
+static void write_stream(image *img, const layout *lay, long start, const bitstream *bs, long base, long from, long to, byte *scratch){
+
+    /* Declaration and initialization of variables */
+    const kernels *k = get_kernels();
+    long position = base + from, end = base + to;
+    int row, col, slot, n, c, full;
+    byte *px, *planes[BYTES_PER_PIXEL], *values[BYTES_PER_PIXEL];
+
+    /* Scratch holds the planes of the row and the values of the channels */
+    for (c = 0; c < BYTES_PER_PIXEL; c++) {
+        planes[c] = scratch + (long)c * img->width;
+        values[c] = scratch + (long)(BYTES_PER_PIXEL + c) * img->width;
     }
 
-    /* Read the compressed data */
-    for (i = 0; i < w_size; i++) {
+    locate_bit(lay, img->width, start, from, &row, &col, &slot);
+
+    while (position < end) {
+
+        /* Rest of the row or rest of the bits */
+        n = img->width - col;
+
+        if (is_legacy(lay)) {
+
+            /* One bit per pixel in the BLUE channel */
+            if (end - position < n) n = (int)(end - position);
+
+            unpack_bits(bs, position, n, scratch);
+            k->embed_lsb(IMAGE_ROW(img, row) + col * BYTES_PER_PIXEL, scratch, n);
+            position += n;
+
+        } else {
+
+            px = IMAGE_ROW(img, row) + col * BYTES_PER_PIXEL;
 
-        temp = 0;
-        for (j = COMPRESSED_SIZE - 1; j >= 0; j--) {
+            /* Rest of the pixel where the range starts */
+            if (slot > 0) {
 
-            if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-                w_col_end = COLUMN_START;
-                w_row_end++;
+                write_slots(px, lay, slot, bs, &position, end);
+                px += BYTES_PER_PIXEL;
+                slot = 0;
+                n--;
             }
-            
-            if (row_pointers[w_row_end][w_col_end] & mask_1) {
-                temp |= 1 << j;
+
+            /* Whole pixels through the planes */
+            full = (long)n < (end - position) / lay->bits_per_pixel ? n : (int)((end - position) / lay->bits_per_pixel);
+
+            if (full > 0) {
+
+                k->deinterleave(planes[0], planes[1], planes[2], px, full);
+
+                /* Split the bits of every pixel into the values of the channels */
+                lay->kernel->split(bs->data, position, values, full);
+                position += (long)full * lay->bits_per_pixel;
+
+                for (c = 0; c < lay->count; c++) {
+                    k->blend_plane(planes[lay->offsets[c]], values[c], (byte)((1 << lay->depth) - 1), full);
+                }
+
+                k->interleave(px, planes[0], planes[1], planes[2], full);
+                px += full * BYTES_PER_PIXEL;
+                n -= full;
+            }
+
+            /* Pixel where the range ends */
+            if (n > 0) {
+                write_slots(px, lay, 0, bs, &position, end);
             }
-            else {
-                temp &= ~(1 << j);
+        }
+
+        col = 0;
+        row++;
+    }
+}
+
+
+/**
+ * This function reads the bits from .. to - 1 of the body from the pixels.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body (row by row)
+ * @param from Index of the first bit to be read
+ * @param to Index after the last bit to be read
+ * @param bs Bitstream where the bits are appended
+ * @param scratch Buffer for one row (SCRATCH_PER_PIXEL bytes per pixel)
+ * 
+ * @return void
+*/
+static void read_stream(const image *img, const layout *lay, long start, long from, long to, bitstream *bs, byte *scratch){
+
+    /* Declaration and initialization of variables */
+    const kernels *k = get_kernels();
+    long count = to - from;
+    int row, col, slot, n, c, full;
+    const byte *px;
+    byte *planes[BYTES_PER_PIXEL], *values[BYTES_PER_PIXEL];
+
+    for (c = 0; c < BYTES_PER_PIXEL; c++) {
+        planes[c] = scratch + (long)c * img->width;
+        values[c] = scratch + (long)(BYTES_PER_PIXEL + c) * img->width;
+    }
+
+    locate_bit(lay, img->width, start, from, &row, &col, &slot);
+
+    while (count > 0) {
+
+        /* Rest of the row or rest of the bits */
+        n = img->width - col;
+
+        if (is_legacy(lay)) {
+
+            /* One bit per pixel in the BLUE channel */
+            if (count < n) n = (int)count;
+
+            k->extract_lsb(IMAGE_ROW(img, row) + col * BYTES_PER_PIXEL, scratch, n);
+            pack_bits(bs, scratch, n);
+            count -= n;
+
+        } else {
+
+            px = IMAGE_ROW(img, row) + col * BYTES_PER_PIXEL;
+
+            /* Rest of the pixel where the range starts */
+            if (slot > 0) {
+
+                read_slots(px, lay, slot, &count, bs);
+                px += BYTES_PER_PIXEL;
+                slot = 0;
+                n--;
             }
 
-            w_col_end += BYTES_PER_PIXEL;
+            /* Whole pixels through the planes */
+            full = (long)n < count / lay->bits_per_pixel ? n : (int)(count / lay->bits_per_pixel);
+
+            if (full > 0) {
+
+                k->deinterleave(planes[0], planes[1], planes[2], px, full);
+
+                for (c = 0; c < lay->count; c++) {
+                    k->mask_plane(planes[lay->offsets[c]], values[c], (byte)((1 << lay->depth) - 1), full);
+                }
+
+                /* Join the values of the channels of every pixel */
+                lay->kernel->join(bs->data, bs->length, values, full);
+                bs->length += (long)full * lay->bits_per_pixel;
+
+                count -= (long)full * lay->bits_per_pixel;
+                px += full * BYTES_PER_PIXEL;
+                n -= full;
+            }
+
+            /* Pixel where the range ends */
+            if (n > 0) {
+                read_slots(px, lay, 0, &count, bs);
+            }
+        }
+
+        col = 0;
+        row++;
+    }
+}
+
+
+/**
+ * This function appends the bits of src to dst.
+ * 
+ * @param dst Bitstream (enough capacity)
+ * @param src Bitstream to be appended
+ * 
+ * @return void
+*/
+static void bitstream_append(bitstream *dst, const bitstream *src){
+
+    /* Declaration and initialization of variables */
+    long i, bytes = (src->length + 7) / 8;
+    int shift = (int)(dst->length & 7);
+    byte *out = dst->data + (dst->length >> 3);
+
+    /* Byte aligned, bits after the end of src are zero */
+    if (shift == 0) {
+
+        memcpy(out, src->data, bytes);
+
+    } else {
+
+        for (i = 0; i < bytes; i++) {
+            out[i] |= src->data[i] >> shift;
+            out[i + 1] = (byte)(src->data[i] << (8 - shift));
+        }
+    }
+
+    dst->length += src->length;
+}
+
+
+/* Work shared by the threads of write_bands() and read_bands() */
+typedef struct {
+
+    /* Picture */
+    image *img;
+
+    /* Layout and the first pixel of the body */
+    const layout *lay;
+    long start;
+
+    /* Bitstream and the index of the first bit of the body in it */
+    bitstream *bs;
+    long base;
+
+    /* Count of bits of the body */
+    long count;
+
+    /* First row of the body and rows of each band */
+    int first_row;
+    int band_rows;
+
+    /* Bits of each band (extraction) */
+    bitstream *parts;
+
+    /* Flag of each band, set if the band ran out of memory (no band writes the flag of another) */
+    byte *failed;
+
+} band_work;
+
+
+/**
+ * This function returns the bits of the body stored in the rows of the band.
+ * 
+ * @param w Shared work
+ * @param index Index of the band
+ * @param from Index of the first bit
+ * @param to Index after the last bit
+ * 
+ * @return void
+*/
+static void band_range(const band_work *w, int index, long *from, long *to){
+
+    /* Declaration and initialization of variables */
+    long row = (long)w->first_row + (long)index * w->band_rows;
+    long bpp = w->lay->bits_per_pixel;
+
+    /* The first band starts in the middle of its first row */
+    *from = index == 0 ? 0 : (row * w->img->width - w->start) * bpp;
+    *to = ((row + w->band_rows) * w->img->width - w->start) * bpp;
+
+    if (*to > w->count) *to = w->count;
+}
+
+
+/**
+ * This function writes the bits of one band (task of parallel_for).
+ * 
+ * @param arg Shared work
+ * @param index Index of the band
+ * 
+ * @return void
+*/
+static void write_band(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    band_work *w = (band_work *)arg;
+    byte *scratch = (byte *)malloc((size_t)w->img->width * SCRATCH_PER_PIXEL);
+    long from, to;
+
+    if (!scratch) {
+        w->failed[index] = TRUE;
+        return;
+    }
+
+    band_range(w, index, &from, &to);
+    write_stream(w->img, w->lay, w->start, w->bs, w->base, from, to, scratch);
+
+    free(scratch);
+}
+
+
+/**
+ * This function reads the bits of one band into its own bitstream (task of parallel_for).
+ * 
+ * @param arg Shared work
+ * @param index Index of the band
+ * 
+ * @return void
+*/
+static void read_band(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    band_work *w = (band_work *)arg;
+    byte *scratch = (byte *)malloc((size_t)w->img->width * SCRATCH_PER_PIXEL);
+    long from, to;
+
+    band_range(w, index, &from, &to);
+
+    if (!scratch || bitstream_init(&w->parts[index], to - from) == FAILURE) {
+        free(scratch);
+        w->failed[index] = TRUE;
+        return;
+    }
+
+    read_stream(w->img, w->lay, w->start, from, to, &w->parts[index], scratch);
+
+    free(scratch);
+}
+
+
+/**
+ * This function splits the rows of the body into bands (one band if it is not worth the threads).
+ * 
+ * @param w Work to be filled
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return Count of bands
+*/
+static int make_bands(band_work *w, int threads){
+
+    /* Declaration and initialization of variables */
+    int last_row, rows, bands;
+
+    w->first_row = (int)(w->start / w->img->width);
+    last_row = (int)((w->start + (w->count - 1) / w->lay->bits_per_pixel) / w->img->width);
+    rows = last_row - w->first_row + 1;
+
+    if (threads == THREADS_AUTO) threads = cpu_count();
+
+    /* Small bodies are faster without the threads */
+    bands = (int)(w->count / MIN_BAND_BITS);
+    if (bands > threads) bands = threads;
+    if (bands > rows) bands = rows;
+    if (bands < 1) bands = 1;
+
+    w->band_rows = (rows + bands - 1) / bands;
+
+    /* Rounding up may leave the last bands empty */
+    return (rows + w->band_rows - 1) / w->band_rows;
+}
+
+
+/**
+ * This function tells if any band of the work failed (read after the threads are joined).
+ * 
+ * @param w Work
+ * @param bands Count of bands
+ * 
+ * @return TRUE or FALSE
+*/
+static int bands_failed(const band_work *w, int bands){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; i < bands; i++) {
+
+        if (w->failed[i]) return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/**
+ * This function writes count bits of the body, each band of rows on its own thread.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream
+ * @param count Count of bits of the body
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_bands(image *img, const layout *lay, long start, bitstream *bs, long base, long count, int threads){
+
+    /* Declaration of variables */
+    band_work w;
+    int bands, ret = SUCCESS;
+
+    w.img = img;
+    w.lay = lay;
+    w.start = start;
+    w.bs = bs;
+    w.base = base;
+    w.count = count;
+    w.parts = NULL;
+
+    bands = make_bands(&w, threads);
+    w.failed = (byte *)calloc(bands, sizeof(byte));
+
+    if (!w.failed || parallel_for(threads, bands, write_band, &w) == FAILURE || bands_failed(&w, bands)) {
+        printf("Error in write_bands!\n");
+        ret = FAILURE;
+    }
+
+    free(w.failed);
+
+    return ret;
+}
+
+
+/**
+ * This function reads count bits of the body, each band of rows on its own thread.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body
+ * @param count Count of bits of the body
+ * @param bs Bitstream where the bits are appended
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_bands(image *img, const layout *lay, long start, long count, bitstream *bs, int threads){
+
+    /* Declaration of variables */
+    band_work w;
+    int i, bands, ret = SUCCESS;
+
+    w.img = img;
+    w.lay = lay;
+    w.start = start;
+    w.bs = bs;
+    w.base = 0;
+    w.count = count;
+
+    bands = make_bands(&w, threads);
+    w.parts = (bitstream *)calloc(bands, sizeof(bitstream));
+    w.failed = (byte *)calloc(bands, sizeof(byte));
+
+    if (!w.parts || !w.failed) {
+        printf("Error in read_bands!\n");
+        free(w.parts);
+        free(w.failed);
+        return FAILURE;
+    }
+
+    if (parallel_for(threads, bands, read_band, &w) == FAILURE || bands_failed(&w, bands)) {
+        printf("Error in read_bands!\n");
+        ret = FAILURE;
+    }
+
+    /* Join the bands in order */
+    for (i = 0; i < bands; i++) {
+
+        if (ret == SUCCESS) bitstream_append(bs, &w.parts[i]);
+        free(w.parts[i].data);
+    }
+
+    free(w.parts);
+    free(w.failed);
+
+    return ret;
+}
+
+
+/**
+ * This function writes the value (bits_per_pixel bits, MSB first) into the slots of one pixel.
+ * 
+ * @param px Pixel
+ * @param lay Layout of the bits
+ * @param value Bits of the pixel
+ * 
+ * @return void
+*/
+static void put_pixel(byte *px, const layout *lay, dword value){
+
+    /* Declaration and initialization of variables */
+    byte mask = (byte)((1 << lay->depth) - 1);
+    int c;
+
+    for (c = lay->count - 1; c >= 0; c--, value >>= lay->depth) {
+        px[lay->offsets[c]] = (px[lay->offsets[c]] & ~mask) | ((byte)value & mask);
+    }
+}
+
+
+/**
+ * This function reads the slots of one pixel (bits_per_pixel bits, MSB first).
+ * 
+ * @param px Pixel
+ * @param lay Layout of the bits
+ * 
+ * @return Bits of the pixel
+*/
+static dword get_pixel(const byte *px, const layout *lay){
+
+    /* Declaration and initialization of variables */
+    byte mask = (byte)((1 << lay->depth) - 1);
+    dword value = 0;
+    int c;
+
+    for (c = 0; c < lay->count; c++) {
+        value = (value << lay->depth) | (px[lay->offsets[c]] & mask);
+    }
+
+    return value;
+}
+
+
+/* Work shared by the threads of the keyed spread */
+typedef struct {
+
+    /* Picture, layout and the first pixel of the body */
+    image *img;
+    const layout *lay;
+    long start;
+
+    /* Bitstream, the index of the first bit of the body in it and the count of bits */
+    bitstream *bs;
+    long base;
+    long count;
+
+    /* Pixels which carry bits (units) */
+    long units;
+
+    /* Pixel of every unit (counted from the start) */
+    dword *target;
+
+    /* Units sorted by tiles, the tile t is order[first[t]] .. order[first[t + 1] - 1] */
+    long tiles;
+    long *first;
+    dword *order;
+
+    /* Bits of every unit (extraction) */
+    word *values;
+
+} spread_work;
+
+
+/**
+ * This function permutes one chunk of units (task of parallel_for).
+ * 
+ * @param arg Shared work
+ * @param index Index of the chunk
+ * 
+ * @return void
+*/
+static void spread_target_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    spread_work *w = (spread_work *)arg;
+    long q = (long)index * SPREAD_TASK_UNITS, end = q + SPREAD_TASK_UNITS;
+
+    if (end > w->units) end = w->units;
+
+    for (; q < end; q++) {
+        w->target[q] = spread_forward(w->lay->spread, (dword)q);
+    }
+}
+
+
+/**
+ * This function writes the units of one tile (task of parallel_for).
+ * 
+ * @param arg Shared work
+ * @param index Index of the tile
+ * 
+ * @return void
+*/
+static void spread_write_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    spread_work *w = (spread_work *)arg;
+    int bpp = w->lay->bits_per_pixel;
+    long e, q, pixel, position, end;
+    byte *px;
+
+    for (e = w->first[index]; e < w->first[index + 1]; e++) {
+
+        q = w->order[e];
+        pixel = w->start + w->target[q];
+        px = IMAGE_ROW(w->img, pixel / w->img->width) + (pixel % w->img->width) * BYTES_PER_PIXEL;
+
+        position = w->base + q * bpp;
+        end = w->base + w->count;
+
+        /* The last unit may be filled only in part */
+        if (end - position >= bpp) {
+            put_pixel(px, w->lay, peek_bits(w->bs, position, bpp));
+        } else {
+            write_slots(px, w->lay, 0, w->bs, &position, end);
+        }
+    }
+}
+
+
+/**
+ * This function reads the units of one tile (task of parallel_for).
+ * 
+ * @param arg Shared work
+ * @param index Index of the tile
+ * 
+ * @return void
+*/
+static void spread_read_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    spread_work *w = (spread_work *)arg;
+    long e, q, pixel;
+
+    for (e = w->first[index]; e < w->first[index + 1]; e++) {
+
+        q = w->order[e];
+        pixel = w->start + w->target[q];
+
+        w->values[q] = (word)get_pixel(IMAGE_ROW(w->img, pixel / w->img->width) + (pixel % w->img->width) * BYTES_PER_PIXEL, w->lay);
+    }
+}
+
+
+/**
+ * This function permutes the units and sorts them by the tiles of the picture.
+ * 
+ * @param w Work to be filled (img, lay, start, bs, base and count are set)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int make_spread_work(spread_work *w, int threads){
+
+    /* Declaration and initialization of variables */
+    long q, t;
+
+    w->units = (w->count + w->lay->bits_per_pixel - 1) / w->lay->bits_per_pixel;
+    w->tiles = ((long)w->img->width * w->img->height + SPREAD_TILE_PIXELS - 1) / SPREAD_TILE_PIXELS;
+
+    w->target = (dword *)malloc(sizeof(dword) * (w->units + 1));
+    w->order = (dword *)malloc(sizeof(dword) * (w->units + 1));
+    w->first = (long *)calloc(w->tiles + 1, sizeof(long));
+    w->values = NULL;
+
+    if (!w->target || !w->order || !w->first) {
+        printf("Error in make_spread_work!\n");
+        return FAILURE;
+    }
+
+    /* Pixel of every unit */
+    if (parallel_for(threads, (int)((w->units + SPREAD_TASK_UNITS - 1) / SPREAD_TASK_UNITS), spread_target_task, w) == FAILURE) {
+        return FAILURE;
+    }
+
+    /* Counting sort by the tiles (units of a tile stay in order) */
+    for (q = 0; q < w->units; q++) {
+        w->first[(w->start + w->target[q]) / SPREAD_TILE_PIXELS + 1]++;
+    }
+
+    for (t = 0; t < w->tiles; t++) {
+        w->first[t + 1] += w->first[t];
+    }
+
+    for (q = 0; q < w->units; q++) {
+        w->order[w->first[(w->start + w->target[q]) / SPREAD_TILE_PIXELS]++] = (dword)q;
+    }
+
+    /* Scattering moved every start to the next tile */
+    for (t = w->tiles; t > 0; t--) {
+        w->first[t] = w->first[t - 1];
+    }
+    w->first[0] = 0;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function frees the work of the keyed spread.
+ * 
+ * @param w Work
+ * 
+ * @return void
+*/
+static void free_spread_work(spread_work *w){
+
+    free(w->target);
+    free(w->order);
+    free(w->first);
+    free(w->values);
+}
+
+
+/**
+ * This function writes count bits of the body to the pixels given by the keyed permutation, tile by tile.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits (with the permutation)
+ * @param start Index of the first pixel of the body
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream
+ * @param count Count of bits of the body
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_spread(image *img, const layout *lay, long start, bitstream *bs, long base, long count, int threads){
+
+    /* Declaration of variables */
+    spread_work w;
+    int ret;
+
+    w.img = img;
+    w.lay = lay;
+    w.start = start;
+    w.bs = bs;
+    w.base = base;
+    w.count = count;
+
+    ret = make_spread_work(&w, threads);
+
+    if (ret != FAILURE) {
+        ret = parallel_for(threads, (int)w.tiles, spread_write_task, &w);
+    }
+
+    free_spread_work(&w);
+
+    return ret;
+}
+
+
+/**
+ * This function reads count bits of the body from the pixels given by the keyed permutation, tile by tile.
+ * 
+ * @param img Image
+ * @param lay Layout of the bits (with the permutation)
+ * @param start Index of the first pixel of the body
+ * @param count Count of bits of the body
+ * @param bs Bitstream where the bits are appended
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_spread(image *img, const layout *lay, long start, long count, bitstream *bs, int threads){
+
+    /* Declaration of variables */
+    spread_work w;
+    long q, position;
+    int ret, bpp = lay->bits_per_pixel;
+
+    w.img = img;
+    w.lay = lay;
+    w.start = start;
+    w.bs = bs;
+    w.base = 0;
+    w.count = count;
+
+    ret = make_spread_work(&w, threads);
+
+    if (ret != FAILURE) {
+
+        w.values = (word *)malloc(sizeof(word) * (w.units + 1));
+        ret = w.values ? parallel_for(threads, (int)w.tiles, spread_read_task, &w) : FAILURE;
+    }
+
+    /* Join the units in order (the last one may be used only in part) */
+    for (q = 0; ret != FAILURE && q < w.units; q++) {
+
+        position = q * bpp;
+        push_bits(bs, w.values[q] >> (count - position < bpp ? bpp - (count - position) : 0), count - position < bpp ? (int)(count - position) : bpp);
+    }
+
+    free_spread_work(&w);
+
+    return ret;
+}
+
+
+/**
+ * This function writes count bits of the body (in order of the rows, or spread by the key).
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream
+ * @param count Count of bits of the body
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_units(image *img, const layout *lay, long start, bitstream *bs, long base, long count, int threads){
+
+    if (lay->spread) {
+        return write_spread(img, lay, start, bs, base, count, threads);
+    }
+
+    return write_bands(img, lay, start, bs, base, count, threads);
+}
+
+
+/**
+ * This function reads count bits of the body (in order of the rows, or spread by the key).
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param start Index of the first pixel of the body
+ * @param count Count of bits of the body
+ * @param bs Bitstream where the bits are appended
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_units(image *img, const layout *lay, long start, long count, bitstream *bs, int threads){
+
+    if (lay->spread) {
+        return read_spread(img, lay, start, count, bs, threads);
+    }
+
+    return read_bands(img, lay, start, count, bs, threads);
+}
+
+
+/* Syndrome of every byte of cover bits (XOR of the offsets of the set bits, parity in the bit 3) */
+static byte syndrome_table[256];
+
+
+/**
+ * This function fills the syndrome table (called before any thread is started).
+ * 
+ * @return void
+*/
+static void init_syndrome_table(void){
+
+    /* Declaration of variables */
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+
+        syndrome_table[i] = 0;
+
+        /* The MSB is the offset 0 */
+        for (j = 0; j < 8; j++) {
+            if ((i >> (7 - j)) & 1) syndrome_table[i] ^= (byte)(j | 8);
+        }
+    }
+}
+
+
+/**
+ * This function calculates the syndrome of one group of cover bits (Hamming code).
+ * The cover bit i of the group has the index i + 1.
+ * 
+ * @param cover Cover bits
+ * @param first Index of the first cover bit of the group
+ * @param k Count of bits carried by the group
+ * 
+ * @return Syndrome (XOR of the indexes of the set cover bits)
+*/
+static int syndrome(const bitstream *cover, long first, int k){
+
+    /* Declaration and initialization of variables */
+    int n = (1 << k) - 1, s = 0, c, lo, hi;
+    dword bits;
+    byte t;
+
+    /* Byte c of the group holds the indexes 8c .. 8c + 7 (the index 0 is not a cover bit) */
+    for (c = 0; 8 * c <= n; c++) {
+
+        lo = c == 0 ? 1 : 8 * c;
+        hi = 8 * c + 7 < n ? 8 * c + 7 : n;
+
+        bits = peek_bits(cover, first + lo - 1, hi - lo + 1) << (7 - (hi - 8 * c));
+        t = syndrome_table[bits];
+
+        s ^= (t & 7) ^ ((t & 8) ? 8 * c : 0);
+    }
+
+    return s;
+}
+
+
+/* Work shared by the threads of the matrix encoder and decoder */
+typedef struct {
+
+    /* Cover bits (slots of the layout) */
+    bitstream *cover;
+
+    /* Bits of the body and the index of the first of them */
+    bitstream *message;
+    long base;
+
+    /* Count of bits of the body */
+    long count;
+
+    /* Bits carried by one group */
+    int k;
+
+    /* Count of groups and groups of one task (multiple of 8, so tasks share no byte) */
+    long groups;
+    long task_groups;
+
+} matrix_work;
+
+
+/**
+ * This function flips at most one cover bit of every group of the task so its syndrome is the message.
+ * 
+ * @param arg Shared work
+ * @param index Index of the task
+ * 
+ * @return void
+*/
+static void matrix_encode_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    matrix_work *w = (matrix_work *)arg;
+    long g = (long)index * w->task_groups, end = g + w->task_groups, first, position;
+    int n = (1 << w->k) - 1, flip, bits;
+    dword message;
+
+    if (end > w->groups) end = w->groups;
+
+    for (; g < end; g++) {
+
+        /* Bits of the body carried by the group (the last one is padded by zeros) */
+        position = (long)g * w->k;
+        bits = w->count - position < w->k ? (int)(w->count - position) : w->k;
+        message = bitstream_get(w->message, w->base + position, bits) << (w->k - bits);
+
+        first = g * n;
+        flip = syndrome(w->cover, first, w->k) ^ (int)message;
+
+        if (flip) {
+            w->cover->data[(first + flip - 1) >> 3] ^= 0x80 >> ((first + flip - 1) & 7);
+        }
+    }
+}
+
+
+/**
+ * This function writes the syndromes of the groups of the task into the body (byte aligned part).
+ * 
+ * @param arg Shared work
+ * @param index Index of the task
+ * 
+ * @return void
+*/
+static void matrix_decode_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    matrix_work *w = (matrix_work *)arg;
+    long g = (long)index * w->task_groups, end = g + w->task_groups;
+    int n = (1 << w->k) - 1;
+    bitstream part;
+
+    if (end > w->groups) end = w->groups;
+
+    /* Bits of the task start at a byte (task_groups * k is a multiple of 8) */
+    part.data = w->message->data + g * w->k / 8;
+    part.length = 0;
+    part.capacity = w->count - g * w->k;
+
+    for (; g < end; g++) {
+        bitstream_put(&part, (dword)syndrome(w->cover, g * n, w->k), w->k);
+    }
+}
+
+
+/**
+ * This function prepares the shared work of the matrix encoder or decoder.
+ * 
+ * @param w Work to be filled
+ * @param cover Cover bits
+ * @param message Bits of the body
+ * @param base Index of the first bit of the body in message
+ * @param count Count of bits of the body
+ * @param k Bits carried by one group
+ * 
+ * @return Count of tasks
+*/
+static int make_matrix_work(matrix_work *w, bitstream *cover, bitstream *message, long base, long count, int k){
+
+    w->cover = cover;
+    w->message = message;
+    w->base = base;
+    w->count = count;
+    w->k = k;
+    w->groups = (count + k - 1) / k;
+    w->task_groups = MATRIX_TASK_GROUPS;
+
+    return (int)((w->groups + w->task_groups - 1) / w->task_groups);
+}
+
+
+/**
+ * This function writes count bits of the body in the layout (through the groups of matrix embedding if it is used).
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream
+ * @param count Count of bits of the body
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_body(image *img, const layout *lay, bitstream *bs, long base, long count, int threads){
+
+    /* Declaration and initialization of variables */
+    long start = body_start(lay), slots = cover_slots(lay, count);
+    layout plain = *lay;
+    bitstream cover;
+    matrix_work w;
+    int ret, tasks;
+
+    if (!lay->matrix) {
+        return write_units(img, lay, start, bs, base, count, threads);
+    }
+
+    /* The cover bits are read, changed in at most one bit per group and written back */
+    plain.matrix = 0;
+
+    if (bitstream_init(&cover, slots) == FAILURE) {
+        return FAILURE;
+    }
+
+    if (read_units(img, &plain, start, slots, &cover, threads) == FAILURE) {
+        bitstream_free(&cover);
+        return FAILURE;
+    }
+
+    tasks = make_matrix_work(&w, &cover, bs, base, count, lay->matrix);
+    ret = parallel_for(threads, tasks, matrix_encode_task, &w);
+
+    if (ret != FAILURE) {
+        ret = write_units(img, &plain, start, &cover, 0, slots, threads);
+    }
+
+    bitstream_free(&cover);
+
+    return ret;
+}
+
+
+/**
+ * This function reads count bits of the body from the layout (decoding the groups of matrix embedding if it is used).
+ * 
+ * @param img Image
+ * @param lay Layout of the bits
+ * @param count Count of bits of the body
+ * @param bs Bitstream where the bits are appended (empty)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_body(image *img, const layout *lay, long count, bitstream *bs, int threads){
+
+    /* Declaration and initialization of variables */
+    long start = body_start(lay), slots = cover_slots(lay, count);
+    layout plain = *lay;
+    bitstream cover;
+    matrix_work w;
+    int ret, tasks;
+
+    if (!lay->matrix) {
+        return read_units(img, lay, start, count, bs, threads);
+    }
+
+    plain.matrix = 0;
+
+    if (bitstream_init(&cover, slots) == FAILURE) {
+        return FAILURE;
+    }
+
+    ret = read_units(img, &plain, start, slots, &cover, threads);
+
+    /* The syndrome of every group is its part of the body */
+    if (ret != FAILURE) {
+
+        tasks = make_matrix_work(&w, &cover, bs, 0, count, lay->matrix);
+        ret = parallel_for(threads, tasks, matrix_decode_task, &w);
+        bs->length = count;
+    }
+
+    bitstream_free(&cover);
+
+    return ret;
+}
+
+
+/**
+ * This function writes the pixels whose bits differ between the old and the new stream and marks their rows.
+ * 
+ * @param img Image (tracking the changed rows)
+ * @param lay Layout of the bits (without matrix embedding)
+ * @param start Index of the first pixel of the stream
+ * @param old Bits now stored in the pixels
+ * @param cur Bits to be stored
+ * @param count Count of bits of both streams
+ * 
+ * @return Count of written pixels
+*/
+static long delta_stream(image *img, const layout *lay, long start, const bitstream *old, const bitstream *cur, long count){
+
+    /* Declaration and initialization of variables */
+    long i, unit, last = -1, pixel, position, changed = 0;
+    int b;
+    byte diff, *px;
+
+    for (i = 0; i < (count + 7) / 8; i++) {
+
+        diff = old->data[i] ^ cur->data[i];
+
+        /* Bits after the end are not compared */
+        if (i == count / 8) diff &= (byte)(0xFF00 >> (count & 7));
+
+        for (b = 0; diff; b++, diff <<= 1) {
+
+            if (!(diff & 0x80)) continue;
+
+            /* The whole pixel of the bit is written once */
+            unit = (i * 8 + b) / lay->bits_per_pixel;
+            if (unit == last) continue;
+            last = unit;
+
+            pixel = start + (lay->spread ? (long)spread_forward(lay->spread, (dword)unit) : unit);
+            px = IMAGE_ROW(img, pixel / img->width) + (pixel % img->width) * BYTES_PER_PIXEL;
+
+            position = unit * lay->bits_per_pixel;
+            write_slots(px, lay, 0, cur, &position, count);
+
+            img->dirty[pixel / img->width] = 1;
+            changed++;
+        }
+    }
+
+    return changed;
+}
+
+
+/**
+ * This function writes count bits of the body, but only into the pixels where the stored bits differ.
+ * 
+ * @param img Image (tracking the changed rows)
+ * @param lay Layout of the bits
+ * @param bs Bitstream
+ * @param base Index of the first bit of the body in the bitstream (multiple of 8)
+ * @param count Count of bits of the body
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * @param changed Count of written pixels (increased)
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int delta_body(image *img, const layout *lay, bitstream *bs, long base, long count, int threads, long *changed){
+
+    /* Declaration and initialization of variables */
+    long start = body_start(lay), slots = cover_slots(lay, count);
+    layout plain = *lay;
+    bitstream old, cur;
+    matrix_work w;
+    int ret, tasks;
+
+    plain.matrix = 0;
+
+    /* Cover bits now stored in the pixels */
+    if (bitstream_init(&old, slots) == FAILURE) {
+        return FAILURE;
+    }
+
+    if (read_units(img, &plain, start, slots, &old, threads) == FAILURE) {
+        bitstream_free(&old);
+        return FAILURE;
+    }
+
+    if (lay->matrix) {
+
+        /* Groups which already have the right syndrome keep their cover bits */
+        if (bitstream_init(&cur, slots) == FAILURE) {
+            bitstream_free(&old);
+            return FAILURE;
+        }
+
+        memcpy(cur.data, old.data, (size_t)(slots + 7) / 8);
+        cur.length = slots;
+
+        tasks = make_matrix_work(&w, &cur, bs, base, count, lay->matrix);
+        ret = parallel_for(threads, tasks, matrix_encode_task, &w);
+
+        if (ret != FAILURE) {
+            *changed += delta_stream(img, &plain, start, &old, &cur, slots);
+        }
+
+        bitstream_free(&cur);
+
+    } else {
+
+        /* The body starts on a byte of the bitstream */
+        cur.data = bs->data + base / 8;
+        cur.length = cur.capacity = count;
+
+        *changed += delta_stream(img, &plain, start, &old, &cur, count);
+        ret = SUCCESS;
+    }
+
+    bitstream_free(&old);
+
+    return ret;
+}
+
+
+/**
+ * This function serializes the prefix (watermark, config and digest), the size, the compressed data and the crc32.
+ *
+ * @param bs Bitstream to be initialized
+ * @param compressed Array of words
+ * @param compressed_size Size of the compressed data
+ * @param lay Layout of the bits
+ * @param digest Digest of the payload (written if the layout has room for it)
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int serialize_stream(bitstream *bs, word *compressed, int compressed_size, const layout *lay, unsigned long long digest){
+
+    /* Declaration and initialization of variables */
+    char *watermark = is_legacy(lay) ? WATERMARK : WATERMARK_CONFIG;
+    const code_kernel *codes = find_code_kernel(COMPRESSED_SIZE);
+    int i;
+
+    init_syndrome_table();
+
+    if (bitstream_init(bs, body_start(lay) + body_bits(compressed_size)) == FAILURE) {
+        return FAILURE;
+    }
+
+    for (i = 0; i < 2; i++) {
+        bitstream_put(bs, (byte)watermark[i], sizeof(char) * 8);
+    }
+
+    if (!is_legacy(lay)) {
+        bitstream_put(bs, lay->channels | ((dword)lay->depth << DEPTH_SHIFT) | ((dword)lay->matrix << MATRIX_SHIFT)
+                      | (lay->spread ? CONFIG_KEYED : 0) | (lay->digest ? CONFIG_DIGEST : 0), CONFIG_SIZE);
+    }
+
+    if (lay->digest) {
+        bitstream_put(bs, (dword)(digest >> 32), DIGEST_SIZE / 2);
+        bitstream_put(bs, (dword)digest, DIGEST_SIZE / 2);
+    }
+
+    bitstream_put(bs, (dword)compressed_size, sizeof(int) * 8);
+
+    if (codes) {
+
+        codes->put(bs->data, bs->length, compressed, compressed_size);
+        bs->length += (long)compressed_size * COMPRESSED_SIZE;
+
+    } else {
+
+        for (i = 0; i < compressed_size; i++) {
+            bitstream_put(bs, compressed[i], COMPRESSED_SIZE);
+        }
+    }
+
+    bitstream_put(bs, crc32b(compressed, compressed_size), CRC32_SIZE);
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function hides the compressed data in the pixels (LSBs of the channels of the layout).
+ * 
+ * @param compressed Array of words
+ * @param compressed_size Size of the compressed data
+ * @param img Image
+ * @param lay Layout of the bits (the original format for the LSB of the BLUE channel)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * @param delta TRUE to write only the pixels which differ (and track the changed rows)
+ * @param digest Digest of the payload (written if the layout has room for it)
+ * 
+ * @return SUCCESS if success, FAILURE if error
+*/
+int hide_mechanism(word *compressed, int compressed_size, image *img, const layout *lay, int threads, int delta, unsigned long long digest){
+
+    /* Declaration of variables */
+	int ret;
+    long prefix;
+    long changed = 0;
+    layout blue;
+    bitstream bs, old;
+    byte *scratch = NULL;
+
+
+	/* Check if the picture file is big enough */
+	if (!body_fits(lay, body_bits(compressed_size), img->width, img->height)) {
+		printf("Picture file is too small!\n");
+		return 1;
+	}
+
+    /* Rows which are not loaded yet are not touched */
+    if (need_rows(img, body_rows(img, lay, body_bits(compressed_size))) == FAILURE) {
+        printf("Error in hide_mechanism!\n");
+        return FAILURE;
+    }
+
+    /* Watermark (and config) are always in the LSB of the BLUE channel */
+    make_layout(&blue, CHANNEL_B, 1);
+    prefix = body_start(lay);
+
+    if (serialize_stream(&bs, compressed, compressed_size, lay, digest) == FAILURE) {
+        return FAILURE;
+    }
+
+
+    /* Buffer for the bits of one row */
+    scratch = (byte *)malloc((size_t)img->width * SCRATCH_PER_PIXEL);
+
+    if (!scratch) {
+        printf("Error in hide_mechanism!\n");
+        bitstream_free(&bs);
+        return FAILURE;
+    }
+
+    if (delta) {
+
+        /* Diff against the stream already in the picture, only differing pixels are written */
+        if (track_dirty(img) == FAILURE || bitstream_init(&old, prefix) == FAILURE) {
+            free(scratch);
+            bitstream_free(&bs);
+            return FAILURE;
+        }
+
+        read_stream(img, &blue, 0, 0, prefix, &old, scratch);
+        changed = delta_stream(img, &blue, 0, &old, &bs, prefix);
+        bitstream_free(&old);
+
+        ret = delta_body(img, lay, &bs, prefix, bs.length - prefix, threads, &changed);
+
+        printf("Delta: %ld pixel(s) changed in %d row(s)\n", changed, count_dirty(img));
+
+    } else {
+
+        /* Write the prefix and the body (bands of rows in parallel) */
+        write_stream(img, &blue, 0, &bs, 0, 0, prefix, scratch);
+        ret = write_body(img, lay, &bs, prefix, bs.length - prefix, threads);
+    }
+
+    free(scratch);
+    bitstream_free(&bs);
+
+    return ret == FAILURE ? FAILURE : 0;
+}
+
+/**
+ * This function selects the layout of the hidden content by its watermark and config.
+ * 
+ * @param watermark Watermark (the first bits in the LSB of the BLUE channel)
+ * @param config Config following the watermark (not used by the original format)
+ * @param lay Layout to be filled (without the spread)
+ * 
+ * @return SUCCESS or FAILURE if there is no hidden content
+*/
+static int parse_config(dword watermark, dword config, layout *lay){
+
+    if (watermark == (dword)((WATERMARK[0] << 8) | WATERMARK[1])) {
+        return make_layout(lay, CHANNEL_B, 1);
+    }
+
+    if (watermark != (dword)((WATERMARK_CONFIG[0] << 8) | WATERMARK_CONFIG[1])
+        || (config >> CONFIG_RESERVED_SHIFT) != 0
+        || make_layout(lay, config & CHANNEL_MASK, (config >> DEPTH_SHIFT) & DEPTH_MASK) == FAILURE
+        || set_matrix(lay, (config >> MATRIX_SHIFT) & MATRIX_MASK) == FAILURE) {
+        return FAILURE;
+    }
+
+    /* The digest is not needed for extracting, the body just starts after it */
+    lay->digest = (config & CONFIG_DIGEST) != 0;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function unpacks the compressed data of the body and checks its crc32.
+ * 
+ * @param bs Bits of the whole body (size, the compressed data and the crc32)
+ * @param w_size Count of compressed words
+ * @param returns Code of return (SUCCESS, FAILURE, 5 - INVALID CRC32)
+ * 
+ * @return NULL if error, otherwise the compressed data
+*/
+static word *unpack_body(const bitstream *bs, int w_size, int *returns){
+
+    /* Declaration and initialization of variables */
+    long header = sizeof(int) * 8;
+    const code_kernel *codes = find_code_kernel(COMPRESSED_SIZE);
+    word *compressed = (word *)malloc(sizeof(word) * w_size);
+    dword w_crc32;
+    int i;
+
+    if (!compressed) {
+        printf("Error in extract_mechanism!\n");
+        *returns = FAILURE;
+        return NULL;
+    }
+
+    if (codes) {
+
+        codes->get(bs->data, header, compressed, w_size);
+
+    } else {
+
+        for (i = 0; i < w_size; i++) {
+            compressed[i] = (word)bitstream_get(bs, header + (long)i * COMPRESSED_SIZE, COMPRESSED_SIZE);
+        }
+    }
+
+    w_crc32 = bitstream_get(bs, header + (long)w_size * COMPRESSED_SIZE, CRC32_SIZE);
+
+    if (crc32b(compressed, w_size) != w_crc32) {
+        /* INVALID CRC32, CONTENT DAMAGED - 5 */
+        free(compressed);
+        *returns = 5;
+        return NULL;
+    }
+
+    *returns = SUCCESS;
+
+    return compressed;
+}
+
+
+/**
+ * This function extracts the compressed data from the pixels (layout is given by the watermark and the config).
+ * 
+ * @param img Image
+ * @param size Size of the extracted data
+ * @param returns Code of return to check what happened (SUCCESS, FAILURE, 4 - NO HIDDEN CONTENT, 5 - INVALID CRC32)
+ * @param opts Options (key and count of threads)
+ * 
+ * @return NULL if error, otherwise extracted data
+*/
+word *extract_mechanism(image *img, int *size, int *returns, const options *opts){
+
+    /* Declaration and initialization of variables */
+	int w_size = 0;
+    long header = sizeof(int) * 8, body;
+    word *compressed = NULL;
+    dword watermark, config;
+    layout blue, lay;
+    bitstream bs;
+    byte *scratch = NULL;
+    spread sp;
+
+
+    /* Check if the prefix fits in the picture */
+    if ((long)img->width * img->height < PREFIX_PIXELS) {
+
+        /* NO HIDDEN CONTENT - 4 */
+        *returns = 4;
+        return NULL;
+    }
+
+    scratch = (byte *)malloc((size_t)img->width * SCRATCH_PER_PIXEL);
+
+    if (!scratch || need_rows(img, (PREFIX_PIXELS + img->width - 1) / img->width) == FAILURE || bitstream_init(&bs, PREFIX_PIXELS) == FAILURE) {
+        printf("Error in extract_mechanism!\n");
+        free(scratch);
+        *returns = FAILURE;
+        return NULL;
+    }
+
+
+    /* Read the watermark and the config (LSB of the BLUE channel) */
+    make_layout(&blue, CHANNEL_B, 1);
+    read_stream(img, &blue, 0, 0, PREFIX_PIXELS, &bs, scratch);
+
+    watermark = bitstream_get(&bs, 0, WATERMARK_SIZE);
+    config = bitstream_get(&bs, WATERMARK_SIZE, CONFIG_SIZE);
+    bitstream_free(&bs);
+
+    if (parse_config(watermark, config, &lay) == FAILURE) {
+
+        free(scratch);
+
+        /* NO HIDDEN CONTENT - 4 */
+        *returns = 4;
+        return NULL;
+    }
+
+    /* The body is spread by the key (the original format has no config) */
+    if (watermark == (dword)((WATERMARK_CONFIG[0] << 8) | WATERMARK_CONFIG[1]) && (config & CONFIG_KEYED)) {
+
+        if (!opts->key) {
+            printf("The content is hidden with a key, use --key!\n");
+        }
+
+        if (!opts->key || (long)img->width * img->height <= PREFIX_PIXELS + (lay.digest ? DIGEST_SIZE : 0)
+            || make_spread(&sp, opts->key, (unsigned long)img->width * img->height - PREFIX_PIXELS - (lay.digest ? DIGEST_SIZE : 0)) == FAILURE) {
+
+            free(scratch);
+
+            /* NO HIDDEN CONTENT - 4 */
+            *returns = 4;
+            return NULL;
+        }
+
+        lay.spread = &sp;
+    }
+
+
+    /* Read the size of the compressed data */
+    if (!body_fits(&lay, header, img->width, img->height) || bitstream_init(&bs, header) == FAILURE) {
+
+        free(scratch);
+
+        /* NO HIDDEN CONTENT - 4 */
+        *returns = 4;
+        return NULL;
+    }
+
+    init_syndrome_table();
+
+    if (need_rows(img, body_rows(img, &lay, header)) == FAILURE || read_body(img, &lay, header, &bs, 1) == FAILURE) {
+        free(scratch);
+        bitstream_free(&bs);
+        *returns = FAILURE;
+        return NULL;
+    }
+
+    w_size = (int)bitstream_get(&bs, 0, header);
+    bitstream_free(&bs);
+
+    /* The size must fit in the rest of the picture */
+    body = body_bits(w_size);
+
+    if (w_size <= 0 || !body_fits(&lay, body, img->width, img->height)) {
+
+        free(scratch);
+
+        /* INVALID SIZE, CONTENT DAMAGED - 5 */
+        *returns = 5;
+        return NULL;
+    }
+
+	*size = w_size;
+
+    if (bitstream_init(&bs, body) == FAILURE) {
+        printf("Error in extract_mechanism!\n");
+        free(scratch);
+        *returns = FAILURE;
+        return NULL;
+    }
+
+
+    /* Read the whole body (size again, the compressed data and the crc32) */
+    free(scratch);
+
+    if (need_rows(img, body_rows(img, &lay, body)) == FAILURE || read_body(img, &lay, body, &bs, opts->threads) == FAILURE) {
+        bitstream_free(&bs);
+        *returns = FAILURE;
+        return NULL;
+    }
+
+    compressed = unpack_body(&bs, w_size, returns);
+    bitstream_free(&bs);
+
+    return compressed;
+}
+
+
+/**
+ * This function calculates the crc32 of a message.
+ * @param message The message to calculate the crc32.
+ * @param length The length of the message.
+ * 
+ * @return The crc32 of the message if the message was calculated successfully and FAILURE if an error occurred.
+*/
+dword crc32b(word *message, int length) {
+
+	/* Sanity check */
+	if (!message || length <= 0) {
+		printf("Error in crc32b function\n");
+		return FAILURE;
+	}
+
+	/* Table or carry-less multiplication kernel (same result as the bitwise algorithm) */
+	return get_kernels()->crc32(message, length);
+
+}
+
+
+/**
+ * This function finishes the layout (spread and digest) and checks if the body fits.
+ * 
+ * @param lay Layout (channels, depth and matrix are set)
+ * @param sp Keyed permutation of the pixels of the body (NULL for the order of the rows)
+ * @param bits Count of bits of the body
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * 
+ * @return TRUE or FALSE
+*/
+static int layout_fits(layout *lay, const spread *sp, long bits, int width, int height){
+
+    lay->spread = sp;
+
+    /* Every new header has the config and the digest of the payload (the original "hD" one is only read) */
+    lay->digest = TRUE;
+
+    return body_fits(lay, bits, width, height);
+}
+
+
+/**
+ * This function selects the layout for the payload.
+ * With --bits auto, the first layout (the fewest bits per pixel) which fits is selected.
+ * With --matrix auto, the biggest k which fits is selected.
+ * 
+ * @param lay Selected layout
+ * @param opts Options (channels and depth)
+ * @param sp Keyed permutation of the pixels of the body (NULL for the order of the rows)
+ * @param compressed_size Count of compressed words
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * 
+ * @return SUCCESS or FAILURE if the payload does not fit
+*/
+static int choose_layout(layout *lay, const options *opts, const spread *sp, int compressed_size, int width, int height){
+
+    /* Declaration and initialization of variables */
+    static const int ladder[][2] = {
+        {CHANNEL_B, 1},
+        {CHANNEL_G | CHANNEL_B, 1},
+        {CHANNEL_R | CHANNEL_G | CHANNEL_B, 1},
+        {CHANNEL_G | CHANNEL_B, 2},
+        {CHANNEL_R | CHANNEL_G | CHANNEL_B, 2},
+        {CHANNEL_R | CHANNEL_G | CHANNEL_B, 3}
+    };
+    int i, channels = opts->channels ? opts->channels : CHANNEL_B;
+    long bits = body_bits(compressed_size);
+
+    /* Matrix embedding (one LSB per channel), the biggest k changes the fewest LSBs */
+    if (opts->matrix != MATRIX_OFF) {
+
+        make_layout(lay, channels, 1);
+
+        for (i = MAX_MATRIX; i >= MIN_MATRIX; i--) {
+
+            if (opts->matrix != MATRIX_AUTO && opts->matrix != i) continue;
+
+            set_matrix(lay, i);
+            if (layout_fits(lay, sp, bits, width, height)) return SUCCESS;
+        }
+
+        return FAILURE;
+    }
+
+    /* Fixed layout */
+    if (opts->depth != DEPTH_AUTO) {
+
+        make_layout(lay, channels, opts->depth);
+        return layout_fits(lay, sp, bits, width, height) ? SUCCESS : FAILURE;
+    }
+
+    /* Fixed channels, the smallest depth */
+    if (opts->channels) {
+
+        for (i = 1; i <= MAX_DEPTH; i++) {
+
+            make_layout(lay, channels, i);
+            if (layout_fits(lay, sp, bits, width, height)) return SUCCESS;
+        }
+
+        return FAILURE;
+    }
+
+    /* The smallest count of bits per pixel */
+    for (i = 0; i < (int)(sizeof(ladder) / sizeof(ladder[0])); i++) {
+
+        make_layout(lay, ladder[i][0], ladder[i][1]);
+        if (layout_fits(lay, sp, bits, width, height)) return SUCCESS;
+    }
+
+    return FAILURE;
+}
+
+
+/**
+ * This function calculates the digest of the payload (64-bit FNV-1a of the key and the data).
+ * It detects a repeated hide of the same payload, it is not a cryptographic hash.
+ * 
+ * @param data Payload
+ * @param key Key (NULL if not used)
+ * 
+ * @return Digest
+*/
+static unsigned long long payload_digest(const payload *data, const char *key){
+
+    /* Declaration and initialization of variables */
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    long i;
+
+    /* The key is ended by a zero, so the key and the data cannot be shifted into each other */
+    for (; key && *key; key++) {
+        hash = (hash ^ (byte)*key) * 0x100000001B3ULL;
+    }
+    hash *= 0x100000001B3ULL;
+
+    for (i = 0; i < data->size; i++) {
+        hash = (hash ^ data->data[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+
+/**
+ * This function returns the count of rows holding the header with the digest.
+ * 
+ * @param width Width of the picture
+ * @return Count of rows
+ */
+int digest_rows(int width){
+
+    return (int)((PREFIX_PIXELS + DIGEST_SIZE + width - 1) / width);
+}
+
+
+/**
+ * This function checks if the layout in the config is one the options would select.
+ * Only what was asked for is compared (--bits auto accepts any depth, --matrix auto any k).
+ * 
+ * @param config Config of the header
+ * @param opts Options (channels, depth and matrix)
+ * @return TRUE or FALSE
+ */
+static int layout_requested(dword config, const options *opts){
+
+    /* Declaration and initialization of variables */
+    int channels = (int)(config & CHANNEL_MASK), depth = (int)((config >> DEPTH_SHIFT) & DEPTH_MASK);
+    int matrix = (int)((config >> MATRIX_SHIFT) & MATRIX_MASK);
+
+    /* Matrix embedding only if it is asked for, with the same k if k is given */
+    if (opts->matrix == MATRIX_OFF ? matrix != 0 : matrix == 0 || (opts->matrix != MATRIX_AUTO && opts->matrix != matrix)) {
+        return FALSE;
+    }
+
+    /* Without --channels only --bits auto may select other channels than BLUE */
+    if (opts->channels ? channels != opts->channels : (opts->depth != DEPTH_AUTO || opts->matrix != MATRIX_OFF) && channels != CHANNEL_B) {
+        return FALSE;
+    }
+
+    /* Matrix embedding always uses one LSB */
+    return opts->matrix != MATRIX_OFF || opts->depth == DEPTH_AUTO || depth == opts->depth;
+}
+
+
+/**
+ * This function checks if the picture already holds the payload (digest in the header).
+ * Only the pixels of the header are read, so only the first rows must be decoded.
+ * 
+ * @param img The image (only the rows of the header are loaded)
+ * @param payload_path Path to the file to be hidden
+ * @param opts Options (key and the layout of the bits)
+ * @return TRUE if the same payload is hidden with the requested layout, otherwise FALSE
+ */
+int payload_hidden(image *img, char *payload_path, const options *opts){
+
+    /* Declaration and initialization of variables */
+    long prefix = PREFIX_PIXELS + DIGEST_SIZE;
+    unsigned long long digest;
+    dword watermark, config;
+    payload *data = NULL;
+    int ret = FALSE;
+    layout blue;
+    bitstream bs;
+    byte *scratch = NULL;
+
+    /* Sanity check */
+    if (!img || !payload_path || !opts || (long)img->width * img->height < prefix || need_rows(img, digest_rows(img->width)) == FAILURE) {
+        return FALSE;
+    }
+
+    scratch = (byte *)malloc((size_t)img->width * SCRATCH_PER_PIXEL);
+
+    if (!scratch || bitstream_init(&bs, prefix) == FAILURE) {
+        free(scratch);
+        return FALSE;
+    }
+
+    /* Watermark, config and digest (LSB of the BLUE channel) */
+    make_layout(&blue, CHANNEL_B, 1);
+    read_stream(img, &blue, 0, 0, prefix, &bs, scratch);
+    free(scratch);
+
+    watermark = bitstream_get(&bs, 0, WATERMARK_SIZE);
+    config = bitstream_get(&bs, WATERMARK_SIZE, CONFIG_SIZE);
+    digest = ((unsigned long long)bitstream_get(&bs, PREFIX_PIXELS, DIGEST_SIZE / 2) << 32) | bitstream_get(&bs, PREFIX_PIXELS + DIGEST_SIZE / 2, DIGEST_SIZE / 2);
+    bitstream_free(&bs);
+
+    /* The header must have the digest, the same use of the key and the requested layout */
+    if (watermark != (dword)((WATERMARK_CONFIG[0] << 8) | WATERMARK_CONFIG[1])
+        || (config >> CONFIG_RESERVED_SHIFT) != 0 || !(config & CONFIG_DIGEST)
+        || !(config & CONFIG_KEYED) != !opts->key || !layout_requested(config, opts)) {
+        return FALSE;
+    }
+
+    /* Only now the payload is worth reading */
+    data = get_payload(payload_path);
+
+    if (data) {
+        ret = payload_digest(data, opts->key) == digest;
+        free_payload(data);
+    }
+
+    return ret;
+}
+
+
+/**
+ * This function reads and compresses the payload and selects the layout for the picture.
+ * 
+ * @param payload_path Path to the payload
+ * @param opts Options (layout of the bits)
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * @param sp Keyed permutation of the pixels of the body (filled if the key is given)
+ * @param lay Selected layout
+ * @param compressed Compressed data (allocated here)
+ * @param size Size of the compressed data
+ * @param digest Digest of the payload
+ * 
+ * @return 0 if success, 1 if the payload cannot be read, 3 if picture is not big enough, 6 if other error
+*/
+static int prepare_hide(char *payload_path, const options *opts, int width, int height, spread *sp, layout *lay,
+                        word **compressed, int *size, unsigned long long *digest){
+
+    /* Declaration of variables */
+    payload *data = NULL;
+    
+    /* Read payLoad file */
+    data = get_payload(payload_path);
+
+    /* The path of the payload is not checked before (get_payload tells why) */
+    if (!data) {
+
+        /* WRONG PARAMETERS - 1 */
+        return 1;
+    }
+
+    /* Compress data */
+    *compressed = compress(data->data, data->size, size);
+    *digest = payload_digest(data, opts->key);
+    free_payload(data);
+
+    if (!*compressed) {
+        printf("Error in hide_in_image!\n");
+
+        /* OTHER ERROR - 6 */
+        return 6;
+    }
+
+
+    /* Permutation of the pixels after the prefix (a keyed header always carries the digest) */
+    if (opts->key && ((long)width * height <= PREFIX_PIXELS + DIGEST_SIZE
+                      || make_spread(sp, opts->key, (unsigned long)width * height - PREFIX_PIXELS - DIGEST_SIZE) == FAILURE)) {
+        free(*compressed);
+        *compressed = NULL;
+
+        /* Picture is too small even for the prefix */
+        printf("Data is too big to hide in this picture!\nPlease choose a bigger picture!\n");
+        return 3;
+    }
+
+    /* Check if the picture is big enough */
+    if (choose_layout(lay, opts, opts->key ? sp : NULL, *size, width, height) == FAILURE) {
+
+        /* Inform user that the picture is not big enough */
+        printf("Data is too big to hide in this picture!\nPlease choose a bigger picture!\n");
+        free(*compressed);
+        *compressed = NULL;
+
+        /* PICTURE IS NOT BIG ENOUGH - 3 */
+        return 3;
+    }
+
+    printf("Hiding data ...\n");
+
+    if (lay->channels != CHANNEL_B || lay->depth != 1) {
+        printf("Using %d bit(s) of %s%s%s (%d bits per pixel)\n", lay->depth,
+               (lay->channels & CHANNEL_R) ? "R" : "", (lay->channels & CHANNEL_G) ? "G" : "", (lay->channels & CHANNEL_B) ? "B" : "",
+               lay->bits_per_pixel);
+    }
+
+    if (lay->matrix) {
+        printf("Matrix embedding: %d bits in every %d LSBs\n", lay->matrix, (1 << lay->matrix) - 1);
+    }
+
+    if (lay->spread) {
+        printf("Pixels are spread by the key\n");
+    }
+
+    return 0;
+}
+
+
+/**
+ * This function hides the compressed data in the picture.
+ * 
+ * @param img Image
+ * @param payload_path Path to the payload
+ * @param opts Options (layout of the bits)
+ * 
+ * @return 0 if success, 1 if the payload cannot be read, 3 if bmp file is not big enough, 6 if other error
+*/
+int hide_in_image(image *img, char *payload_path, const options *opts){
+
+    /* Declaration of variables */
+    word *compressed = NULL;
+    unsigned long long digest;
+    int size = 0, ret;
+    layout lay;
+    spread sp;
+
+    ret = prepare_hide(payload_path, opts, img->width, img->height, &sp, &lay, &compressed, &size, &digest);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Hide the data */
+    if (hide_mechanism(compressed, size, img, &lay, opts->threads, opts->delta, digest) != FAILURE) {
+
+        printf("Data hidden successfully!\n");
+        free(compressed);
+
+        /* DATA HIDDEN - 0 */
+        return 0;
+
+    }
+
+    printf("Data hiding went wrong!\n");
+    free(compressed);
+
+    /* DIFFERENT ERROR - 6 */
+    return 6;
+}
+
+/**
+ * This function returns the range of the bits of a stream which fall in the window.
+ * 
+ * @param width Width of the picture
+ * @param lay Layout of the stream
+ * @param start Index of the first pixel of the stream
+ * @param count Count of bits of the stream
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * @param from Index of the first bit in the window
+ * @param to Index after the last bit in the window (not bigger than from if there is none)
+ * 
+ * @return void
+*/
+static void window_range(int width, const layout *lay, long start, long count, int first_row, int rows, long *from, long *to){
+
+    /* Declaration and initialization of variables */
+    long first = (long)first_row * width - start, last = (long)(first_row + rows) * width - start;
+
+    *from = first > 0 ? first * lay->bits_per_pixel : 0;
+    *to = last * lay->bits_per_pixel < count ? last * lay->bits_per_pixel : count;
+}
+
+
+/**
+ * This function prepares the hide of the payload in a picture which is processed by windows of rows.
+ * 
+ * @param plan Plan to be filled
+ * @param payload_path Path to the file to be hidden
+ * @param opts Options (layout of the bits, the key is not supported)
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * 
+ * @return 0 if success, 1 if the payload cannot be read, 3 if picture is not big enough, 6 if other error
+*/
+int make_hide_plan(hide_plan *plan, char *payload_path, const options *opts, int width, int height){
 
-        }
+    /* Declaration of variables */
+    word *compressed = NULL;
+    unsigned long long digest;
+    int size = 0, ret;
+    spread sp;
 
-        compressed[i] = temp;
+    /* Sanity check (a spread body may be in any window) */
+    if (!plan || !payload_path || !opts || opts->key) {
+        printf("Error in make_hide_plan!\n");
+        return 6;
     }
 
+    memset(plan, 0, sizeof(hide_plan));
 
-    /* Read the crc32 */
-    for (i = CRC32_SIZE- 1; i >= 0; i--) {
-
-        if ((w_col_end == (((width * BYTES_PER_PIXEL) - 1) + BYTES_PER_PIXEL))) {
-            w_col_end = COLUMN_START;
-            w_row_end++;
-        }
-        
-        if (row_pointers[w_row_end][w_col_end] & mask_1) {
-            w_crc32 |= 1 << i;
-        }
-        else {
-            w_crc32 &= ~(1 << i);
-        }
+    ret = prepare_hide(payload_path, opts, width, height, &sp, &plan->lay, &compressed, &size, &digest);
 
-        w_col_end += BYTES_PER_PIXEL;
-       
+    if (ret != 0) {
+        return ret;
     }
 
-    crc32 = crc32b(compressed, w_size);
+    make_layout(&plan->blue, CHANNEL_B, 1);
+    plan->prefix = body_start(&plan->lay);
+    plan->width = width;
+    plan->height = height;
 
-    if (crc32 != w_crc32) {
-        /* INVALID CRC32, CONTENT DAMAGED - 5 */
-        free(compressed);
-        *returns = 5;
-        return NULL;
-    }
+    ret = serialize_stream(&plan->bs, compressed, size, &plan->lay, digest);
+    free(compressed);
 
+    if (ret == FAILURE) {
+        printf("Error in make_hide_plan!\n");
+        return 6;
+    }
 
-    *returns = SUCCESS;
+    plan->count = plan->bs.length - plan->prefix;
+    plan->scratch = (byte *)malloc((size_t)width * SCRATCH_PER_PIXEL);
 
+    /* The cover bits of every window are gathered before the body is encoded */
+    if (!plan->scratch || (plan->lay.matrix && bitstream_init(&plan->cover, cover_slots(&plan->lay, plan->count)) == FAILURE)) {
+        printf("Error in make_hide_plan!\n");
+        free_hide_plan(plan);
+        return 6;
+    }
 
-    return compressed;
+    return 0;
 }
 
 
 /**
- * This function calculates the crc32 of a message.
- * @param message The message to calculate the crc32.
- * @param length The length of the message.
+ * This function returns the count of the first rows touched by the plan.
  * 
- * @return The crc32 of the message if the message was calculated successfully and FAILURE if an error occurred.
+ * @param plan Plan
+ * 
+ * @return Count of rows
 */
-dword crc32b(word *message, int length) {
-
-	/* Declare and initialize variables */
-   	int i = 0, j;
-   	unsigned int current_word, crc = 0xFFFFFFFF, mask;
-
-	/* Sanity check */
-	if (!message || length <= 0) {
-		printf("Error in crc32b function\n");
-		return FAILURE;
-	}
-
-	/* Iterate through message */
-	while (i < length) {
+int plan_rows(const hide_plan *plan){
 
-		/* Get current word */
-		current_word = message[i]; 
-
-		/* XOR crc with current word */
-		crc = crc ^ current_word;
-
-		/* Iterate through current word */
-		for (j = 15; j >= 0; j--) { 
-
-			/* Get mask */
-			mask = -(crc & 1);
+    /* Declaration and initialization of variables */
+    long pixels = plan->prefix + (cover_slots(&plan->lay, plan->count) + plan->lay.bits_per_pixel - 1) / plan->lay.bits_per_pixel;
 
-			/* Shift crc */
-			crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & mask);
-		}
+    return (int)((pixels + plan->width - 1) / plan->width);
+}
 
-		/* Increase i */
-		i = i + 1;
-	}
 
+/**
+ * This function reads the cover bits of the body from the window (matrix embedding only, windows in order).
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * 
+ * @return void
+*/
+void plan_read_window(hide_plan *plan, const image *win, int first_row, int rows){
 
-	/* Return crc */
-	return ~crc;
+    /* Declaration and initialization of variables */
+    layout plain = plan->lay;
+    long from, to;
 
+    plain.matrix = 0;
+    window_range(plan->width, &plain, plan->prefix, cover_slots(&plan->lay, plan->count), first_row, rows, &from, &to);
 
+    /* The window starts at its first row */
+    if (from < to) {
+        read_stream(win, &plain, plan->prefix - (long)first_row * plan->width, from, to, &plan->cover, plan->scratch);
+    }
 }
 
 
 /**
- * This function hides the compressed data in the picture.
+ * This function encodes the body into the cover bits (after every window was read by plan_read_window).
  * 
- * @param width Width of the picture
- * @param height Height of the picture
- * @param row_pointers_pt Pointer to the array of png_bytep
- * @param payload_path Path to the payload
+ * @param plan Plan
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
  * 
- * @return 0 if success, 3 if bmp file is not big enough, 6 if other error
+ * @return SUCCESS or FAILURE
 */
-int hide_in_image(int width, int height, png_bytep **row_pointers, char *payload_path){
+int plan_encode(hide_plan *plan, int threads){
 
     /* Declaration of variables */
-    word *compressed = NULL;
-    payload *data = NULL;
-    int size = 0;
-    
-    /* Read payLoad file */
-    data = get_payload(payload_path);
-
-    if (!data) {
-        printf("Error in hide_in_image!\n");
+    matrix_work w;
+    int tasks;
 
-        /* OTHER ERROR - 6 */
-        return 6;
+    if (!plan->lay.matrix) {
+        return SUCCESS;
     }
 
-    /* Compress data */
-    compressed = compress(data->data, data->size, &size);
+    tasks = make_matrix_work(&w, &plan->cover, &plan->bs, plan->prefix, plan->count, plan->lay.matrix);
 
-    if (!compressed) {
-        printf("Error in hide_in_image!\n");
+    return parallel_for(threads, tasks, matrix_encode_task, &w);
+}
 
-        /* OTHER ERROR - 6 */
-        return 6;
-    }
 
+/**
+ * This function writes the bits of the prefix and of the body which fall in the window.
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * 
+ * @return void
+*/
+void plan_write_window(const hide_plan *plan, image *win, int first_row, int rows){
 
-    /* Check if the bmp file is big enough */
-    if ((width * height) >= (size  * COMPRESSED_SIZE) + WATERMARK_SIZE + CRC32_SIZE + ( (int) sizeof(int) ) * 8) {
+    /* Declaration and initialization of variables */
+    long shift = (long)first_row * plan->width, from, to;
+    layout plain = plan->lay;
 
-        
-        printf("Hiding data ...\n");
+    /* Prefix */
+    window_range(plan->width, &plan->blue, 0, plan->prefix, first_row, rows, &from, &to);
 
-        /* Hide the data */
-        if (hide_mechanism(compressed, size, row_pointers, width, height) != FAILURE) {
+    if (from < to) {
+        write_stream(win, &plan->blue, -shift, &plan->bs, 0, from, to, plan->scratch);
+    }
 
-            printf("Data hidden successfully!\n");
-            free_payload(data);
-            free(compressed);
+    /* Body (the encoded cover bits for matrix embedding) */
+    if (plan->lay.matrix) {
 
-            /* DATA HIDDEN - 0 */
-            return 0;
+        plain.matrix = 0;
+        window_range(plan->width, &plain, plan->prefix, plan->cover.length, first_row, rows, &from, &to);
 
-        } else {
+        if (from < to) {
+            write_stream(win, &plain, plan->prefix - shift, &plan->cover, 0, from, to, plan->scratch);
+        }
 
-            printf("Data hiding went wrong!\n");
-            free_payload(data);
-            free(compressed);
+    } else {
 
-            /* DIFFERENT ERROR - 6 */
-            return 6;
+        window_range(plan->width, &plan->lay, plan->prefix, plan->count, first_row, rows, &from, &to);
 
+        if (from < to) {
+            write_stream(win, &plan->lay, plan->prefix - shift, &plan->bs, plan->prefix, from, to, plan->scratch);
         }
+    }
+}
 
 
-    } else {
-
-        /* Inform user that the bmp file is not big enough */
-        printf("Data is too big to hide in this picture!\nPlease choose a bigger picture!\n");
-        /* Free memory */
-        free_payload(data);
-        free(compressed);
-
-        /* BMP FILE IS NOT BIG ENOUGH - 3 */
-        return 3;
+/**
+ * This function frees the plan.
+ * 
+ * @param plan Plan
+ * 
+ * @return void
+*/
+void free_hide_plan(hide_plan *plan){
 
+    /* Sanity check */
+    if (!plan) {
+        return;
     }
 
+    bitstream_free(&plan->bs);
+    bitstream_free(&plan->cover);
+    free(plan->scratch);
+    plan->scratch = NULL;
 }
 
 
+
 /**
- * This function extracts the compressed data from the picture.
+ * This function decompresses the extracted data and writes them to the file.
  * 
- * @param width Width of the picture
- * @param height Height of the picture
- * @param row_pointers Pointer to the array of png_bytep
+ * @param compressed Extracted data (freed here)
+ * @param size Count of compressed words
+ * @param ex_ret Code of return of the extraction (SUCCESS, FAILURE, 4 - NO HIDDEN CONTENT, 5 - INVALID CRC32)
  * @param to Path to the file where the data will be written
  * 
  * @return 0 if success, 4 if no hidden content, 5 if invalid crc32, 6 if other error
 */
-int extract_from_image(int width, png_bytep **row_pointers, char *to){
+static int save_payload(word *compressed, int size, int ex_ret, char *to){
 
     /* Declaration and  of variables */
-	int size = 0, ex_ret = 0, str_size = 0;
-	word *compressed = NULL;
+	int str_size = 0;
 	byte *decompressed = NULL;
     FILE *file = NULL;
     
 
-	/* Extract the data from image */
-	compressed = extract_mechanism(row_pointers, &size, width, &ex_ret);
-
     /* Check what happened */
     switch (ex_ret) {
         case FAILURE: {
@@ -589,4 +2738,272 @@ int extract_from_image(int width, png_bytep **row_pointers, char *to){
 }
 
 
+/**
+ * This function extracts the compressed data from the picture.
+ * 
+ * @param img Image
+ * @param to Path to the file where the data will be written
+ * @param opts Options (count of threads)
+ * 
+ * @return 0 if success, 4 if no hidden content, 5 if invalid crc32, 6 if other error
+*/
+int extract_from_image(image *img, char *to, const options *opts){
+
+    /* Declaration and initialization of variables */
+	int size = 0, ex_ret = 0;
+	word *compressed = NULL;
+
+	/* Extract the data from image */
+	compressed = extract_mechanism(img, &size, &ex_ret, opts);
+
+    return save_payload(compressed, size, ex_ret, to);
+}
+
+
+
+
+
+/**
+ * This function prepares the extract from a picture which is processed by windows of rows (in order).
+ * 
+ * @param plan Plan to be filled
+ * @param width Width of the picture
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int make_extract_plan(extract_plan *plan, int width){
+
+    /* Sanity check */
+    if (!plan || width <= 0) {
+        printf("Error in make_extract_plan!\n");
+        return FAILURE;
+    }
+
+    memset(plan, 0, sizeof(extract_plan));
+
+    make_layout(&plan->blue, CHANNEL_B, 1);
+    plan->width = width;
+    plan->scratch = (byte *)malloc((size_t)width * SCRATCH_PER_PIXEL);
+
+    if (!plan->scratch || bitstream_init(&plan->head, PREFIX_PIXELS) == FAILURE) {
+        printf("Error in make_extract_plan!\n");
+        free_extract_plan(plan);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function grows the bitstream to hold at least needed bits (doubled, so it is copied O(1) times per bit).
+ * 
+ * @param bs Bitstream
+ * @param needed Count of bits which must fit
+ * @param limit Count of bits which is never exceeded
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int bitstream_grow(bitstream *bs, long needed, long limit){
+
+    /* Declaration and initialization of variables */
+    long capacity = bs->capacity * 2 > needed ? bs->capacity * 2 : needed;
+    byte *grown;
+
+    if (capacity > limit) capacity = limit;
+
+    /* One spare byte for appending at a bit offset, the new bytes are zero */
+    grown = (byte *)realloc(bs->data, (size_t)(capacity / 8 + 2));
+
+    if (!grown) {
+        return FAILURE;
+    }
+
+    memset(grown + bs->capacity / 8 + 2, 0, (size_t)(capacity / 8 - bs->capacity / 8));
+    bs->data = grown;
+    bs->capacity = capacity;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the bits of the body which fall in the window and are not read yet.
+ * The bitstream grows with the read bits, so a damaged size costs only the memory of the frames which are read.
+ * 
+ * @param plan Plan (the prefix is read)
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_body_window(extract_plan *plan, const image *win, int first_row, int rows){
+
+    /* Declaration and initialization of variables */
+    long from, to;
+
+    window_range(plan->width, &plan->lay, plan->start, plan->count, first_row, rows, &from, &to);
+
+    if (from < plan->bs.length) from = plan->bs.length;
+
+    if (from < to) {
+
+        if (to > plan->bs.capacity && bitstream_grow(&plan->bs, to, plan->count) == FAILURE) {
+            return FAILURE;
+        }
+
+        read_stream(win, &plan->lay, plan->start - (long)first_row * plan->width, from, to, &plan->bs, plan->scratch);
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the bits of the prefix and of the body which fall in the window.
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window (the windows follow each other)
+ * @param rows Count of rows of the window
+ * 
+ * @return 0 if success (done is set after the last bit of the body), 4 if no hidden content, 5 if invalid size, 6 if other error
+*/
+int plan_extract_window(extract_plan *plan, const image *win, int first_row, int rows){
+
+    /* Declaration and initialization of variables */
+    long header = sizeof(int) * 8, from, to;
+    dword watermark, config;
+
+    /* Sanity check */
+    if (!plan || !win || win->width != plan->width) {
+        printf("Error in plan_extract_window!\n");
+        return 6;
+    }
+
+    if (plan->done) {
+        return 0;
+    }
+
+    /* Watermark and config (LSB of the BLUE channel) */
+    if (plan->count == 0) {
+
+        window_range(plan->width, &plan->blue, 0, PREFIX_PIXELS, first_row, rows, &from, &to);
+
+        if (from < plan->head.length) from = plan->head.length;
+
+        if (from < to) {
+            read_stream(win, &plan->blue, -(long)first_row * plan->width, from, to, &plan->head, plan->scratch);
+        }
+
+        if (plan->head.length < PREFIX_PIXELS) {
+            return 0;
+        }
+
+        watermark = bitstream_get(&plan->head, 0, WATERMARK_SIZE);
+        config = bitstream_get(&plan->head, WATERMARK_SIZE, CONFIG_SIZE);
+
+        if (parse_config(watermark, config, &plan->lay) == FAILURE) {
+            return 4;
+        }
+
+        /* A spread body may be in any window, the groups of matrix embedding are decoded from the whole body */
+        if (plan->lay.matrix || (watermark == (dword)((WATERMARK_CONFIG[0] << 8) | WATERMARK_CONFIG[1]) && (config & CONFIG_KEYED))) {
+            printf("The content is hidden with a key or matrix embedding, it cannot be read window by window!\n");
+            return 4;
+        }
+
+        plan->start = body_start(&plan->lay);
+        plan->count = header;
+
+        if (bitstream_init(&plan->bs, header) == FAILURE) {
+            printf("Error in plan_extract_window!\n");
+            return 6;
+        }
+
+        /* The body of the original format starts in the pixels of the config (the same LSBs, maybe of an earlier window) */
+        if (plan->start < PREFIX_PIXELS) {
+            bitstream_put(&plan->bs, bitstream_get(&plan->head, plan->start, (int)(PREFIX_PIXELS - plan->start)), (int)(PREFIX_PIXELS - plan->start));
+        }
+    }
+
+    if (read_body_window(plan, win, first_row, rows) == FAILURE) {
+        printf("Error in plan_extract_window!\n");
+        return 6;
+    }
+
+    /* The size tells how long the body is, the rest of it may be in this window too */
+    if (plan->count == header && plan->bs.length == header) {
+
+        plan->size = (int)bitstream_get(&plan->bs, 0, header);
+
+        /* The size is not trusted with memory, the bitstream grows only as the bits are read */
+        if (plan->size <= 0 || plan->size > (LONG_MAX - header - CRC32_SIZE) / COMPRESSED_SIZE) {
+            return 5;
+        }
+
+        plan->count = body_bits(plan->size);
+
+        if (read_body_window(plan, win, first_row, rows) == FAILURE) {
+            printf("Error in plan_extract_window!\n");
+            return 6;
+        }
+    }
+
+    plan->done = plan->bs.length == plan->count;
+
+    return 0;
+}
+
+
+/**
+ * This function checks the read body and writes the payload to the file.
+ * 
+ * @param plan Plan (after the last window)
+ * @param to Path to the file where the data will be written
+ * 
+ * @return 0 if success, 4 if no hidden content, 5 if the body is cut or invalid crc32, 6 if other error
+*/
+int plan_extract_finish(extract_plan *plan, char *to){
+
+    /* Declaration and initialization of variables */
+    word *compressed = NULL;
+    int ex_ret = 4;
+
+    /* Sanity check */
+    if (!plan || !to) {
+        printf("Error in plan_extract_finish!\n");
+        return 6;
+    }
+
+    /* The picture ends before the prefix (no hidden content) or before the end of the body (damaged) */
+    if (plan->done) {
+        compressed = unpack_body(&plan->bs, plan->size, &ex_ret);
+    } else if (plan->count != 0) {
+        ex_ret = 5;
+    }
+
+    return save_payload(compressed, plan->size, ex_ret, to);
+}
+
+
+/**
+ * This function frees the plan.
+ * 
+ * @param plan Plan
+ * 
+ * @return void
+*/
+void free_extract_plan(extract_plan *plan){
+
+    /* Sanity check */
+    if (!plan) {
+        return;
+    }
 
+    bitstream_free(&plan->head);
+    bitstream_free(&plan->bs);
+    free(plan->scratch);
+    plan->scratch = NULL;
+}
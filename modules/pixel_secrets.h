@@ -5,6 +5,10 @@
 #define __CONVERTOR_H__
 
 #include "my_defs.h"
+#include "input.h"
+#include "image.h"
+#include "spread.h"
+#include "layout_kernels.h"
 
 
 /* Defines */
@@ -23,19 +27,249 @@
 #define WATERMARK_SIZE 16
 #define WATERMARK "hD"
 
+/* Watermark of the configurable layout (followed by the config in the BLUE LSB) */
+#define WATERMARK_CONFIG "hC"
+#define CONFIG_SIZE 16
+
+/* Pixels of the watermark and the config, the body starts after them */
+#define PREFIX_PIXELS (WATERMARK_SIZE + CONFIG_SIZE)
+
+/* Layout defines (channel mask and LSBs per channel in the config) */
+#define CHANNEL_R 0x01
+#define CHANNEL_G 0x02
+#define CHANNEL_B 0x04
+#define CHANNEL_MASK 0x07
+#define DEPTH_SHIFT 3
+#define DEPTH_MASK 0x03
+#define MAX_DEPTH 3
+
+/* Matrix embedding in the config (k bits in 2^k - 1 LSBs, 0 if not used) */
+#define MATRIX_SHIFT 5
+#define MATRIX_MASK 0x0F
+#define MIN_MATRIX 2
+#define MAX_MATRIX 8
+
+/* The body is spread over the picture by the key (--key) */
+#define CONFIG_KEYED 0x200
+
+/* The config is followed by the digest of the payload (DIGEST_SIZE bits in the BLUE LSB) */
+#define CONFIG_DIGEST 0x400
+#define DIGEST_SIZE 64
+
+/* Higher bits of the config must be zero */
+#define CONFIG_RESERVED_SHIFT 11
+
+/* Groups of matrix embedding per task (multiple of 8, so the tasks share no byte) */
+#define MATRIX_TASK_GROUPS 8192L
+
+/* Bytes of the scratch buffer per pixel of a row (three planes and the values of three channels) */
+#define SCRATCH_PER_PIXEL (2 * BYTES_PER_PIXEL)
+
+/* Bands of rows of fewer bits are not worth a thread */
+#define MIN_BAND_BITS (1L << 16)
+
+/* Pixels of one tile of the keyed spread (the tile of RGB bytes stays in the L2 cache) */
+#define SPREAD_TILE_PIXELS 16384L
+
+/* Units permuted by one task of the keyed spread */
+#define SPREAD_TASK_UNITS 65536L
+
+
+
+/* Structures */
+
+/* Bits of the hidden message, packed from the MSB of the first byte */
+typedef struct {
+
+    /* Packed bits */
+    byte *data;
+
+    /* Count of bits written */
+    long length;
+
+    /* Count of bits which fit in data */
+    long capacity;
+
+} bitstream;
+
+
+/* Where the bits are stored in the pixels */
+typedef struct {
+
+    /* Mask of the channels (CHANNEL_*) */
+    int channels;
+
+    /* Count of LSBs used in each channel */
+    int depth;
+
+    /* Count of the channels */
+    int count;
+
+    /* Byte offsets of the channels in the pixel (in R, G, B order) */
+    int offsets[BYTES_PER_PIXEL];
+
+    /* Bits stored in one pixel (count * depth) */
+    int bits_per_pixel;
+
+    /* Bits carried by one group of 2^matrix - 1 LSBs (Hamming code), 0 for plain LSBs */
+    int matrix;
+
+    /* Keyed permutation of the pixels of the body, NULL for the order of the rows */
+    const spread *spread;
+
+    /* TRUE if the digest of the payload follows the config */
+    int digest;
+
+    /* Kernel specialised for count and depth (selected by make_layout) */
+    const layout_kernel *kernel;
+
+} layout;
+
+
+/* Bits of a hide which is written window by window (the picture is never in memory as a whole) */
+typedef struct {
+
+    /* Layout of the body and of the prefix (LSB of the BLUE channel) */
+    layout lay;
+    layout blue;
+
+    /* Prefix and body */
+    bitstream bs;
+
+    /* Cover bits of the body for matrix embedding (read before the body is encoded) */
+    bitstream cover;
+
+    /* Bits of the prefix and of the body */
+    long prefix;
+    long count;
+
+    /* Size of the picture */
+    int width;
+    int height;
+
+    /* Buffer for the bits of one row */
+    byte *scratch;
+
+} hide_plan;
+
+
+/* Bits of an extract which is read window by window (the picture is never in memory as a whole) */
+typedef struct {
+
+    /* Layout of the body (known after the prefix) and of the prefix (LSB of the BLUE channel) */
+    layout lay;
+    layout blue;
+
+    /* Watermark and config */
+    bitstream head;
+
+    /* Body (only its size until the size is read) */
+    bitstream bs;
+
+    /* First pixel of the body and the bits of the body (0 until the prefix is read) */
+    long start;
+    long count;
+
+    /* Count of compressed words */
+    int size;
+
+    /* Width of the picture */
+    int width;
+
+    /* TRUE if the whole body is read */
+    int done;
+
+    /* Buffer for the bits of one row */
+    byte *scratch;
+
+} extract_plan;
+
 
 
 /* Prototypes */
 
 /**
- * This function will free the array of pointers to rows of pixels
+ * This function allocates the bitstream.
+ * 
+ * @param bs Bitstream to be initialized
+ * @param capacity Count of bits to be stored
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int bitstream_init(bitstream *bs, long capacity);
+
+
+/**
+ * This function appends the lowest count bits of value (MSB first).
+ * 
+ * @param bs Bitstream
+ * @param value Value to be written
+ * @param count Count of bits (at most 32)
+ * 
+ * @return void
+*/
+void bitstream_put(bitstream *bs, dword value, int count);
+
+
+/**
+ * This function reads count bits (MSB first) from the position.
+ * 
+ * @param bs Bitstream
+ * @param position Index of the first bit
+ * @param count Count of bits (at most 32)
+ * 
+ * @return Read value
+*/
+dword bitstream_get(const bitstream *bs, long position, int count);
+
+
+/**
+ * This function fills the layout.
+ * 
+ * @param lay Layout to be filled
+ * @param channels Mask of the channels (CHANNEL_*)
+ * @param depth Count of LSBs per channel (1 - MAX_DEPTH)
+ * 
+ * @return SUCCESS or FAILURE if the combination is invalid
+*/
+int make_layout(layout *lay, int channels, int depth);
+
+
+/**
+ * This function finds where the bit of the body is stored (closed form, no cursor is needed).
+ * 
+ * @param lay Layout of the bits
+ * @param width Width of the picture
+ * @param start Index of the first pixel of the body (row by row)
+ * @param bit Index of the bit in the body
+ * @param row Row of the pixel
+ * @param col Column of the pixel
+ * @param slot Index of the bit in the pixel (0 - bits_per_pixel - 1)
+ * 
+ * @return void
+*/
+void locate_bit(const layout *lay, int width, long start, long bit, int *row, int *col, int *slot);
+
+
+/**
+ * This function turns on matrix embedding of the layout.
+ * 
+ * @param lay Layout (one LSB per channel)
+ * @param k Bits carried by one group of 2^k - 1 LSBs (0 turns it off)
+ * 
+ * @return SUCCESS or FAILURE if the combination is invalid
+*/
+int set_matrix(layout *lay, int k);
+
+
+/**
+ * This function frees the data of the bitstream.
  * 
- * @param row_pointers Array of pointers to rows of pixels
- * @param row_count Number of rows
+ * @param bs Bitstream
  * 
  * @return void
 */
-void free_row_pointers(png_bytep *row_pointers, int row_count);
+void bitstream_free(bitstream *bs);
 
 
 /**
@@ -53,23 +287,153 @@ dword crc32b(word *message, int length);
 /**
  * This function will hide the data in the image. (PNG or BMP)
  * 
- * @param width The width of the image
- * @param height The height of the image
- * @param row_pointers Array of pointers to rows of pixels
+ * @param img The image
+ * @param payload_path Path to the file to be hidden
+ * @param opts Options (layout of the bits)
+ * @return 0 if success, 1 if the payload cannot be read, 3 if bmp file is not big enough, 6 if other error
+ */
+int hide_in_image(image *img, char *payload_path, const options *opts);
+
+
+/**
+ * This function prepares the hide of the payload in a picture which is processed by windows of rows.
+ * 
+ * @param plan Plan to be filled
+ * @param payload_path Path to the file to be hidden
+ * @param opts Options (layout of the bits, the key is not supported)
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * @return 0 if success, 1 if the payload cannot be read, 3 if picture is not big enough, 6 if other error
+ */
+int make_hide_plan(hide_plan *plan, char *payload_path, const options *opts, int width, int height);
+
+
+/**
+ * This function returns the count of the first rows touched by the plan.
+ * 
+ * @param plan Plan
+ * @return Count of rows
+ */
+int plan_rows(const hide_plan *plan);
+
+
+/**
+ * This function reads the cover bits of the body from the window (matrix embedding only, windows in order).
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * @return void
+ */
+void plan_read_window(hide_plan *plan, const image *win, int first_row, int rows);
+
+
+/**
+ * This function encodes the body into the cover bits (after every window was read by plan_read_window).
+ * 
+ * @param plan Plan
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * @return SUCCESS or FAILURE
+ */
+int plan_encode(hide_plan *plan, int threads);
+
+
+/**
+ * This function writes the bits of the prefix and of the body which fall in the window.
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window
+ * @param rows Count of rows of the window
+ * @return void
+ */
+void plan_write_window(const hide_plan *plan, image *win, int first_row, int rows);
+
+
+/**
+ * This function frees the plan.
+ * 
+ * @param plan Plan
+ * @return void
+ */
+void free_hide_plan(hide_plan *plan);
+
+
+/**
+ * This function prepares the extract from a picture which is processed by windows of rows (in order).
+ * 
+ * @param plan Plan to be filled
+ * @param width Width of the picture
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int make_extract_plan(extract_plan *plan, int width);
+
+
+/**
+ * This function reads the bits of the prefix and of the body which fall in the window.
+ * 
+ * @param plan Plan
+ * @param win Rows of the window (the first one is row first_row of the picture)
+ * @param first_row First row of the window (the windows follow each other)
+ * @param rows Count of rows of the window
+ * 
+ * @return 0 if success (done is set after the last bit of the body), 4 if no hidden content, 5 if invalid size, 6 if other error
+*/
+int plan_extract_window(extract_plan *plan, const image *win, int first_row, int rows);
+
+
+/**
+ * This function checks the read body and writes the payload to the file.
+ * 
+ * @param plan Plan (after the last window)
+ * @param to Path to the file where the data will be written
+ * 
+ * @return 0 if success, 4 if no hidden content, 5 if the body is cut or invalid crc32, 6 if other error
+*/
+int plan_extract_finish(extract_plan *plan, char *to);
+
+
+/**
+ * This function frees the plan.
+ * 
+ * @param plan Plan
+ * 
+ * @return void
+*/
+void free_extract_plan(extract_plan *plan);
+
+
+/**
+ * This function checks if the picture already holds the payload (digest in the header).
+ * Only the pixels of the header are read, so only the first rows must be decoded.
+ * 
+ * @param img The image (only the rows of the header are loaded)
  * @param payload_path Path to the file to be hidden
- * @return 0 if success, 3 if bmp file is not big enough, 6 if other error
+ * @param opts Options (key and the layout of the bits)
+ * @return TRUE if the same payload is hidden with the requested layout, otherwise FALSE
+ */
+int payload_hidden(image *img, char *payload_path, const options *opts);
+
+
+/**
+ * This function returns the count of rows holding the header with the digest.
+ * 
+ * @param width Width of the picture
+ * @return Count of rows
  */
-int hide_in_image(int width, int height, png_bytep **row_pointers, char *payload_path);
+int digest_rows(int width);
 
 
 /**
  * This function will extract the data from the image. (PNG or BMP)
  * 
- * @param width The width of the image
- * @param row_pointers Array of pointers to rows of pixels
+ * @param img The image
  * @param to Path to the file to be extracted
+ * @param opts Options (count of threads)
  * @return 0 if success, 4 if no hidden content, 5 if invalid crc32, 6 if other error
  */
-int extract_from_image(int width, png_bytep **row_pointers, char *to);
+int extract_from_image(image *img, char *to, const options *opts);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,721 @@
+/* PNG_DEFLATE.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include <zlib.h>
+#include "png_deflate.h"
+#include "png_lib.h"
+#include "parallel.h"
+#include "file_map.h"
+
+
+/* Work shared by the tasks of the encoder */
+typedef struct {
+
+    /* Image and the bytes of one filtered row (the filter type and the pixels) */
+    const image *img;
+    long row_bytes;
+
+    /* Filters which may be used (PNG_FILTER_*), zlib level, strategy and memory level */
+    int filters;
+    int level;
+    int strategy;
+    int mem_level;
+
+    /* Rows of one group and count of groups */
+    int group_rows;
+    int groups;
+
+    /* TRUE if the groups are segments (no dictionary, the first row does not use the row above) */
+    int segmented;
+
+    /* Groups of the tasks (NULL if every group is a task) */
+    int *touched;
+
+    /* Filtered rows of the whole image */
+    byte *filtered;
+
+    /* Deflated groups, their sizes (-1 if the task failed) and the Adler-32 of their filtered rows */
+    byte **out;
+    long *out_size;
+    uLong *adler;
+
+} deflate_work;
+
+
+
+/**
+ * This function returns the predictor of the Paeth filter.
+ *
+ * @param a Byte on the left
+ * @param b Byte above
+ * @param c Byte above on the left
+ *
+ * @return Predicted byte
+*/
+static int paeth(int a, int b, int c){
+
+    /* Declaration and initialization of variables */
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+
+    return c;
+}
+
+
+/**
+ * This function filters one row by the filter.
+ *
+ * @param dst Filtered row (the filter type and the bytes)
+ * @param row Bytes of the row
+ * @param prev Bytes of the row above (NULL for the first row)
+ * @param n Count of bytes of the row
+ * @param type Filter type (PNG_FILTER_VALUE_*)
+ *
+ * @return Sum of the absolute values of the filtered bytes (taken as signed)
+*/
+static long filter_row(byte *dst, const byte *row, const byte *prev, long n, int type){
+
+    /* Declaration and initialization of variables */
+    long i, sum = 0;
+    int a, b, c, v;
+
+    dst[0] = (byte)type;
+
+    for (i = 0; i < n; i++) {
+
+        a = i >= PNG_PIXEL_BYTES ? row[i - PNG_PIXEL_BYTES] : 0;
+        b = prev ? prev[i] : 0;
+        c = prev && i >= PNG_PIXEL_BYTES ? prev[i - PNG_PIXEL_BYTES] : 0;
+
+        switch (type) {
+            case PNG_FILTER_VALUE_SUB: v = row[i] - a; break;
+            case PNG_FILTER_VALUE_UP: v = row[i] - b; break;
+            case PNG_FILTER_VALUE_AVG: v = row[i] - ((a + b) >> 1); break;
+            case PNG_FILTER_VALUE_PAETH: v = row[i] - paeth(a, b, c); break;
+            default: v = row[i];
+        }
+
+        dst[i + 1] = (byte)v;
+        sum += abs((signed char)(byte)v);
+    }
+
+    return sum;
+}
+
+
+/**
+ * This function returns the count of bytes of the filtered rows of the group.
+ *
+ * @param w Work of the encoder
+ * @param group Index of the group
+ *
+ * @return Count of bytes
+*/
+static long group_bytes(const deflate_work *w, int group){
+
+    /* Declaration and initialization of variables */
+    int rows = w->img->height - group * w->group_rows;
+
+    return (long)(rows < w->group_rows ? rows : w->group_rows) * w->row_bytes;
+}
+
+
+/**
+ * This function filters the rows of one group (task of parallel_for).
+ * With more filters allowed, every one is tried and the smallest sum is kept (the heuristic of libpng).
+ * The first row of a segment uses only None or Sub, so the segment does not depend on the one above.
+ *
+ * @param arg Pointer to the deflate_work
+ * @param index Index of the task
+ *
+ * @return void
+*/
+static void filter_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    deflate_work *w = (deflate_work *)arg;
+    static const int masks[PNG_FILTER_VALUE_LAST] = {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH};
+    long n = (long)w->img->width * PNG_PIXEL_BYTES, sum, best;
+    int y, type, filters, group = w->touched ? w->touched[index] : index;
+    int first = group * w->group_rows, last = first + w->group_rows;
+    byte *dst, *scratch = NULL;
+    const byte *prev;
+
+    if (last > w->img->height) last = w->img->height;
+
+    /* Candidates of the other filters (the best one is kept in the output) */
+    scratch = (byte *)malloc((size_t)w->row_bytes);
+
+    for (y = first; y < last; y++) {
+
+        dst = w->filtered + (long)y * w->row_bytes;
+        prev = y > 0 ? IMAGE_ROW(w->img, y - 1) : NULL;
+        best = -1;
+
+        filters = w->filters;
+
+        if (w->segmented && y == first) {
+            filters &= PNG_FILTER_NONE | PNG_FILTER_SUB;
+            if (!filters) filters = PNG_FILTER_NONE;
+        }
+
+        for (type = 0; type < PNG_FILTER_VALUE_LAST; type++) {
+
+            if (!(filters & masks[type])) continue;
+
+            /* The first allowed filter goes to the output, the others only if they are better */
+            if (best < 0) {
+
+                best = filter_row(dst, IMAGE_ROW(w->img, y), prev, n, type);
+
+            } else if (scratch && (sum = filter_row(scratch, IMAGE_ROW(w->img, y), prev, n, type)) < best) {
+
+                memcpy(dst, scratch, (size_t)w->row_bytes);
+                best = sum;
+            }
+        }
+    }
+
+    free(scratch);
+}
+
+
+/**
+ * This function deflates the filtered rows of one group (task of parallel_for).
+ * The end of the previous group is the dictionary, every group but the last ends by a sync flush.
+ * A segment has no dictionary and ends by a full flush, so it can be deflated again on its own.
+ *
+ * @param arg Pointer to the deflate_work
+ * @param index Index of the task
+ *
+ * @return void
+*/
+static void deflate_task(void *arg, int index){
+
+    /* Declaration and initialization of variables */
+    deflate_work *w = (deflate_work *)arg;
+    int group = w->touched ? w->touched[index] : index, last = group == w->groups - 1, ret;
+    long first = (long)group * w->group_rows * w->row_bytes, size = group_bytes(w, group), dictionary;
+    byte *data = w->filtered + first;
+    uLong bound;
+    z_stream z;
+
+    w->out_size[group] = -1;
+    w->adler[group] = adler32(adler32(0L, Z_NULL, 0), data, (uInt)size);
+
+    memset(&z, 0, sizeof(z_stream));
+
+    /* Raw deflate, the zlib header and the Adler-32 are written once for the whole stream */
+    if (deflateInit2(&z, w->level, Z_DEFLATED, -15, w->mem_level, w->strategy) != Z_OK) {
+        return;
+    }
+
+    dictionary = w->segmented ? 0 : first < PNG_WINDOW_BYTES ? first : PNG_WINDOW_BYTES;
+
+    if (dictionary > 0 && deflateSetDictionary(&z, data - dictionary, (uInt)dictionary) != Z_OK) {
+        deflateEnd(&z);
+        return;
+    }
+
+    /* The flush adds an empty stored block */
+    bound = deflateBound(&z, (uLong)size) + 64;
+    w->out[group] = (byte *)malloc(bound);
+
+    if (!w->out[group]) {
+        deflateEnd(&z);
+        return;
+    }
+
+    z.next_in = data;
+    z.avail_in = (uInt)size;
+    z.next_out = w->out[group];
+    z.avail_out = (uInt)bound;
+
+    ret = deflate(&z, last ? Z_FINISH : w->segmented ? Z_FULL_FLUSH : Z_SYNC_FLUSH);
+
+    if (last ? ret == Z_STREAM_END : (ret == Z_OK && z.avail_in == 0 && z.avail_out > 0)) {
+        w->out_size[group] = (long)(bound - z.avail_out);
+    }
+
+    deflateEnd(&z);
+}
+
+
+/**
+ * This function prepares the work of the encoder (the defaults of libpng for 8-bit RGB).
+ *
+ * @param w Work to be filled
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param group_rows Rows of one group
+ * @param segmented TRUE if the groups are segments
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int init_work(deflate_work *w, const image *img, int profile, int group_rows, int segmented){
+
+    /* Declaration and initialization of variables */
+    const png_profile *p = get_png_profile(profile);
+
+    memset(w, 0, sizeof(deflate_work));
+    w->img = img;
+    w->row_bytes = 1 + (long)img->width * PNG_PIXEL_BYTES;
+    w->filters = p->filters >= 0 ? p->filters : PNG_ALL_FILTERS;
+    w->level = p->level >= 0 ? p->level : Z_DEFAULT_COMPRESSION;
+    w->strategy = p->strategy >= 0 ? p->strategy : Z_FILTERED;
+    w->mem_level = p->mem_level >= 0 ? p->mem_level : 8;
+    w->group_rows = group_rows < 1 ? 1 : group_rows;
+    w->groups = (img->height + w->group_rows - 1) / w->group_rows;
+    w->segmented = segmented;
+
+    w->filtered = (byte *)malloc((size_t)img->height * w->row_bytes);
+    w->out = (byte **)calloc(w->groups, sizeof(byte *));
+    w->out_size = (long *)malloc(sizeof(long) * w->groups);
+    w->adler = (uLong *)malloc(sizeof(uLong) * w->groups);
+
+    if (!w->filtered || !w->out || !w->out_size || !w->adler) {
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function frees the work of the encoder.
+ *
+ * @param w Work
+ *
+ * @return void
+*/
+static void free_work(deflate_work *w){
+
+    /* Declaration of variables */
+    int i;
+
+    for (i = 0; w->out && i < w->groups; i++) {
+        free(w->out[i]);
+    }
+
+    free(w->filtered);
+    free(w->out);
+    free(w->out_size);
+    free(w->adler);
+    free(w->touched);
+}
+
+
+/**
+ * This function filters and deflates the groups of the tasks.
+ * Every group is filtered before any is deflated (the end of the previous group is the dictionary).
+ *
+ * @param w Work
+ * @param tasks Count of tasks (groups in w->touched, or every group)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int encode_groups(deflate_work *w, int tasks, int threads){
+
+    /* Declaration of variables */
+    int i;
+
+    if (tasks == 0) {
+        return SUCCESS;
+    }
+
+    if (parallel_for(threads, tasks, filter_task, w) == FAILURE || parallel_for(threads, tasks, deflate_task, w) == FAILURE) {
+        return FAILURE;
+    }
+
+    for (i = 0; i < tasks; i++) {
+
+        if (w->out_size[w->touched ? w->touched[i] : i] < 0) {
+            return FAILURE;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function writes one chunk made of up to three parts of data.
+ *
+ * @param fp Opened file
+ * @param type Type of the chunk (4 letters)
+ * @param head First part (NULL if none)
+ * @param head_size Size of the first part
+ * @param data Second part (NULL if none)
+ * @param size Size of the second part
+ * @param tail Third part (NULL if none)
+ * @param tail_size Size of the third part
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int write_chunk(FILE *fp, const char *type, const byte *head, long head_size, const byte *data, long size, const byte *tail, long tail_size){
+
+    /* Declaration and initialization of variables */
+    uLong crc = crc32(0L, (const Bytef *)type, 4);
+    byte length[4], check[4];
+
+    png_save_uint_32(length, (png_uint_32)(head_size + size + tail_size));
+
+    if (head_size > 0) crc = crc32(crc, head, (uInt)head_size);
+    if (size > 0) crc = crc32(crc, data, (uInt)size);
+    if (tail_size > 0) crc = crc32(crc, tail, (uInt)tail_size);
+
+    png_save_uint_32(check, (png_uint_32)crc);
+
+    if (fwrite(length, 1, 4, fp) != 4 || fwrite(type, 1, 4, fp) != 4
+        || (head_size > 0 && fwrite(head, 1, (size_t)head_size, fp) != (size_t)head_size)
+        || (size > 0 && fwrite(data, 1, (size_t)size, fp) != (size_t)size)
+        || (tail_size > 0 && fwrite(tail, 1, (size_t)tail_size, fp) != (size_t)tail_size)
+        || fwrite(check, 1, 4, fp) != 4) {
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function writes the PNG file from the deflated groups (one IDAT per group).
+ * The segments are recorded in the SEGMENTS_CHUNK before the first IDAT.
+ *
+ * @param filename Name of the file
+ * @param w Work with every group deflated
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int write_groups(const char *filename, const deflate_work *w){
+
+    /* Declaration and initialization of variables */
+    static const byte signature[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+    byte ihdr[13], header[2], trailer[4], *table = NULL;
+    uLong adler = w->adler[0];
+    int i, ret = SUCCESS;
+    FILE *fp;
+
+    /* The Adler-32 of the whole stream is combined from the groups */
+    for (i = 1; i < w->groups; i++) {
+        adler = adler32_combine(adler, w->adler[i], (z_off_t)group_bytes(w, i));
+    }
+
+    /* zlib header of a 32K window (the level only informs) */
+    header[0] = 0x78;
+    header[1] = (byte)((w->level == 1 ? 0 : w->level >= 2 && w->level <= 5 ? 1 : w->level >= 7 ? 3 : 2) << 6);
+    header[1] = (byte)(header[1] + 31 - (header[0] * 256 + header[1]) % 31);
+    png_save_uint_32(trailer, (png_uint_32)adler);
+
+    png_save_uint_32(ihdr, (png_uint_32)w->img->width);
+    png_save_uint_32(ihdr + 4, (png_uint_32)w->img->height);
+    ihdr[8] = 8;
+    ihdr[9] = PNG_COLOR_TYPE_RGB;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+
+    /* Rows of a segment, count of segments, then the size and the Adler-32 of every segment */
+    if (w->segmented) {
+
+        table = (byte *)malloc(8 + 8 * (size_t)w->groups);
+
+        if (!table) {
+            return FAILURE;
+        }
+
+        png_save_uint_32(table, (png_uint_32)w->group_rows);
+        png_save_uint_32(table + 4, (png_uint_32)w->groups);
+
+        for (i = 0; i < w->groups; i++) {
+            png_save_uint_32(table + 8 + 8 * i, (png_uint_32)w->out_size[i]);
+            png_save_uint_32(table + 12 + 8 * i, (png_uint_32)w->adler[i]);
+        }
+    }
+
+    fp = fopen(filename, "wb");
+
+    if (!fp) {
+        free(table);
+        return FAILURE;
+    }
+
+    if (fwrite(signature, 1, 8, fp) != 8 || write_chunk(fp, "IHDR", NULL, 0, ihdr, 13, NULL, 0) == FAILURE
+        || (table && write_chunk(fp, SEGMENTS_CHUNK, NULL, 0, table, 8 + 8L * w->groups, NULL, 0) == FAILURE)) {
+        ret = FAILURE;
+    }
+
+    /* The header goes before the first group and the Adler-32 after the last one */
+    for (i = 0; ret == SUCCESS && i < w->groups; i++) {
+
+        ret = write_chunk(fp, "IDAT", header, i == 0 ? 2 : 0, w->out[i], w->out_size[i], trailer, i == w->groups - 1 ? 4 : 0);
+    }
+
+    if (ret == SUCCESS) {
+        ret = write_chunk(fp, "IEND", NULL, 0, NULL, 0, NULL, 0);
+    }
+
+    if (fclose(fp) != 0) ret = FAILURE;
+
+    free(table);
+
+    return ret;
+}
+
+
+/**
+ * This function writes the image as a 24-bit PNG file with the rows filtered and deflated by groups in parallel.
+ * The groups are joined by sync flush points into one zlib stream (the Adler-32 is combined from the groups).
+ * With segment_rows, the groups are segments of the rows with full flush points, recorded in the SEGMENTS_CHUNK.
+ *
+ * @param filename Name of the file
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * @param segment_rows Rows of one segment (0 for groups of PNG_GROUP_BYTES without segments)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int write_png_parallel(char *filename, image *img, int profile, int threads, int segment_rows){
+
+    /* Declaration and initialization of variables */
+    int ret = SUCCESS;
+    deflate_work w;
+
+    /* Sanity check */
+    if (!filename || !img || img->width <= 0 || img->height <= 0) {
+        printf("Error in write_png_parallel!\n");
+        return FAILURE;
+    }
+
+    if (init_work(&w, img, profile, segment_rows > 0 ? segment_rows : (int)(PNG_GROUP_BYTES / (1 + (long)img->width * PNG_PIXEL_BYTES)), segment_rows > 0) == FAILURE
+        || encode_groups(&w, w.groups, threads) == FAILURE || write_groups(filename, &w) == FAILURE) {
+        ret = FAILURE;
+    }
+
+    free_work(&w);
+
+    if (ret == FAILURE) {
+        printf("Error in write_png_parallel!\n");
+    }
+
+    return ret;
+}
+
+
+/**
+ * This function reads the header of the chunk at the position of the mapped file.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param p Position of the chunk (moved after its data and CRC)
+ * @param length Length of the data of the chunk
+ * @param type Type of the chunk (4 letters and the terminator)
+ *
+ * @return SUCCESS or FAILURE (also if the chunk does not end in the file)
+*/
+static int read_chunk_head(const byte *data, long size, long *p, long *length, char *type){
+
+    if (size - *p < 12) {
+        return FAILURE;
+    }
+
+    *length = (long)png_get_uint_32(data + *p);
+    memcpy(type, data + *p + 4, 4);
+    type[4] = '\0';
+
+    if (*length > PNG_UINT_31_MAX || *length > size - *p - 12) {
+        return FAILURE;
+    }
+
+    *p += 12 + *length;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the segments of a PNG file written by write_png_parallel (nothing is printed if there are none).
+ * The table comes from the SEGMENTS_CHUNK seen by libpng, the IDAT chunks are found in the mapped file (it is not read again).
+ * The file must be exactly the signature, IHDR, SEGMENTS_CHUNK, one IDAT per segment and IEND.
+ *
+ * @param data Bytes of the mapped file
+ * @param size Count of the bytes
+ * @param table Data of the SEGMENTS_CHUNK (its CRC is checked by libpng)
+ * @param length Length of the table
+ * @param seg Segments to be filled
+ *
+ * @return SUCCESS or FAILURE if the file has no valid segments
+*/
+int load_png_segments(const byte *data, long size, const byte *table, long length, png_segments *seg){
+
+    /* Declaration and initialization of variables */
+    static const byte signature[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+    const byte *ihdr = data + 16;
+    char type[5];
+    long p = 8, chunk, expected;
+    int i, height;
+
+    memset(seg, 0, sizeof(png_segments));
+
+    /* Sanity check */
+    if (!data || !table || length < 8 || (length - 8) % 8 != 0) {
+        return FAILURE;
+    }
+
+    /* Signature and IHDR of an 8-bit RGB picture, the table right after it */
+    if (size < 8 || memcmp(data, signature, 8) != 0
+        || read_chunk_head(data, size, &p, &chunk, type) == FAILURE || strcmp(type, "IHDR") != 0 || chunk != 13
+        || ihdr[8] != 8 || ihdr[9] != PNG_COLOR_TYPE_RGB || ihdr[12] != PNG_INTERLACE_NONE
+        || read_chunk_head(data, size, &p, &chunk, type) == FAILURE || strcmp(type, SEGMENTS_CHUNK) != 0 || chunk != length) {
+        return FAILURE;
+    }
+
+    height = (int)png_get_uint_32(ihdr + 4);
+    seg->rows = (int)png_get_uint_32(table);
+    seg->count = (int)png_get_uint_32(table + 4);
+
+    if (seg->rows < 1 || seg->rows > MAX_SEGMENT_ROWS || seg->count != (length - 8) / 8
+        || seg->count != (height + seg->rows - 1) / seg->rows) {
+        seg->count = 0;
+        return FAILURE;
+    }
+
+    seg->offset = (long *)malloc(sizeof(long) * seg->count);
+    seg->size = (long *)malloc(sizeof(long) * seg->count);
+    seg->adler = (dword *)malloc(sizeof(dword) * seg->count);
+
+    if (!seg->offset || !seg->size || !seg->adler) {
+        free_png_segments(seg);
+        return FAILURE;
+    }
+
+    /* One IDAT per segment (the zlib header before the first one, the Adler-32 after the last one) */
+    for (i = 0; i < seg->count; i++) {
+
+        seg->size[i] = (long)png_get_uint_32(table + 8 + 8 * i);
+        seg->adler[i] = (dword)png_get_uint_32(table + 12 + 8 * i);
+        expected = seg->size[i] + (i == 0 ? 2 : 0) + (i == seg->count - 1 ? 4 : 0);
+        seg->offset[i] = p + 8 + (i == 0 ? 2 : 0);
+
+        if (read_chunk_head(data, size, &p, &chunk, type) == FAILURE || strcmp(type, "IDAT") != 0 || chunk != expected) {
+            free_png_segments(seg);
+            return FAILURE;
+        }
+    }
+
+    if (read_chunk_head(data, size, &p, &chunk, type) == FAILURE || strcmp(type, "IEND") != 0) {
+        free_png_segments(seg);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function writes the image by the segments of the source file.
+ * Only the segments with a changed row (img->dirty) are filtered and deflated again, the rest is copied.
+ *
+ * @param from Path to the source file
+ * @param to Path to the written file (may be the source)
+ * @param img Image (the changed rows are tracked)
+ * @param seg Segments of the source file
+ * @param profile Encoding profile of the changed segments (PNG_PROFILE_*)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int rewrite_png_segments(char *from, char *to, image *img, const png_segments *seg, int profile, int threads){
+
+    /* Declaration and initialization of variables */
+    int i, y, tasks = 0, ret = SUCCESS;
+    char *part = NULL;
+    deflate_work w;
+    FILE *fp = NULL;
+
+    /* Sanity check */
+    if (!from || !to || !img || !seg) {
+        printf("Error in rewrite_png_segments!\n");
+        return FAILURE;
+    }
+
+    if (init_work(&w, img, profile, seg->rows, TRUE) == FAILURE || w.groups != seg->count
+        || !(w.touched = (int *)malloc(sizeof(int) * w.groups)) || !(fp = fopen(from, "rb"))) {
+        ret = FAILURE;
+    }
+
+    /* The segments with a changed row are encoded, the others are copied byte for byte */
+    for (i = 0; ret == SUCCESS && i < w.groups; i++) {
+
+        for (y = i * w.group_rows; y < img->height && y < (i + 1) * w.group_rows; y++) {
+            if (!img->dirty || img->dirty[y]) break;
+        }
+
+        if (y < img->height && y < (i + 1) * w.group_rows) {
+            w.touched[tasks++] = i;
+            continue;
+        }
+
+        w.out[i] = (byte *)malloc((size_t)(seg->size[i] > 0 ? seg->size[i] : 1));
+        w.out_size[i] = seg->size[i];
+        w.adler[i] = seg->adler[i];
+
+        if (!w.out[i] || fseek(fp, seg->offset[i], SEEK_SET) != 0 || fread(w.out[i], 1, (size_t)seg->size[i], fp) != (size_t)seg->size[i]) {
+            ret = FAILURE;
+        }
+    }
+
+    if (fp) fclose(fp);
+
+    /* The file is written aside, the source is read until then */
+    if (ret == SUCCESS && (encode_groups(&w, tasks, threads) == FAILURE || !(part = part_path(to)) || write_groups(part, &w) == FAILURE)) {
+
+        if (part) remove(part);
+        ret = FAILURE;
+    }
+
+    if (ret == SUCCESS) {
+
+        ret = replace_file(part, to);
+
+        if (ret == SUCCESS) {
+            printf("Segments: %d of %d deflated again\n", tasks, w.groups);
+        }
+    }
+
+    free(part);
+    free_work(&w);
+
+    if (ret == FAILURE) {
+        printf("Error in rewrite_png_segments!\n");
+    }
+
+    return ret;
+}
+
+
+/**
+ * This function frees the segments.
+ *
+ * @param seg Segments
+ *
+ * @return void
+*/
+void free_png_segments(png_segments *seg){
+
+    free(seg->offset);
+    free(seg->size);
+    free(seg->adler);
+
+    seg->offset = NULL;
+    seg->size = NULL;
+    seg->adler = NULL;
+    seg->count = 0;
+}
@@ -0,0 +1,105 @@
+/* PNG_DEFLATE.H */
+
+/* Inclusion guard */
+#ifndef __PNG_DEFLATE_H__
+#define __PNG_DEFLATE_H__
+
+#include "my_defs.h"
+#include "image.h"
+
+
+/* Defines */
+
+/* Bytes of filtered rows deflated by one task (the rows of a group are never split) */
+#define PNG_GROUP_BYTES (1L << 20)
+
+/* Window of deflate, the end of the previous group is the dictionary of the next one */
+#define PNG_WINDOW_BYTES 32768L
+
+/* Bytes of one RGB pixel (the distance of the Sub, Average and Paeth filters) */
+#define PNG_PIXEL_BYTES 3
+
+/* Private chunk with the segments (ancillary, not safe to copy, so editors drop it with the pixels) */
+#define SEGMENTS_CHUNK "stSG"
+
+/* Rows of one segment (--png-segments <rows>) */
+#define MAX_SEGMENT_ROWS 65536
+
+
+/* Structures */
+
+/* Segments of a PNG file written with full flush points (every segment is deflated on its own) */
+typedef struct {
+
+    /* Rows of one segment (the last one may be shorter) and count of segments */
+    int rows;
+    int count;
+
+    /* Offsets of the deflated segments in the file, their sizes and the Adler-32 of their filtered rows */
+    long *offset;
+    long *size;
+    dword *adler;
+
+} png_segments;
+
+
+/* Prototypes */
+
+/**
+ * This function writes the image as a 24-bit PNG file with the rows filtered and deflated by groups in parallel.
+ * The groups are joined by sync flush points into one zlib stream (the Adler-32 is combined from the groups).
+ * With segment_rows, the groups are segments of the rows with full flush points, recorded in the SEGMENTS_CHUNK.
+ *
+ * @param filename Name of the file
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ * @param segment_rows Rows of one segment (0 for groups of PNG_GROUP_BYTES without segments)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int write_png_parallel(char *filename, image *img, int profile, int threads, int segment_rows);
+
+
+/**
+ * This function reads the segments of a PNG file written by write_png_parallel (nothing is printed if there are none).
+ * The table comes from the SEGMENTS_CHUNK seen by libpng, the IDAT chunks are found in the mapped file (it is not read again).
+ *
+ * @param data Bytes of the mapped file
+ * @param size Count of the bytes
+ * @param table Data of the SEGMENTS_CHUNK (its CRC is checked by libpng)
+ * @param length Length of the table
+ * @param seg Segments to be filled
+ *
+ * @return SUCCESS or FAILURE if the file has no valid segments
+*/
+int load_png_segments(const byte *data, long size, const byte *table, long length, png_segments *seg);
+
+
+/**
+ * This function writes the image by the segments of the source file.
+ * Only the segments with a changed row (img->dirty) are filtered and deflated again, the rest is copied.
+ *
+ * @param from Path to the source file
+ * @param to Path to the written file (may be the source)
+ * @param img Image (the changed rows are tracked)
+ * @param seg Segments of the source file
+ * @param profile Encoding profile of the changed segments (PNG_PROFILE_*)
+ * @param threads Count of threads (THREADS_AUTO for every CPU)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int rewrite_png_segments(char *from, char *to, image *img, const png_segments *seg, int profile, int threads);
+
+
+/**
+ * This function frees the segments.
+ *
+ * @param seg Segments
+ *
+ * @return void
+*/
+void free_png_segments(png_segments *seg);
+
+
+#endif
@@ -5,51 +5,249 @@
 #include <string.h>
 #include <stdint.h>
 #include <png.h>
+#include <zlib.h>
 #include "png_lib.h"
 #include "pixel_secrets.h"
+#include "file_map.h"
+#include "png_deflate.h"
+
+
+
+/* Profiles in the order of the PNG_PROFILE_* defines */
+static const png_profile profiles[PNG_PROFILE_COUNT] = {
+
+    /* libpng chooses */
+    {"default", -1, -1, -1, -1},
+
+    /* One cheap filter and runs of bytes only */
+    {"fastest", 1, PNG_FILTER_SUB, Z_RLE, -1},
+
+    /* One filter, a low level */
+    {"fast", 3, PNG_FILTER_UP, Z_FILTERED, -1},
+
+    /* Every filter tried on every row, the highest level and the most memory of zlib */
+    {"smallest", 9, PNG_ALL_FILTERS, Z_DEFAULT_STRATEGY, 9}
+
+};
+
+
+
+
+/* Bytes written by libpng, the file is written from them at once */
+typedef struct {
+
+    /* Written bytes, their count and the allocated size */
+    byte *data;
+    long size;
+    long capacity;
+
+} png_sink;
 
 
 
 /**
- * This function read the PNG file and store the data in the row_pointers.
+ * This function makes the opened file the source of read_png.
  * 
- * @param filename Name of the file
- * @param width Pointer to the width
- * @param height Pointer to the height
- * @param row_pointers Pointer to the array of png_bytep
- * @param png Pointer to the png_structp
- * @param info Pointer to the png_infop
+ * @param src Source to be filled
+ * @param fp Opened file (owned by the source from now on)
+ * @param map TRUE to map the file if it can be (libpng then copies from the pages), FALSE to read it by stdio
+ * 
+ * @return void
+*/
+void png_file_source(png_source *src, FILE *fp, int map) {
+
+    memset(src, 0, sizeof(png_source));
+    src->fp = fp;
+
+    /* A pipe or an empty file is read by stdio */
+    if (map && map_stream(&src->map, fp) == SUCCESS) {
+        src->data = src->map.data;
+        src->size = src->map.size;
+    }
+}
+
+
+/**
+ * This function makes the buffer of the caller the source of read_png (nothing is copied before libpng reads).
+ * 
+ * @param src Source to be filled
+ * @param data Bytes of the PNG (kept by the caller until the source is closed)
+ * @param size Count of the bytes
+ * 
+ * @return void
+*/
+void png_buffer_source(png_source *src, const byte *data, long size) {
+
+    memset(src, 0, sizeof(png_source));
+    src->data = data;
+    src->size = size;
+}
+
+
+/**
+ * This function closes the source (the file is unmapped and closed).
+ * 
+ * @param src Source
+ * 
+ * @return void
+*/
+void close_png_source(png_source *src) {
+
+    unmap_file(&src->map);
+
+    if (src->fp) {
+        fclose(src->fp);
+    }
+
+    memset(src, 0, sizeof(png_source));
+}
+
+
+/**
+ * This function moves the source back to its first byte.
+ * 
+ * @param src Source
  * 
  * @return SUCCESS or FAILURE
 */
-int read_png(char *filename, int *width, int *height, png_bytep **row_pointers, png_structp *png, png_infop *info) {
-    
-    /* Declaration of variables */
-    FILE *fp;
-    int y;
+static int rewind_png_source(png_source *src) {
 
-    /* Sanity check */
-    if (!filename || !width || !height || !row_pointers || !png || !info) {
-        printf("Error in read_png!\n");
-        return FAILURE;
+    if (src->data) {
+        src->position = 0;
+        return SUCCESS;
     }
 
-    /* Open the file */
-    fp = fopen(filename, "rb");
+    return fseek(src->fp, 0, SEEK_SET) == 0 ? SUCCESS : FAILURE;
+}
 
-    /* Check if the file was opened */
-    if (!fp) {
-        printf("Error in read_png!\n");
-        return FAILURE;
+
+/**
+ * This function gives the next bytes of the source to libpng (the read callback).
+ * 
+ * @param png The png_structp (the io pointer is the png_source)
+ * @param out Buffer of libpng
+ * @param length Count of bytes
+ * 
+ * @return void
+*/
+static void read_source(png_structp png, png_bytep out, png_size_t length) {
+
+    /* Declaration and initialization of variables */
+    png_source *src = (png_source *)png_get_io_ptr(png);
+
+    if (!src->data) {
+
+        if (fread(out, 1, length, src->fp) != length) {
+            png_error(png, "Read error");
+        }
+
+        return;
+    }
+
+    if ((png_size_t)(src->size - src->position) < length) {
+        png_error(png, "Read past the end of the PNG");
+    }
+
+    memcpy(out, src->data + src->position, length);
+    src->position += (long)length;
+}
+
+
+/**
+ * This function appends the bytes of libpng to the sink (the write callback).
+ * 
+ * @param png The png_structp (the io pointer is the png_sink)
+ * @param data Bytes written by libpng
+ * @param length Count of bytes
+ * 
+ * @return void
+*/
+static void write_sink(png_structp png, png_bytep data, png_size_t length) {
+
+    /* Declaration and initialization of variables */
+    png_sink *sink = (png_sink *)png_get_io_ptr(png);
+    long capacity = sink->capacity;
+    byte *grown;
+
+    /* The buffer is doubled, so the bytes are copied O(1) times on average */
+    while (capacity - sink->size < (long)length) {
+        capacity = capacity > 0 ? capacity * 2 : PNG_SINK_BYTES;
+    }
+
+    if (capacity != sink->capacity) {
+
+        grown = (byte *)realloc(sink->data, (size_t)capacity);
+
+        if (!grown) {
+            png_error(png, "Out of memory");
+        }
+
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+
+    memcpy(sink->data + sink->size, data, length);
+    sink->size += (long)length;
+}
+
+
+/**
+ * This function does nothing, the sink is written to the file at once (the flush callback).
+ * 
+ * @param png The png_structp
+ * 
+ * @return void
+*/
+static void flush_sink(png_structp png) {
+
+    (void)png;
+}
+
+
+/**
+ * This function reads the segments of the file when libpng meets the SEGMENTS_CHUNK (the user chunk callback).
+ * The IDAT chunks are found in the mapped source, a file read by stdio is written without its segments.
+ * 
+ * @param png The png_structp (the user chunk pointer is the png_source)
+ * @param chunk Unknown chunk read by libpng
+ * 
+ * @return 1 if the chunk is handled here, 0 for the default handling of libpng
+*/
+static int read_segments_chunk(png_structp png, png_unknown_chunkp chunk) {
+
+    /* Declaration and initialization of variables */
+    png_source *src = (png_source *)png_get_user_chunk_ptr(png);
+
+    if (memcmp(chunk->name, SEGMENTS_CHUNK, 4) != 0) {
+        return 0;
     }
 
+    /* The layout is checked from the signature to IEND, so a file with another table has no segments */
+    if (src->data) {
+        load_png_segments(src->data, src->size, chunk->data, (long)chunk->size, src->segments);
+    }
+
+    return 1;
+}
+
+
+/**
+ * This function starts reading of the PNG file and checks its format (the header is read).
+ * 
+ * @param src Source of the PNG (not closed here)
+ * @param png Pointer to the png_structp
+ * @param info Pointer to the png_infop
+ * 
+ * @return SUCCESS or FAILURE (also if the PNG is not 24-bit RGB, nothing is left allocated)
+*/
+static int open_png(png_source *src, png_structp *png, png_infop *info) {
+
     /* Check if the file can be read as PNG */
     *png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
     /* Check if it was created */
     if (!(*png)) {
         printf("Error in read_png!\n");
-        fclose(fp);
         return FAILURE;
     }
 
@@ -61,7 +259,6 @@ int read_png(char *filename, int *width, int *height, png_bytep **row_pointers,
 
         printf("Error in read_png!\n");
         png_destroy_read_struct(png, info, NULL);
-        fclose(fp);
         return FAILURE;
     }
 
@@ -70,260 +267,620 @@ int read_png(char *filename, int *width, int *height, png_bytep **row_pointers,
 
         printf("Error in read_png!\n");
         png_destroy_read_struct(png, info, NULL);
-        fclose(fp);
         return FAILURE;
     }
 
-    /* Initialize the IO */
-    png_init_io(*png, fp);
+    /* The bytes come from the source (mapped, in memory or by stdio) */
+    png_set_read_fn(*png, src, read_source);
+
+    /* The table of the segments is read on the way, the file is not opened again for it */
+    if (src->segments) {
+        png_set_keep_unknown_chunks(*png, PNG_HANDLE_CHUNK_ALWAYS, (png_const_bytep)SEGMENTS_CHUNK, 1);
+        png_set_read_user_chunk_fn(*png, src, read_segments_chunk);
+    }
 
     /* Read the info */
     png_read_info(*png, *info);
 
+    /* Only 8 bits of RGB per pixel are supported */
+    if (png_get_bit_depth(*png, *info) != 8 || png_get_color_type(*png, *info) != PNG_COLOR_TYPE_RGB) {
+
+        printf("Invalid PNG subformat!\nPlease use a 24-bit PNG file.\n");
+        png_destroy_read_struct(png, info, NULL);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the PNG file and stores the data in the image.
+ * The format is checked on the same stream the rows are decoded from (the file is opened once).
+ * 
+ * @param src Source of the PNG (closed here, or by read_png_rest if only the header rows are decoded)
+ * @param img Pointer to the image (allocated here)
+ * @param png Pointer to the png_structp
+ * @param info Pointer to the png_infop
+ * @param header_first TRUE to decode only the rows of the header (the source stays open for read_png_rest)
+ * 
+ * @return Count of decoded rows or FAILURE (also if the PNG is not 24-bit RGB)
+*/
+int read_png(png_source *src, image **img, png_structp *png, png_infop *info, int header_first) {
+    
+    /* Declaration of variables */
+    int width, height, rows;
+
+    /* Sanity check */
+    if (!src || !img || !png || !info) {
+        printf("Error in read_png!\n");
+        if (src) close_png_source(src);
+        return FAILURE;
+    }
+
+    *img = NULL;
+
+    /* Header and format */
+    if (open_png(src, png, info) == FAILURE) {
+        close_png_source(src);
+        return FAILURE;
+    }
+
+    /* Check if the setjmp was set */
+    if (setjmp(png_jmpbuf(*png))) {
+
+        printf("Error in read_png!\n");
+
+        if (*img) {
+            free_image(*img);
+            *img = NULL;
+        }
+
+        png_destroy_read_struct(png, info, NULL);
+        close_png_source(src);
+        return FAILURE;
+    }
+
     /* Get the width and height */
-    *width = png_get_image_width(*png, *info);
-    *height = png_get_image_height(*png, *info);
+    width = png_get_image_width(*png, *info);
+    height = png_get_image_height(*png, *info);
+
+    /* Interlaced pictures are put together by libpng */
+    png_set_interlace_handling(*png);
 
     /* Get the color type */
     png_read_update_info(*png, *info);
 
-    /* Allocate memory for row_pointers */
-    *row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * (*height));
+    /* Allocate the image (libpng gets the pointers to its rows) */
+    *img = create_image(width, height);
 
     /* Check if the memory was allocated */
-    if (!(*row_pointers)) {
+    if (!(*img)) {
         printf("Error in read_png!\n");
         png_destroy_read_struct(png, info, NULL);
-        fclose(fp);
+        close_png_source(src);
         return FAILURE;
     }
 
-    /* Allocate memory for each row */
-    for (y = 0; y < *height; y++) {
+    rows = header_first ? digest_rows(width) : height;
 
-        (*row_pointers)[y] = (png_byte *)malloc(png_get_rowbytes(*png, *info));
+    /* Interlaced rows are complete only after the last pass */
+    if (rows >= height || png_get_interlace_type(*png, *info) != PNG_INTERLACE_NONE) {
 
-        /* Check if the memory was allocated */
-        if (!(*row_pointers)[y]) {
-            printf("Error in read_png!\n");
+        /* Read the image */
+        png_read_image(*png, (*img)->rows);
 
-            /* Free the allocated memory */
-            for (int i = 0; i < y; i++) {
-                free((*row_pointers)[i]);
-            }
+        /* Close the source */
+        close_png_source(src);
 
-            free(*row_pointers);
+        return height;
+    }
 
+    /* Read the first rows only */
+    png_read_rows(*png, (*img)->rows, NULL, rows);
+    (*img)->loaded = rows;
 
-            png_destroy_read_struct(png, info, NULL);
-            fclose(fp);
-            return FAILURE;
-        }
+    return rows;
+}
 
+
+/**
+ * This function decodes the next rows of the picture (task of need_rows, the file stays open).
+ * 
+ * @param img Image (the source is the png_structp of read_png)
+ * @param from First row to be decoded (the rows are decoded in order)
+ * @param to Row after the last one
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int load_png_rows(image *img, int from, int to) {
+
+    /* Declaration and initialization of variables */
+    png_structp png = (png_structp)img->source;
+
+    if (setjmp(png_jmpbuf(png))) {
+        printf("Error in read_png!\n");
+        return FAILURE;
     }
-    /* Read the image */
-    png_read_image(*png, *row_pointers);
 
-    /* Close the file */
-    fclose(fp);
+    png_read_rows(png, img->rows + from, NULL, to - from);
 
     return SUCCESS;
 }
 
 
-
 /**
- * This function write the PNG file from the row_pointers.
+ * This function decodes the rest of the rows and closes the source.
  * 
- * @param filename Name of the file
- * @param width Width of the image
- * @param height Height of the image
- * @param row_pointers Pointer to the array of png_bytep
- * @param read_png Pointer to the png_structp
- * @param read_info Pointer to the png_infop
+ * @param png The png_structp of read_png
+ * @param img Image
+ * @param from Count of rows decoded by read_png
  * 
  * @return SUCCESS or FAILURE
 */
-int write_png_file(char *filename, png_bytep *row_pointers, png_structp read_png, png_infop read_info) {
+int read_png_rest(png_structp png, image *img, int from) {
 
-    /* Declaration of variables */
-    FILE *fp;
-    png_uint_32 width_orig, height_orig;
-    int bit_depth_orig, color_type_orig;
+    /* Declaration and initialization of variables */
+    png_source *src = (png_source *)png_get_io_ptr(png);
 
     /* Sanity check */
-    if (!filename || !row_pointers || !read_png || !read_info) {
-        printf("Error in write_png_file!\n");
+    if (!img || from >= img->height) {
+        return SUCCESS;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+
+        printf("Error in read_png!\n");
+        close_png_source(src);
         return FAILURE;
     }
 
-    /* Open the file */
-    fp = fopen(filename, "wb");
+    png_read_rows(png, img->rows + from, NULL, img->height - from);
+    img->loaded = img->height;
 
-    /* Check if the file was opened */
-    if (!fp) {
-        printf("Error in write_png_file!\n");
+    close_png_source(src);
+
+    return SUCCESS;
+}
+
+
+
+/**
+ * This function returns the index of the encoding profile.
+ * 
+ * @param name Name of the profile (fastest, fast, default, smallest)
+ * 
+ * @return One of the PNG_PROFILE_* defines or FAILURE
+*/
+int parse_png_profile(const char *name) {
+
+    /* Declaration of variables */
+    int i;
+
+    /* Sanity check */
+    if (!name) {
+        printf("Error in parse_png_profile!\n");
         return FAILURE;
     }
 
-    /* Check if the file can be read as PNG */
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    for (i = 0; i < PNG_PROFILE_COUNT; i++) {
+        if (strcmp(name, profiles[i].name) == 0) return i;
+    }
+
+    return FAILURE;
+}
+
+
+/**
+ * This function returns the name of the encoding profile.
+ * 
+ * @param profile One of the PNG_PROFILE_* defines
+ * 
+ * @return Name of the profile
+*/
+const char *png_profile_name(int profile) {
+
+    if (profile < 0 || profile >= PNG_PROFILE_COUNT) return "?";
+
+    return profiles[profile].name;
+}
 
 
-    if (!png) {
+/**
+ * This function returns the encoding of the profile.
+ * 
+ * @param profile One of the PNG_PROFILE_* defines (PNG_PROFILE_DEFAULT if it is invalid)
+ * 
+ * @return Profile
+*/
+const png_profile *get_png_profile(int profile) {
+
+    return &profiles[profile >= 0 && profile < PNG_PROFILE_COUNT ? profile : PNG_PROFILE_DEFAULT];
+}
+
+
+/**
+ * This function starts writing of the 24-bit PNG file (the header is written).
+ * 
+ * @param fp Opened file (not closed here), NULL to write into the sink
+ * @param sink Sink of the bytes if fp is NULL
+ * @param width Width of the picture
+ * @param height Height of the picture
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param png Pointer to the png_structp
+ * @param info Pointer to the png_infop
+ * 
+ * @return SUCCESS or FAILURE (nothing is left allocated)
+*/
+static int open_png_write(FILE *fp, png_sink *sink, int width, int height, int profile, png_structp *png, png_infop *info) {
+
+    /* Declaration of variables */
+    const png_profile *p;
+
+    /* Check if the file can be written as PNG */
+    *png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+
+
+    if (!(*png)) {
         printf("Error in write_png_file!\n");
-        fclose(fp);
         return FAILURE;
     }
 
     /* Check if the info struct was created */
-    png_infop info = png_create_info_struct(png);
+    *info = png_create_info_struct(*png);
 
     /* Check if it was created */
-    if (!info) {
+    if (!(*info)) {
         printf("Error in write_png_file!\n");
-        png_destroy_write_struct(&png, &info);
-        fclose(fp);
+        png_destroy_write_struct(png, info);
         return FAILURE;
     }
 
     /* Check if the setjmp was set */
-    if (setjmp(png_jmpbuf(png))) {
+    if (setjmp(png_jmpbuf(*png))) {
         printf("Error in write_png_file!\n");
-        png_destroy_write_struct(&png, &info);
-        fclose(fp);
+        png_destroy_write_struct(png, info);
         return FAILURE;
     }
 
-    /* Initialize the IO */
-    png_init_io(png, fp);
+    /* Initialize the IO (the sink is written to the file at once) */
+    if (fp) {
+        png_init_io(*png, fp);
+    } else {
+        png_set_write_fn(*png, sink, write_sink, flush_sink);
+    }
+
+    /* Encoding of the profile (the defaults of libpng are kept where it has none), set after the setjmp so a longjmp cannot clobber it */
+    p = get_png_profile(profile);
 
-    /* Get the image attributes */
-    png_get_IHDR(read_png, read_info, &width_orig, &height_orig, &bit_depth_orig, &color_type_orig, NULL, NULL, NULL);
+    if (p->level >= 0) png_set_compression_level(*png, p->level);
+    if (p->filters >= 0) png_set_filter(*png, PNG_FILTER_TYPE_BASE, p->filters);
+    if (p->strategy >= 0) png_set_compression_strategy(*png, p->strategy);
+    if (p->mem_level >= 0) png_set_compression_mem_level(*png, p->mem_level);
 
     /* Set the image attributes */
     png_set_IHDR(
-        png,
-        info,
-        width_orig, height_orig,
-        bit_depth_orig,
-        color_type_orig,
+        *png,
+        *info,
+        width, height,
+        8,
+        PNG_COLOR_TYPE_RGB,
         PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_DEFAULT,
         PNG_FILTER_TYPE_DEFAULT
     );
 
     /* Write the info */
-    png_write_info(png, info);
+    png_write_info(*png, *info);
 
-    /* Write the image */
-    png_write_image(png, row_pointers);
-    png_write_end(png, NULL);
+    return SUCCESS;
+}
 
 
-    /* Close the file */
-    fclose(fp);
+/**
+ * This function encodes the image as a 24-bit PNG into memory (the buffer grows as libpng writes).
+ * 
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param data Pointer to the encoded bytes (allocated here, freed by the caller)
+ * @param size Pointer to the count of the encoded bytes
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int write_png_buffer(image *img, int profile, byte **data, long *size) {
+
+    /* Declaration of variables */
+    png_structp png;
+    png_infop info;
+    png_sink sink;
+
+    /* Sanity check */
+    if (!img || !data || !size) {
+        printf("Error in write_png_file!\n");
+        return FAILURE;
+    }
+
+    memset(&sink, 0, sizeof(png_sink));
+
+    if (open_png_write(NULL, &sink, img->width, img->height, profile, &png, &info) == FAILURE) {
+        free(sink.data);
+        return FAILURE;
+    }
+
+    /* Check if the setjmp was set */
+    if (setjmp(png_jmpbuf(png))) {
+        printf("Error in write_png_file!\n");
+        png_destroy_write_struct(&png, &info);
+        free(sink.data);
+        return FAILURE;
+    }
+
+    /* Write the image */
+    png_write_image(png, img->rows);
+    png_write_end(png, NULL);
 
     /* Free the memory */
     png_destroy_write_struct(&png, &info);
 
-    return 0;
+    *data = sink.data;
+    *size = sink.size;
+
+    return SUCCESS;
 }
 
+
 /**
- * This function checks if file is PNG file in correct format
+ * This function writes the image as a 24-bit PNG file.
+ * The image is encoded into memory first, then the file is written by one call.
  * 
- * @param path Path to the file
+ * @param filename Name of the file
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
  * 
- * @return Count of pixels if png, FAILURE if error
+ * @return SUCCESS or FAILURE
 */
-int check_png(char *path){
+int write_png_file(char *filename, image *img, int profile) {
 
     /* Declaration and initialization of variables */
     FILE *fp;
-    int bit_depth, color_type;
+    byte *data = NULL;
+    long size = 0;
+    int ret = 0;
 
     /* Sanity check */
-    if (!path) {
-        printf("Error in check_png!\n");
+    if (!filename || !img) {
+        printf("Error in write_png_file!\n");
         return FAILURE;
     }
 
+    if (write_png_buffer(img, profile, &data, &size) == FAILURE) {
+        return FAILURE;
+    }
 
     /* Open the file */
-    fp = fopen(path, "rb");
+    fp = fopen(filename, "wb");
 
-    if (!fp) {
-        printf("Error in check_png!\n");
-        return FAILURE;
+    /* Check if the file was opened and written */
+    if (!fp || fwrite(data, 1, (size_t)size, fp) != (size_t)size) {
+        printf("Error in write_png_file!\n");
+        ret = FAILURE;
     }
 
-    /* Check if the file can be read as PNG */
-    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    /* Close the file */
+    if (fp && fclose(fp) != 0 && ret == 0) {
+        printf("Error in write_png_file!\n");
+        ret = FAILURE;
+    }
 
-    /* Check if it was created */
-    if (!png) {
+    free(data);
+
+    return ret;
+}
+
+/**
+ * This function decodes the next rows of the PNG file into the window.
+ * 
+ * @param png The png_structp of the read file
+ * @param win Window (the rows are stored from its first row)
+ * @param rows Count of rows
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int read_window(png_structp png, image *win, int rows) {
 
-        printf("Error in check_png!\n");
-        fclose(fp);
+    if (setjmp(png_jmpbuf(png))) {
+        printf("Error in read_png!\n");
         return FAILURE;
     }
-        
-    /* Check if the info struct was created */
-    png_infop info = png_create_info_struct(png);
 
-    /* Check if it was created */
-    if (!info) {
+    png_read_rows(png, win->rows, NULL, rows);
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function encodes the rows of the window into the PNG file.
+ * 
+ * @param png The png_structp of the written file
+ * @param win Window
+ * @param rows Count of rows
+ * @param last TRUE to end the file after the rows
+ * 
+ * @return SUCCESS or FAILURE
+*/
+static int write_window(png_structp png, image *win, int rows, int last) {
 
-        printf("Error in check_png!\n");
-        png_destroy_read_struct(&png, NULL, NULL);
-        fclose(fp);
+    if (setjmp(png_jmpbuf(png))) {
+        printf("Error in write_png_file!\n");
         return FAILURE;
+    }
+
+    png_write_rows(png, win->rows, rows);
 
+    if (last) {
+        png_write_end(png, NULL);
     }
 
+    return SUCCESS;
+}
 
-    if (setjmp(png_jmpbuf(png))) {
 
-        printf("Error in check_png!\n");
+/**
+ * This function hides the payload while the PNG file is decoded and encoded row by row.
+ * Only a window of rows (the rows of the header with the digest, usually one) and the payload are in memory.
+ * The new file is written next to the output (or the picture) and replaces it when it is complete.
+ * 
+ * @param src Source of the picture (read by stdio, not closed here)
+ * @param picture Path to the picture
+ * @param payload_path Path to the payload
+ * @param opts Options (the output path, NULL to replace the picture)
+ * 
+ * @return 0 if success, 1 if the payload cannot be read, 2 not in correct format, 3 if picture is not big enough,
+ *         6 different error, FAILURE if the picture is interlaced (nothing was written)
+*/
+static int hide_png_streamed(png_source *src, char *picture, char *payload_path, options *opts) {
+
+    /* Declaration and initialization of variables */
+    char *target = opts->output ? opts->output : picture, *part = NULL;
+    png_structp png = NULL, out = NULL;
+    png_infop info = NULL, out_info = NULL;
+    int width, height, window, body, first, next, n, ret = 0;
+    image *win = NULL;
+    FILE *fo = NULL;
+    hide_plan plan;
+
+    memset(&plan, 0, sizeof(hide_plan));
+
+    if (open_png(src, &png, &info) == FAILURE) {
+        return 2;
+    }
+
+    /* The rows of an interlaced picture are complete only after the last pass */
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        printf("An interlaced PNG cannot be streamed, it is read whole.\n");
         png_destroy_read_struct(&png, &info, NULL);
-        fclose(fp);
         return FAILURE;
     }
 
-    /* Initialize the IO */
-    png_init_io(png, fp);
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
 
-    /* Read the info */
-    png_read_info(png, info);
+    /* The first window holds the header with the digest */
+    window = digest_rows(width);
+    if (window > height) window = height;
+    n = window;
 
-    /* Get the bit depth and color type */
-    bit_depth = png_get_bit_depth(png, info);
-    color_type = png_get_color_type(png, info);
+    win = create_image(width, window);
 
-    /* Check if the file is in correct format */
-    if (bit_depth != 8 || color_type != PNG_COLOR_TYPE_RGB) {
+    if (!win || read_window(png, win, n) == FAILURE) {
+        ret = 6;
+    }
 
-        /* Free the memory */
+    /* The same payload is already hidden, nothing to compress, embed or write */
+    if (ret == 0 && !opts->output && payload_hidden(win, payload_path, opts)) {
+
+        printf("Payload is already hidden in the picture!\n");
+        free_image(win);
         png_destroy_read_struct(&png, &info, NULL);
-        fclose(fp);
-        
-        printf("Invalid PNG subformat!\nPlease use a 24-bit PNG file.\n");
-        return FAILURE;
+        return 0;
+    }
 
-    } 
+    if (ret == 0) {
+        ret = make_hide_plan(&plan, payload_path, opts, width, height);
+    }
 
-   
-    /* Close */
-    fclose(fp);
+    body = ret == 0 ? plan_rows(&plan) : 0;
 
-    /* Free the memory */
-    png_destroy_read_struct(&png, &info, NULL);
+    /* Matrix embedding needs the cover bits of the whole body first, then the picture is decoded again */
+    if (ret == 0 && plan.lay.matrix) {
 
+        for (first = 0; ; first = next) {
 
-    /* Return count of pixels in image */
-    return (png_get_image_width(png, info) * png_get_image_height(png, info));
+            plan_read_window(&plan, win, first, n);
+            next = first + n;
 
+            if (next >= body) break;
+
+            n = height - next < window ? height - next : window;
+
+            if (read_window(png, win, n) == FAILURE) {
+                ret = 6;
+                break;
+            }
+        }
+
+        png_destroy_read_struct(&png, &info, NULL);
+        n = window;
+
+        if (ret == 0 && (plan_encode(&plan, opts->threads) == FAILURE || rewind_png_source(src) == FAILURE)) {
+            ret = 6;
+        }
+
+        if (ret == 0 && (open_png(src, &png, &info) == FAILURE || read_window(png, win, n) == FAILURE)) {
+            ret = 6;
+        }
+    }
+
+    /* The new file */
+    if (ret == 0) {
+
+        part = part_path(target);
+        fo = part ? fopen(part, "wb") : NULL;
+
+        if (!fo || open_png_write(fo, NULL, width, height, opts->png_profile, &out, &out_info) == FAILURE) {
+            printf("Error in write_png_file!\n");
+            ret = 6;
+        }
+    }
+
+    /* Decode, embed and encode every window */
+    for (first = 0; ret == 0; first = next) {
+
+        if (first < body) {
+            plan_write_window(&plan, win, first, n);
+        }
+
+        next = first + n;
+
+        if (write_window(out, win, n, next >= height) == FAILURE) {
+            ret = 6;
+            break;
+        }
+
+        if (next >= height) break;
+
+        n = height - next < window ? height - next : window;
+
+        if (read_window(png, win, n) == FAILURE) {
+            ret = 6;
+        }
+    }
+
+    if (out) png_destroy_write_struct(&out, &out_info);
+    if (png) png_destroy_read_struct(&png, &info, NULL);
+
+    if (fo && fclose(fo) != 0 && ret == 0) {
+        printf("Error in write_png_file!\n");
+        ret = 6;
+    }
+
+    /* No half written picture is left */
+    if (ret == 0 && replace_file(part, target) == FAILURE) {
+        ret = 6;
+    } else if (ret != 0 && fo) {
+        remove(part);
+    }
+
+    if (ret == 0) {
+        printf("Data hidden successfully!\nStream: %d of %d row(s) embedded row by row\n", body, height);
+    }
+
+    free(part);
+    free_image(win);
+    free_hide_plan(&plan);
+
+    return ret;
 }
 
 
@@ -332,16 +889,21 @@ int check_png(char *path){
  * 
  * @param paths Array of paths
  * @param sw Switch
+ * @param opts Options
  * 
  * @return 0 if success, 2 not in correct format, 3 if picture is not big enough, 4 no hidden content, 5 damagged content ,6 different errror
 */
-int proceed_png(char **paths, char sw){
+int proceed_png(char **paths, char sw, options *opts){
 
     /* Declaration of variables */
-	int result = 0, width, height, exit_code = 0;
-	png_bytep *row_pointers = NULL;
+	int result = 0, exit_code = 0;
+	image *img = NULL;
+	FILE *fp = NULL;
+	png_source src;
 	png_structp png;
 	png_infop info;
+	png_segments seg;
+	options patch;
 
     /* Sanity check */
     if (!paths) {
@@ -349,61 +911,155 @@ int proceed_png(char **paths, char sw){
         return FAILURE;
     }
 
-    /* Check if the png is in correct format */
-	result = check_png(paths[0]);
+    /* Open the picture (the only open of it) */
+	fp = fopen(paths[0], "rb");
 
+	if (!fp) {
 
-	/* -1 indicate that the png is not 24 bit*/
-	if (result == FAILURE) {
-		return 2;
+		/* WRONG PARAMETERS - 1 */
+		printf("Invalid path: %s\n", paths[0]);
+		return 1;
 	}
 
 
-	/* Read the png file */
-	exit_code = read_png(paths[0], &width, &height, &row_pointers, &png, &info);
+	/* Decode, embed and encode row by row (an interlaced picture is read whole, the pages of a map would stay resident) */
+	if (sw == 'h' && opts->stream) {
 
-    /* Check if the file was read */
-    if (exit_code == FAILURE) {
-        printf("Error in proceed_png!\n");
-        return FAILURE;
+		png_file_source(&src, fp, FALSE);
+		result = hide_png_streamed(&src, paths[0], paths[1], opts);
+
+		if (result != FAILURE || rewind_png_source(&src) == FAILURE) {
+			close_png_source(&src);
+			return result == FAILURE ? 6 : result;
+		}
+
+	} else {
+
+		/* libpng copies from the pages of the mapped file, no stdio buffer in between */
+		png_file_source(&src, fp, TRUE);
+	}
+
+	/* The whole output is written, the changed rows are not tracked */
+	if (opts->output) {
+		opts->delta = FALSE;
+	}
+
+	/* A hide takes the segments of the file from the stream libpng reads */
+	memset(&seg, 0, sizeof(png_segments));
+
+	if (sw == 'h') {
+		src.segments = &seg;
+	}
+
+	/* Check the format and read the png file (only the rows of the header with the digest) */
+	result = read_png(&src, &img, &png, &info, TRUE);
+
+    /* Not a 24-bit PNG or the rows are missing - not in correct format */
+    if (result == FAILURE) {
+        free_png_segments(&seg);
+        return 2;
     }
+
+	/* Extraction decodes only the rows up to the end of the body (the rest is never inflated) */
+	if (sw == 'x' && result < img->height) {
+		img->load = load_png_rows;
+		img->source = png;
+	}
 	
 
 	if (sw == 'h') {
 
-		exit_code = hide_in_image(width, height, &row_pointers, paths[1]);
+		/* The same payload is already hidden, nothing to compress, embed or write (unless a new file is wanted) */
+		if (!opts->output && payload_hidden(img, paths[1], opts)) {
 
-        if(exit_code == 3){
+			printf("Payload is already hidden in the picture!\n");
+
+			if (result < img->height) {
+				close_png_source((png_source *)png_get_io_ptr(png));
+			}
+
+			free_png_segments(&seg);
+			free_image(img);
+			png_destroy_read_struct(&png, &info, NULL);
+			return 0;
+		}
+
+		/* The rows after the header are missing or damaged - not in correct format */
+		if (read_png_rest(png, img, result) == FAILURE) {
+
+			close_png_source((png_source *)png_get_io_ptr(png));
+			free_png_segments(&seg);
+			free_image(img);
+			png_destroy_read_struct(&png, &info, NULL);
+			return 2;
+		}
+
+		/* A PNG written by segments (of the same rows) is deflated again only where the rows changed */
+		patch = *opts;
+
+		if (seg.count > 0 && opts->png_segments != 0 && opts->png_segments != seg.rows) {
+			free_png_segments(&seg);
+		}
+
+		if (seg.count > 0) {
+			patch.delta = TRUE;
+		}
+
+		exit_code = hide_in_image(img, paths[1], &patch);
+
+        if(exit_code != 0){
 
             /* Free memory */
-            free_row_pointers(row_pointers, height);
+            free_png_segments(&seg);
+            free_image(img);
             png_destroy_read_struct(&png, &info, NULL);
 
-            return 3;
+            return exit_code;
         }
 
 
-		exit_code = write_png_file(paths[0], row_pointers, png, info);
+		/* Nothing changed (--delta), the file stays as it is */
+		if (count_dirty(img) == 0 && !opts->output) {
+
+			free_png_segments(&seg);
+			free_image(img);
+			png_destroy_read_struct(&png, &info, NULL);
+			return 0;
+		}
+
+		/* More threads filter and deflate groups of rows in parallel, one thread keeps the output of libpng */
+		if (seg.count > 0) {
+			exit_code = rewrite_png_segments(paths[0], opts->output ? opts->output : paths[0], img, &seg, opts->png_profile, opts->threads) == FAILURE ? FAILURE : 0;
+		} else if (opts->threads != 1 || opts->png_segments != 0) {
+			exit_code = write_png_parallel(opts->output ? opts->output : paths[0], img, opts->png_profile, opts->threads, opts->png_segments) == FAILURE ? FAILURE : 0;
+		} else {
+			exit_code = write_png_file(opts->output ? opts->output : paths[0], img, opts->png_profile);
+		}
+
+		free_png_segments(&seg);
 
         if (exit_code == FAILURE) {
             
             /* Free memory */
-            free_row_pointers(row_pointers, height);
+            free_image(img);
             png_destroy_read_struct(&png, &info, NULL);
             return 6;
         }
 
 	} else if (sw == 'x') {
 
-		exit_code = extract_from_image(width, &row_pointers, paths[1]);
+		exit_code = extract_from_image(img, paths[1], opts);
 
-        
+		/* The source is still open if some rows were not decoded */
+		if (result < img->height) {
+			close_png_source((png_source *)png_get_io_ptr(png));
+		}
 
 	}
 
 
 	/* Free memory */
-	free_row_pointers(row_pointers, height);
+	free_image(img);
 	png_destroy_read_struct(&png, &info, NULL);
 	
 
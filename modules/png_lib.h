@@ -4,7 +4,63 @@
 #ifndef __PNG_LIB_H__
 #define __PNG_LIB_H__
 
+#include <stdio.h>
 #include "my_defs.h"
+#include "input.h"
+#include "image.h"
+#include "file_map.h"
+#include "png_deflate.h"
+
+
+/* Defines */
+
+/* Encoding profiles of the written file (--png-profile), from the fastest to the smallest output */
+#define PNG_PROFILE_DEFAULT 0
+#define PNG_PROFILE_FASTEST 1
+#define PNG_PROFILE_FAST 2
+#define PNG_PROFILE_SMALLEST 3
+#define PNG_PROFILE_COUNT 4
+
+/* First size of the buffer of an encoded PNG (doubled as libpng writes) */
+#define PNG_SINK_BYTES (1L << 16)
+
+
+
+/* Structures */
+
+/* Encoding of the written file (-1 keeps the default of libpng) */
+typedef struct {
+
+    /* Name of the profile (--png-profile) */
+    const char *name;
+
+    /* zlib level, filters of the rows (PNG_FILTER_*), zlib strategy and memory level */
+    int level;
+    int filters;
+    int strategy;
+    int mem_level;
+
+} png_profile;
+
+
+/* Bytes of a PNG read by libpng: a mapped file, a buffer of the caller or a stream */
+typedef struct {
+
+    /* Bytes of the PNG, their count and the position of the next read (NULL if read from fp) */
+    const byte *data;
+    long size;
+    long position;
+
+    /* Map of the file (map.data is NULL if it is not mapped) */
+    file_map map;
+
+    /* Opened file (closed with the source), NULL for a buffer of the caller */
+    FILE *fp;
+
+    /* Segments filled when libpng meets the SEGMENTS_CHUNK of a mapped file (NULL if they are not wanted) */
+    png_segments *segments;
+
+} png_source;
 
 
 
@@ -13,32 +69,118 @@
 /* Prototypes */
 
 /**
- * This function will write PNG file
+ * This function writes the image as a 24-bit PNG file.
  * 
  * @param filename Name of the file
- * @param width Width of image
- * @param height Height of image
- * @param row_pointers Pointer to array of pointers to rows of pixels
- * @param read_png Pointer to the png_structp
- * @param read_info Pointer to the png_infop
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
  * 
  * @return SUCCESS or FAILURE
 */
-int write_png_file(char *filename, png_bytep *row_pointers, png_structp read_png, png_infop read_info);
+int write_png_file(char *filename, image *img, int profile);
 
 
 /**
- * This function will read PNG file
+ * This function encodes the image as a 24-bit PNG into memory (the buffer grows as libpng writes).
  * 
- * @param filename Name of the file
- * @param width Pointer to the width of image
- * @param height Pointer to the height of image
- * @param row_pointers Pointer to array of pointers to rows of pixels
+ * @param img Image
+ * @param profile Encoding profile (PNG_PROFILE_*)
+ * @param data Pointer to the encoded bytes (allocated here, freed by the caller)
+ * @param size Pointer to the count of the encoded bytes
+ * 
+ * @return SUCCESS or FAILURE
+*/
+int write_png_buffer(image *img, int profile, byte **data, long *size);
+
+
+/**
+ * This function makes the opened file the source of read_png.
+ * 
+ * @param src Source to be filled
+ * @param fp Opened file (owned by the source from now on)
+ * @param map TRUE to map the file if it can be (libpng then copies from the pages), FALSE to read it by stdio
+ * 
+ * @return void
+*/
+void png_file_source(png_source *src, FILE *fp, int map);
+
+
+/**
+ * This function makes the buffer of the caller the source of read_png (nothing is copied before libpng reads).
+ * 
+ * @param src Source to be filled
+ * @param data Bytes of the PNG (kept by the caller until the source is closed)
+ * @param size Count of the bytes
+ * 
+ * @return void
+*/
+void png_buffer_source(png_source *src, const byte *data, long size);
+
+
+/**
+ * This function closes the source (the file is unmapped and closed).
+ * 
+ * @param src Source
+ * 
+ * @return void
+*/
+void close_png_source(png_source *src);
+
+
+/**
+ * This function returns the index of the encoding profile.
+ * 
+ * @param name Name of the profile (fastest, fast, default, smallest)
+ * 
+ * @return One of the PNG_PROFILE_* defines or FAILURE
+*/
+int parse_png_profile(const char *name);
+
+
+/**
+ * This function returns the encoding of the profile.
+ * 
+ * @param profile One of the PNG_PROFILE_* defines (PNG_PROFILE_DEFAULT if it is invalid)
+ * 
+ * @return Profile
+*/
+const png_profile *get_png_profile(int profile);
+
+
+/**
+ * This function returns the name of the encoding profile.
+ * 
+ * @param profile One of the PNG_PROFILE_* defines
+ * 
+ * @return Name of the profile
+*/
+const char *png_profile_name(int profile);
+
+
+/**
+ * This function will read PNG file (the format is checked on the same stream)
+ * 
+ * @param src Source of the PNG (closed here, or by read_png_rest if only the header rows are decoded)
+ * @param img Pointer to the image (allocated here)
  * @param png Pointer to the png_structp
  * @param info Pointer to the png_infop
+ * @param header_first TRUE to decode only the rows of the header (the source stays open for read_png_rest)
+ * 
+ * @return Count of decoded rows or FAILURE (also if the PNG is not 24-bit RGB)
+*/
+int read_png(png_source *src, image **img, png_structp *png, png_infop *info, int header_first);
+
+
+/**
+ * This function decodes the rest of the rows and closes the source.
  * 
+ * @param png The png_structp of read_png
+ * @param img Image
+ * @param from Count of rows decoded by read_png
+ * 
+ * @return SUCCESS or FAILURE
 */
-int read_png(char *filename, int *width, int *height, png_bytep **row_pointers, png_structp *png, png_infop *info);
+int read_png_rest(png_structp png, image *img, int from);
 
 
 /**
@@ -46,9 +188,10 @@ int read_png(char *filename, int *width, int *height, png_bytep **row_pointers,
  * 
  * @param paths Array of paths to files
  * @param sw Switch
+ * @param opts Options
  * 
  * @return 0 success, 2 not in correct format, 3 image too small, 4 no hidden content , 5 damagged file, 6 error
 */
-int proceed_png(char **paths, char sw);
+int proceed_png(char **paths, char sw, options *opts);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,447 @@
+/* PNM_LIB.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pnm_lib.h"
+#include "pixel_secrets.h"
+
+
+
+/**
+ * This function skips the white space and the comments (from # to the end of the line) of the header.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param p Position in the header
+ *
+ * @return Position of the next token (size if the header ends)
+*/
+static long skip_space(const byte *data, long size, long p){
+
+    while (p < size) {
+
+        if (data[p] == '#') {
+
+            while (p < size && data[p] != '\n') p++;
+
+        } else if (isspace(data[p])) {
+
+            p++;
+
+        } else {
+
+            break;
+        }
+    }
+
+    return p;
+}
+
+
+/**
+ * This function reads the decimal number of the header (it must be followed by a white space).
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param p Pointer to the position in the header (moved after the number)
+ * @param value Pointer to the number
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int read_number(const byte *data, long size, long *p, long *value){
+
+    /* Declaration and initialization of variables */
+    long q = skip_space(data, size, *p), number = 0;
+
+    if (q >= size || !isdigit(data[q])) {
+        return FAILURE;
+    }
+
+    while (q < size && isdigit(data[q])) {
+
+        number = number * 10 + (data[q++] - '0');
+
+        if (number > PNM_MAX_NUMBER) {
+            return FAILURE;
+        }
+    }
+
+    if (q >= size || !isspace(data[q])) {
+        return FAILURE;
+    }
+
+    *p = q;
+    *value = number;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the keyword (or the tuple type) of the PAM header.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param p Pointer to the position in the header (moved after the token)
+ * @param token Buffer of PAM_TOKEN_SIZE bytes for the token
+ *
+ * @return SUCCESS or FAILURE (also if the token is too long)
+*/
+static int read_token(const byte *data, long size, long *p, char *token){
+
+    /* Declaration and initialization of variables */
+    long q = skip_space(data, size, *p);
+    int length = 0;
+
+    while (q < size && !isspace(data[q])) {
+
+        if (length == PAM_TOKEN_SIZE - 1) {
+            return FAILURE;
+        }
+
+        token[length++] = (char)data[q++];
+    }
+
+    if (length == 0) {
+        return FAILURE;
+    }
+
+    token[length] = '\0';
+    *p = q;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function parses the header of the PAM picture (the keywords up to ENDHDR).
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param head Header to be filled
+ * @param depth Pointer to the count of the channels
+ * @param maxval Pointer to the biggest value of a sample
+ * @param rgb Pointer set to FALSE if the tuple type is not RGB
+ *
+ * @return SUCCESS or FAILURE
+*/
+static int parse_pam(const byte *data, long size, pnm_head *head, long *depth, long *maxval, int *rgb){
+
+    /* Declaration and initialization of variables */
+    char token[PAM_TOKEN_SIZE], tuple[PAM_TOKEN_SIZE];
+    long p = 2, width = -1, height = -1;
+
+    *depth = *maxval = -1;
+    *rgb = TRUE;
+
+    while (read_token(data, size, &p, token) == SUCCESS) {
+
+        if (strcmp(token, "ENDHDR") == 0) {
+
+            /* The pixels follow the end of the line */
+            if (p >= size || data[p] != '\n' || width <= 0 || height <= 0) {
+                return FAILURE;
+            }
+
+            head->width = (int)width;
+            head->height = (int)height;
+            head->offset = p + 1;
+
+            return SUCCESS;
+        }
+
+        if (strcmp(token, "WIDTH") == 0) {
+
+            if (read_number(data, size, &p, &width) == FAILURE) return FAILURE;
+
+        } else if (strcmp(token, "HEIGHT") == 0) {
+
+            if (read_number(data, size, &p, &height) == FAILURE) return FAILURE;
+
+        } else if (strcmp(token, "DEPTH") == 0) {
+
+            if (read_number(data, size, &p, depth) == FAILURE) return FAILURE;
+
+        } else if (strcmp(token, "MAXVAL") == 0) {
+
+            if (read_number(data, size, &p, maxval) == FAILURE) return FAILURE;
+
+        } else if (strcmp(token, "TUPLTYPE") == 0) {
+
+            /* A longer tuple type is not RGB either */
+            *rgb = read_token(data, size, &p, tuple) == SUCCESS && strcmp(tuple, PAM_TUPLTYPE) == 0;
+
+            while (p < size && data[p] != '\n') p++;
+
+        } else {
+
+            return FAILURE;
+        }
+    }
+
+    return FAILURE;
+}
+
+
+/**
+ * This function parses the header of the binary PPM (P6) or the PAM (P7) picture.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param head Header to be filled
+ *
+ * @return SUCCESS or FAILURE (also if the picture is not 8-bit RGB or the pixels are missing)
+*/
+int parse_pnm(const byte *data, long size, pnm_head *head){
+
+    /* Declaration and initialization of variables */
+    long p = 2, width, height, depth = PNM_CHANNELS, maxval;
+    int rgb = TRUE, ret = FAILURE;
+
+    /* Sanity check */
+    if (!data || !head) {
+        printf("Error in parse_pnm!\n");
+        return FAILURE;
+    }
+
+    if (size > 2 && isspace(data[2])) {
+
+        if (memcmp(data, PPM_MAGIC, 2) == 0) {
+
+            /* Width, height and maxval, then one white space before the pixels */
+            if (read_number(data, size, &p, &width) == SUCCESS && read_number(data, size, &p, &height) == SUCCESS
+                && read_number(data, size, &p, &maxval) == SUCCESS && width > 0 && height > 0) {
+
+                head->width = (int)width;
+                head->height = (int)height;
+                head->offset = p + 1;
+                ret = SUCCESS;
+            }
+
+        } else if (memcmp(data, PAM_MAGIC, 2) == 0) {
+
+            ret = parse_pam(data, size, head, &depth, &maxval, &rgb);
+        }
+    }
+
+    if (ret == FAILURE) {
+        printf("Invalid PPM / PAM file!\n");
+        return FAILURE;
+    }
+
+    /* Only RGB with a byte per sample */
+    if (depth != PNM_CHANNELS || maxval != PNM_MAXVAL || !rgb) {
+        printf("Invalid PPM / PAM subformat!\nPlease use a 24-bit (RGB) PPM or PAM file.\n");
+        return FAILURE;
+    }
+
+    /* Every row must be in the file */
+    if ((long)head->width * PNM_CHANNELS > (size - head->offset) / head->height) {
+        printf("Invalid PPM / PAM file!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function maps the PPM / PAM file, the image is a view of the mapped pixels (no copy is made).
+ *
+ * @param path Path to the file
+ * @param map Map to be filled (unmapped by the caller after the image is freed)
+ * @param head Header to be filled
+ * @param writable TRUE to change the file through the image
+ * @param code Set to 1 if the file cannot be opened, 2 if it is not in correct format, 6 otherwise
+ *
+ * @return Image or NULL if error
+*/
+image *map_pnm(char *path, file_map *map, pnm_head *head, int writable, int *code){
+
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    FILE *fp;
+
+    /* Sanity check */
+    if (!path || !map || !head || !code) {
+        printf("Error in map_pnm!\n");
+        return NULL;
+    }
+
+    fp = fopen(path, "rb");
+
+    if (!fp) {
+
+        /* WRONG PARAMETERS - 1 */
+        printf("Invalid path: %s\n", path);
+        *code = 1;
+        return NULL;
+    }
+
+    fclose(fp);
+
+    if (map_file(map, path, writable) == FAILURE) {
+        *code = 6;
+        return NULL;
+    }
+
+    /* Not a 24-bit PPM / PAM - not in correct format */
+    if (parse_pnm(map->data, map->size, head) == FAILURE) {
+        unmap_file(map);
+        *code = 2;
+        return NULL;
+    }
+
+    /* The rows of the file are already r, g, b without any gap */
+    img = wrap_image(head->width, head->height, map->data + head->offset, (long)head->width * PNM_CHANNELS);
+
+    if (!img) {
+        unmap_file(map);
+        *code = 6;
+        return NULL;
+    }
+
+    return img;
+}
+
+
+/**
+ * This function hides the payload by changing only the differing pixels of the mapped file.
+ *
+ * @param path Path to the picture
+ * @param payload_path Path to the payload
+ * @param opts Options
+ *
+ * @return 0 if success, 1 the picture cannot be opened, 2 not in correct format, 3 if picture is not big enough, 6 different error
+*/
+static int hide_mapped(char *path, char *payload_path, options *opts){
+
+    /* Declaration and initialization of variables */
+    file_map map;
+    pnm_head head;
+    options patch = *opts;
+    image *img = NULL;
+    int i, first = -1, last = -1, ret = 2;
+
+    img = map_pnm(path, &map, &head, TRUE, &ret);
+
+    if (!img) {
+        return ret;
+    }
+
+    /* The same payload is already hidden, nothing to compress, embed or write */
+    if (payload_hidden(img, payload_path, opts)) {
+
+        printf("Payload is already hidden in the picture!\n");
+        free_image(img);
+        unmap_file(&map);
+        return 0;
+    }
+
+    /* The pixels are the file, only the ones which differ are written */
+    patch.delta = TRUE;
+    ret = hide_in_image(img, payload_path, &patch);
+
+    for (i = 0; ret == 0 && img->dirty && i < img->height; i++) {
+
+        if (!img->dirty[i]) continue;
+
+        if (first < 0) first = i;
+        last = i;
+    }
+
+    if (first >= 0 && flush_range(&map, head.offset + (long)first * img->stride, (long)(last - first + 1) * img->stride, opts->sync) == FAILURE) {
+        ret = 6;
+    }
+
+    if (ret == 0) {
+        printf("In place: %d row(s) written\n", count_dirty(img));
+    }
+
+    free_image(img);
+    unmap_file(&map);
+
+    return ret;
+}
+
+
+/**
+ * This function will hide / extract the payload in / from the PPM or PAM file.
+ *
+ * @param paths Array of paths
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 if success, 1 the picture cannot be opened, 2 not in correct format, 3 if picture is not big enough,
+ *         4 no hidden content, 5 damagged content, 6 different errror
+*/
+int proceed_pnm(char **paths, char sw, options *opts){
+
+    /* Declaration and initialization of variables */
+    file_map map;
+    pnm_head head;
+    image *img = NULL;
+    int ret = 2;
+
+    /* Sanity check */
+    if (!paths || !opts) {
+        printf("Error in proceed_pnm!\n");
+        return FAILURE;
+    }
+
+    if (sw == 'h') {
+
+        /* The file is always patched in place (--in-place changes nothing) */
+        if (!opts->output) {
+            return hide_mapped(paths[0], paths[1], opts);
+        }
+
+        /* The picture is checked before the copy is made */
+        img = map_pnm(paths[0], &map, &head, FALSE, &ret);
+
+        if (!img) {
+            return ret;
+        }
+
+        free_image(img);
+        unmap_file(&map);
+
+        /* The copy is patched in place (no half written picture is left) */
+        ret = clone_file(paths[0], opts->output);
+
+        if (ret == FAILURE) {
+            return 6;
+        }
+
+        printf("Output: %s\n", ret == CLONE_REFLINK ? "blocks shared with the picture" : ret == CLONE_RANGE ? "copied by the kernel" : "copied");
+
+        ret = hide_mapped(opts->output, paths[1], opts);
+
+        if (ret != 0) {
+            remove(opts->output);
+        }
+
+    } else if (sw == 'x') {
+
+        /* Only the pages holding the header and the body are read */
+        img = map_pnm(paths[0], &map, &head, FALSE, &ret);
+
+        if (!img) {
+            return ret;
+        }
+
+        ret = extract_from_image(img, paths[1], opts);
+
+        free_image(img);
+        unmap_file(&map);
+
+    } else {
+
+        printf("Wrong switch\n");
+        ret = 1;
+    }
+
+    return ret;
+}
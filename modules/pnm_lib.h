@@ -0,0 +1,85 @@
+/* PNM_LIB.H */
+
+/* Inclusion guard */
+#ifndef __PNM_LIB_H__
+#define __PNM_LIB_H__
+
+#include "my_defs.h"
+#include "input.h"
+#include "image.h"
+#include "file_map.h"
+
+
+/* Defines */
+
+/* Magic numbers of the binary PPM and of the PAM */
+#define PPM_MAGIC "P6"
+#define PAM_MAGIC "P7"
+
+/* Only 8-bit RGB samples are supported (a LSB of a smaller maxval could leave its range) */
+#define PNM_MAXVAL 255
+#define PNM_CHANNELS 3
+#define PAM_TUPLTYPE "RGB"
+
+/* Longest keyword of the PAM header and the biggest number of a header */
+#define PAM_TOKEN_SIZE 16
+#define PNM_MAX_NUMBER 1000000000L
+
+
+
+/* Structures */
+
+/* Header of the PPM / PAM file */
+typedef struct {
+
+    /* Size of the picture */
+    int width;
+    int height;
+
+    /* First byte of the pixels (right after the header) */
+    long offset;
+
+} pnm_head;
+
+
+
+/* Prototypes */
+
+/**
+ * This function parses the header of the binary PPM (P6) or the PAM (P7) picture.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param head Header to be filled
+ *
+ * @return SUCCESS or FAILURE (also if the picture is not 8-bit RGB or the pixels are missing)
+*/
+int parse_pnm(const byte *data, long size, pnm_head *head);
+
+
+/**
+ * This function maps the PPM / PAM file, the image is a view of the mapped pixels (no copy is made).
+ *
+ * @param path Path to the file
+ * @param map Map to be filled (unmapped by the caller after the image is freed)
+ * @param head Header to be filled
+ * @param writable TRUE to change the file through the image
+ * @param code Set to 1 if the file cannot be opened, 2 if it is not in correct format, 6 otherwise
+ *
+ * @return Image or NULL if error
+*/
+image *map_pnm(char *path, file_map *map, pnm_head *head, int writable, int *code);
+
+
+/**
+ * This function will hide / extract data in / from PPM or PAM file
+ *
+ * @param paths Array of paths to files
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 success, 1 the picture cannot be opened, 2 not in correct format, 3 image too small, 4 no hidden content, 5 damagged file, 6 error
+*/
+int proceed_pnm(char **paths, char sw, options *opts);
+
+#endif
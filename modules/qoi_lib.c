@@ -0,0 +1,475 @@
+/* QOI_LIB.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi_lib.h"
+#include "pixel_secrets.h"
+#include "file_map.h"
+
+
+
+/**
+ * This function reads the 32-bit big endian number.
+ *
+ * @param data First byte of the number
+ *
+ * @return Number
+*/
+static dword read_be32(const byte *data){
+
+    return ((dword)data[0] << 24) | ((dword)data[1] << 16) | ((dword)data[2] << 8) | (dword)data[3];
+}
+
+
+/**
+ * This function writes the 32-bit big endian number.
+ *
+ * @param data First byte of the number
+ * @param value Number
+ *
+ * @return void
+*/
+static void write_be32(byte *data, dword value){
+
+    data[0] = (byte)(value >> 24);
+    data[1] = (byte)(value >> 16);
+    data[2] = (byte)(value >> 8);
+    data[3] = (byte)value;
+}
+
+
+/**
+ * This function decodes the QOI picture from memory straight into the rows of the image.
+ * The chunks are read only up to the end marker, which is long enough for the longest chunk,
+ * so a chunk is checked once and a run is filled by its own loop (also across the end of a row).
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param img Pointer to the image (allocated here)
+ *
+ * @return SUCCESS or FAILURE (also if the picture is not RGB)
+*/
+int decode_qoi(const byte *data, long size, image **img){
+
+    /* Declaration and initialization of variables */
+    byte r = 0, g = 0, b = 0, a = 255, b1, b2, *px, *stop;
+    const byte *in, *end;
+    dword index[QOI_INDEX_SIZE], width, height, v;
+    int y, vg;
+    long run = 0;
+
+    /* Sanity check */
+    if (!data || !img) {
+        printf("Error in read_qoi!\n");
+        return FAILURE;
+    }
+
+    *img = NULL;
+
+    if (size < QOI_HEADER_SIZE + QOI_END_SIZE || memcmp(data, QOI_MAGIC, 4) != 0) {
+        printf("Invalid QOI file!\n");
+        return FAILURE;
+    }
+
+    width = read_be32(data + 4);
+    height = read_be32(data + 8);
+
+    if (width == 0 || height == 0 || width > QOI_MAX_PIXELS || height > QOI_MAX_PIXELS
+        || (long)width * (long)height > QOI_MAX_PIXELS || data[13] > 1) {
+        printf("Invalid QOI file!\n");
+        return FAILURE;
+    }
+
+    /* Only RGB is supported (the alpha would be lost) */
+    if (data[12] != QOI_CHANNELS) {
+        printf("Invalid QOI subformat!\nPlease use a 24-bit (RGB) QOI file.\n");
+        return FAILURE;
+    }
+
+    *img = create_image((int)width, (int)height);
+
+    if (!(*img)) {
+        printf("Error in read_qoi!\n");
+        return FAILURE;
+    }
+
+    memset(index, 0, sizeof(index));
+    in = data + QOI_HEADER_SIZE;
+    end = data + size - QOI_END_SIZE;
+
+    for (y = 0; y < (int)height; y++) {
+
+        px = IMAGE_ROW(*img, y);
+        stop = px + (long)width * QOI_CHANNELS;
+
+        while (px < stop) {
+
+            /* The rest of the run (the pixel does not change, so neither does the index) */
+            for (; run > 0 && px < stop; run--, px += QOI_CHANNELS) {
+                px[0] = r;
+                px[1] = g;
+                px[2] = b;
+            }
+
+            if (px == stop) break;
+
+            /* The chunks end before the pixels */
+            if (in >= end) {
+                printf("Invalid QOI file!\n");
+                free_image(*img);
+                *img = NULL;
+                return FAILURE;
+            }
+
+            b1 = *in++;
+
+            switch (b1 & QOI_MASK_2) {
+
+                case QOI_OP_INDEX:
+
+                    /* The pixel is already in the index */
+                    v = index[b1];
+                    r = (byte)v;
+                    g = (byte)(v >> 8);
+                    b = (byte)(v >> 16);
+                    a = (byte)(v >> 24);
+                    break;
+
+                case QOI_OP_DIFF:
+
+                    r = (byte)(r + ((b1 >> 4) & 0x03) - 2);
+                    g = (byte)(g + ((b1 >> 2) & 0x03) - 2);
+                    b = (byte)(b + (b1 & 0x03) - 2);
+                    break;
+
+                case QOI_OP_LUMA:
+
+                    b2 = *in++;
+                    vg = (b1 & 0x3F) - 32;
+                    r = (byte)(r + vg - 8 + ((b2 >> 4) & 0x0F));
+                    g = (byte)(g + vg);
+                    b = (byte)(b + vg - 8 + (b2 & 0x0F));
+                    break;
+
+                default:
+
+                    if (b1 == QOI_OP_RGB || b1 == QOI_OP_RGBA) {
+
+                        r = in[0];
+                        g = in[1];
+                        b = in[2];
+
+                        if (b1 == QOI_OP_RGBA) a = in[3];
+                        in += b1 == QOI_OP_RGBA ? 4 : 3;
+
+                    } else {
+
+                        /* The pixel repeats, it is written by the loop of the run */
+                        run = (b1 & 0x3F) + 1;
+                        continue;
+                    }
+            }
+
+            if (b1 & QOI_MASK_2) {
+                index[QOI_HASH(r, g, b, a)] = (dword)r | ((dword)g << 8) | ((dword)b << 16) | ((dword)a << 24);
+            }
+
+            px[0] = r;
+            px[1] = g;
+            px[2] = b;
+            px += QOI_CHANNELS;
+        }
+    }
+
+    (*img)->loaded = (*img)->height;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function encodes the image as a QOI picture into memory.
+ *
+ * @param img Image
+ * @param data Pointer to the encoded bytes (allocated here, freed by the caller)
+ * @param size Pointer to the count of the encoded bytes
+ *
+ * @return SUCCESS or FAILURE
+*/
+int encode_qoi(const image *img, byte **data, long *size){
+
+    /* Declaration and initialization of variables */
+    byte index[QOI_INDEX_SIZE][4], pr = 0, pg = 0, pb = 0, *out;
+    const byte *px;
+    long p = 0, last;
+    int x, y, run = 0, h, vr, vg, vb, vg_r, vg_b;
+
+    /* Sanity check */
+    if (!img || !data || !size || img->width <= 0 || img->height <= 0) {
+        printf("Error in write_qoi_file!\n");
+        return FAILURE;
+    }
+
+    /* The longest chunk of a pixel is QOI_OP_RGB (4 bytes) */
+    out = (byte *)malloc((size_t)QOI_HEADER_SIZE + (size_t)img->width * img->height * (QOI_CHANNELS + 1) + QOI_END_SIZE);
+
+    if (!out) {
+        printf("Error in write_qoi_file!\n");
+        return FAILURE;
+    }
+
+    /* Header (sRGB) */
+    memcpy(out, QOI_MAGIC, 4);
+    write_be32(out + 4, (dword)img->width);
+    write_be32(out + 8, (dword)img->height);
+    out[12] = QOI_CHANNELS;
+    out[13] = 0;
+    p = QOI_HEADER_SIZE;
+
+    memset(index, 0, sizeof(index));
+    last = (long)img->width * img->height - 1;
+
+    for (y = 0; y < img->height; y++) {
+
+        px = IMAGE_ROW(img, y);
+
+        for (x = 0; x < img->width; x++, px += 3) {
+
+            /* Runs of the previous pixel (the alpha is always 255) */
+            if (px[0] == pr && px[1] == pg && px[2] == pb) {
+
+                run++;
+
+                if (run == QOI_MAX_RUN || (long)y * img->width + x == last) {
+                    out[p++] = (byte)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+
+                continue;
+            }
+
+            if (run > 0) {
+                out[p++] = (byte)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            h = QOI_HASH(px[0], px[1], px[2], 255);
+
+            if (index[h][0] == px[0] && index[h][1] == px[1] && index[h][2] == px[2] && index[h][3] == 255) {
+
+                out[p++] = (byte)(QOI_OP_INDEX | h);
+
+            } else {
+
+                index[h][0] = px[0];
+                index[h][1] = px[1];
+                index[h][2] = px[2];
+                index[h][3] = 255;
+
+                /* Differences wrap around as signed bytes */
+                vr = (signed char)(byte)(px[0] - pr);
+                vg = (signed char)(byte)(px[1] - pg);
+                vb = (signed char)(byte)(px[2] - pb);
+                vg_r = vr - vg;
+                vg_b = vb - vg;
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+
+                    out[p++] = (byte)(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+
+                    out[p++] = (byte)(QOI_OP_LUMA | (vg + 32));
+                    out[p++] = (byte)((vg_r + 8) << 4 | (vg_b + 8));
+
+                } else {
+
+                    out[p++] = QOI_OP_RGB;
+                    out[p++] = px[0];
+                    out[p++] = px[1];
+                    out[p++] = px[2];
+                }
+            }
+
+            pr = px[0];
+            pg = px[1];
+            pb = px[2];
+        }
+    }
+
+    /* End marker */
+    memset(out + p, 0, QOI_END_SIZE - 1);
+    p += QOI_END_SIZE - 1;
+    out[p++] = 1;
+
+    *data = out;
+    *size = p;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the QOI file (the file is mapped if it can be).
+ *
+ * @param path Path to the file
+ * @param img Pointer to the image (allocated here)
+ * @param code Set to 1 if the file cannot be opened (not changed otherwise)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int read_qoi(char *path, image **img, int *code){
+
+    /* Declaration and initialization of variables */
+    FILE *fp = NULL;
+    file_map map;
+    byte *data = NULL;
+    long size = 0;
+    int ret;
+
+    /* Sanity check */
+    if (!path || !img || !code) {
+        printf("Error in read_qoi!\n");
+        return FAILURE;
+    }
+
+    fp = fopen(path, "rb");
+
+    if (!fp) {
+
+        /* WRONG PARAMETERS - 1 */
+        printf("Invalid path: %s\n", path);
+        *code = 1;
+        return FAILURE;
+    }
+
+    memset(&map, 0, sizeof(file_map));
+
+    /* The decoder reads the pages of the file, or a copy of it if it cannot be mapped */
+    if (map_stream(&map, fp) == SUCCESS) {
+
+        ret = decode_qoi(map.data, map.size, img);
+
+    } else if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0
+               && (data = (byte *)malloc((size_t)size)) && fread(data, 1, (size_t)size, fp) == (size_t)size) {
+
+        ret = decode_qoi(data, size, img);
+
+    } else {
+
+        printf("Invalid QOI file!\n");
+        ret = FAILURE;
+    }
+
+    unmap_file(&map);
+    free(data);
+    fclose(fp);
+
+    return ret;
+}
+
+
+/**
+ * This function writes the image as a QOI file (encoded into memory, then written by one call).
+ *
+ * @param filename Name of the file
+ * @param img Image
+ *
+ * @return SUCCESS or FAILURE
+*/
+int write_qoi_file(char *filename, image *img){
+
+    /* Declaration and initialization of variables */
+    FILE *fp;
+    byte *data = NULL;
+    long size = 0;
+    int ret = SUCCESS;
+
+    /* Sanity check */
+    if (!filename || !img) {
+        printf("Error in write_qoi_file!\n");
+        return FAILURE;
+    }
+
+    if (encode_qoi(img, &data, &size) == FAILURE) {
+        return FAILURE;
+    }
+
+    fp = fopen(filename, "wb");
+
+    if (!fp || fwrite(data, 1, (size_t)size, fp) != (size_t)size) {
+        printf("Error in write_qoi_file!\n");
+        ret = FAILURE;
+    }
+
+    if (fp && fclose(fp) != 0 && ret == SUCCESS) {
+        printf("Error in write_qoi_file!\n");
+        ret = FAILURE;
+    }
+
+    free(data);
+
+    return ret;
+}
+
+
+/**
+ * This function will hide / extract the payload in / from the QOI file.
+ *
+ * @param paths Array of paths
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 if success, 1 the picture cannot be opened, 2 not in correct format, 3 if picture is not big enough,
+ *         4 no hidden content, 5 damagged content, 6 different errror
+*/
+int proceed_qoi(char **paths, char sw, options *opts){
+
+    /* Declaration and initialization of variables */
+    image *img = NULL;
+    int ret = 2;
+
+    /* Sanity check */
+    if (!paths || !opts) {
+        printf("Error in proceed_qoi!\n");
+        return FAILURE;
+    }
+
+    /* Not a 24-bit QOI - not in correct format (or the file cannot be opened) */
+    if (read_qoi(paths[0], &img, &ret) == FAILURE) {
+        return ret;
+    }
+
+    if (sw == 'h') {
+
+        /* The same payload is already hidden, nothing to compress, embed or write (unless a new file is wanted) */
+        if (!opts->output && payload_hidden(img, paths[1], opts)) {
+
+            printf("Payload is already hidden in the picture!\n");
+            free_image(img);
+            return 0;
+        }
+
+        ret = hide_in_image(img, paths[1], opts);
+
+        /* Nothing changed (--delta), the file stays as it is */
+        if (ret == 0 && (count_dirty(img) != 0 || opts->output)
+            && write_qoi_file(opts->output ? opts->output : paths[0], img) == FAILURE) {
+            ret = 6;
+        }
+
+    } else if (sw == 'x') {
+
+        ret = extract_from_image(img, paths[1], opts);
+
+    } else {
+
+        printf("Wrong switch\n");
+        ret = 1;
+    }
+
+    free_image(img);
+
+    return ret;
+}
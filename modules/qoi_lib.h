@@ -0,0 +1,103 @@
+/* QOI_LIB.H */
+
+/* Inclusion guard */
+#ifndef __QOI_LIB_H__
+#define __QOI_LIB_H__
+
+#include "my_defs.h"
+#include "input.h"
+#include "image.h"
+
+
+/* Defines */
+
+/* Header (magic, width, height, channels, colorspace) and the end marker (7 zero bytes and 1) */
+#define QOI_MAGIC "qoif"
+#define QOI_HEADER_SIZE 14
+#define QOI_END_SIZE 8
+
+/* Channels of the written file (RGB, the alpha is always 255) */
+#define QOI_CHANNELS 3
+
+/* Chunks of the stream (the 2-bit tags and the 8-bit tags) */
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+#define QOI_OP_RGBA 0xFF
+#define QOI_MASK_2 0xC0
+
+/* Previously seen pixels indexed by the hash, the longest run */
+#define QOI_INDEX_SIZE 64
+#define QOI_MAX_RUN 62
+
+/* Index of the pixel in the table of the seen pixels */
+#define QOI_HASH(r, g, b, a) (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) % QOI_INDEX_SIZE)
+
+/* Largest picture which is read (the limit of the reference decoder) */
+#define QOI_MAX_PIXELS 400000000L
+
+
+
+/* Prototypes */
+
+/**
+ * This function decodes the QOI picture from memory.
+ *
+ * @param data Bytes of the file
+ * @param size Count of the bytes
+ * @param img Pointer to the image (allocated here)
+ *
+ * @return SUCCESS or FAILURE (also if the picture is not RGB)
+*/
+int decode_qoi(const byte *data, long size, image **img);
+
+
+/**
+ * This function encodes the image as a QOI picture into memory.
+ *
+ * @param img Image
+ * @param data Pointer to the encoded bytes (allocated here, freed by the caller)
+ * @param size Pointer to the count of the encoded bytes
+ *
+ * @return SUCCESS or FAILURE
+*/
+int encode_qoi(const image *img, byte **data, long *size);
+
+
+/**
+ * This function reads the QOI file (the file is mapped if it can be).
+ *
+ * @param path Path to the file
+ * @param img Pointer to the image (allocated here)
+ * @param code Set to 1 if the file cannot be opened (not changed otherwise)
+ *
+ * @return SUCCESS or FAILURE
+*/
+int read_qoi(char *path, image **img, int *code);
+
+
+/**
+ * This function writes the image as a QOI file (encoded into memory, then written by one call).
+ *
+ * @param filename Name of the file
+ * @param img Image
+ *
+ * @return SUCCESS or FAILURE
+*/
+int write_qoi_file(char *filename, image *img);
+
+
+/**
+ * This function will hide / extract data in / from QOI file
+ *
+ * @param paths Array of paths to files
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 success, 1 the picture cannot be opened, 2 not in correct format, 3 image too small, 4 no hidden content, 5 damagged file, 6 error
+*/
+int proceed_qoi(char **paths, char sw, options *opts);
+
+#endif
@@ -0,0 +1,111 @@
+/* SPREAD.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "spread.h"
+
+
+/**
+ * This function mixes the half of the network with the key of the round.
+ * 
+ * @param x Half of the network
+ * @param key Key of the round
+ * 
+ * @return Mixed value
+*/
+static dword spread_round(dword x, dword key){
+
+    /* Finalizer of MurmurHash3 */
+    x ^= key;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+
+    return x;
+}
+
+
+/**
+ * This function derives the permutation from the key.
+ * (It hides the order of the bits, it is not a cipher)
+ * 
+ * @param sp Permutation to be filled
+ * @param key Key (text)
+ * @param domain Count of permuted indexes
+ * 
+ * @return SUCCESS or FAILURE if the domain is too big
+*/
+int make_spread(spread *sp, const char *key, unsigned long domain){
+
+    /* Declaration and initialization of variables */
+    unsigned long long hash = 0xCBF29CE484222325ULL, z;
+    int i;
+
+    /* Sanity check */
+    if (!sp || !key || domain == 0 || domain > SPREAD_MAX_DOMAIN) {
+        printf("Error in make_spread!\n");
+        return FAILURE;
+    }
+
+    sp->domain = domain;
+
+    /* The smallest even count of bits which covers the domain */
+    for (sp->half = 1; sp->half < 16 && (1ULL << (2 * sp->half)) < domain; sp->half++);
+    sp->mask = (dword)((1ULL << sp->half) - 1);
+
+    /* FNV-1a of the key (the domain is mixed in too, so every picture gets its own order) */
+    for (; *key; key++) {
+        hash = (hash ^ (byte)*key) * 0x100000001B3ULL;
+    }
+    hash ^= domain;
+
+    /* Keys of the rounds (SplitMix64) */
+    for (i = 0; i < SPREAD_ROUNDS; i++) {
+
+        hash += 0x9E3779B97F4A7C15ULL;
+        z = hash;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        sp->keys[i] = (dword)(z ^ (z >> 31));
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function returns the position of the index in the permutation.
+ * 
+ * @param sp Permutation
+ * @param index Index (less than the domain)
+ * 
+ * @return Permuted index (less than the domain)
+*/
+dword spread_forward(const spread *sp, dword index){
+
+    /* Declaration and initialization of variables */
+    unsigned long long x = index;
+    dword l, r, t;
+    int i;
+
+    /* Cycle walking: the network permutes 4^half indexes, walk until the result is in the domain */
+    do {
+
+        l = (dword)(x >> sp->half);
+        r = (dword)x & sp->mask;
+
+        for (i = 0; i < SPREAD_ROUNDS; i++) {
+
+            t = r;
+            r = l ^ (spread_round(r, sp->keys[i]) & sp->mask);
+            l = t;
+        }
+
+        x = ((unsigned long long)l << sp->half) | r;
+
+    } while (x >= sp->domain);
+
+    return (dword)x;
+}
@@ -0,0 +1,64 @@
+/* SPREAD.H */
+
+/* Inclusion guard */
+#ifndef __SPREAD_H__
+#define __SPREAD_H__
+
+#include "my_defs.h"
+
+
+/* Defines */
+
+/* Rounds of the Feistel network (4 rounds make a pseudo-random permutation) */
+#define SPREAD_ROUNDS 4
+
+/* Biggest domain of the permutation (both halves fit in a dword) */
+#define SPREAD_MAX_DOMAIN 0xFFFFFFFFUL
+
+
+/* Structures */
+
+/* Keyed permutation of 0 .. domain - 1 (Feistel network with cycle walking) */
+typedef struct {
+
+    /* Count of permuted indexes */
+    unsigned long domain;
+
+    /* Bits of one half of the network and their mask */
+    int half;
+    dword mask;
+
+    /* Keys of the rounds */
+    dword keys[SPREAD_ROUNDS];
+
+} spread;
+
+
+
+/* Prototypes */
+
+/**
+ * This function derives the permutation from the key.
+ * (It hides the order of the bits, it is not a cipher)
+ * 
+ * @param sp Permutation to be filled
+ * @param key Key (text)
+ * @param domain Count of permuted indexes
+ * 
+ * @return SUCCESS or FAILURE if the domain is too big
+*/
+int make_spread(spread *sp, const char *key, unsigned long domain);
+
+
+/**
+ * This function returns the position of the index in the permutation.
+ * 
+ * @param sp Permutation
+ * @param index Index (less than the domain)
+ * 
+ * @return Permuted index (less than the domain)
+*/
+dword spread_forward(const spread *sp, dword index);
+
+
+#endif
@@ -0,0 +1,491 @@
+/* Y4M_LIB.C */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "y4m_lib.h"
+#include "image.h"
+#include "file_map.h"
+#include "pixel_secrets.h"
+
+
+
+/**
+ * This function reads one header line (of the stream or of a frame).
+ *
+ * @param fp Opened video
+ * @param line Buffer of Y4M_LINE_SIZE bytes (the line is ended by a zero)
+ * @param length Pointer to the bytes of the line with its end, 0 if the video ends before the line
+ *
+ * @return SUCCESS or FAILURE if the line is too long or cut
+*/
+static int read_line(FILE *fp, char *line, int *length){
+
+    /* Declaration and initialization of variables */
+    int c, n = 0;
+
+    while ((c = getc(fp)) != EOF) {
+
+        if (n == Y4M_LINE_SIZE - 1) {
+            return FAILURE;
+        }
+
+        line[n++] = (char)c;
+
+        if (c == '\n') {
+            line[n] = '\0';
+            *length = n;
+            return SUCCESS;
+        }
+    }
+
+    *length = 0;
+
+    return n == 0 ? SUCCESS : FAILURE;
+}
+
+
+/**
+ * This function reads and parses the stream header of the Y4M video (8-bit 420, 422, 444, 411, mono or 444alpha).
+ *
+ * @param fp Opened video (at its first byte)
+ * @param head Header to be filled
+ *
+ * @return SUCCESS or FAILURE
+*/
+int read_y4m_head(FILE *fp, y4m_head *head){
+
+    /* Declaration and initialization of variables */
+    char params[Y4M_LINE_SIZE], *token, *end, *colorspace = "420";
+    long width = 0, height = 0;
+
+    /* Sanity check */
+    if (!fp || !head) {
+        printf("Error in read_y4m_head!\n");
+        return FAILURE;
+    }
+
+    if (read_line(fp, head->line, &head->length) == FAILURE || head->length == 0
+        || strncmp(head->line, Y4M_MAGIC, strlen(Y4M_MAGIC)) != 0) {
+        printf("Invalid Y4M file!\n");
+        return FAILURE;
+    }
+
+    /* Parameters separated by spaces (only the size and the colorspace matter, the rest is copied) */
+    strcpy(params, head->line + strlen(Y4M_MAGIC));
+    params[strcspn(params, "\n")] = '\0';
+
+    for (token = strtok(params, " "); token; token = strtok(NULL, " ")) {
+
+        if (token[0] == 'W') {
+
+            width = strtol(token + 1, &end, 10);
+            if (*end) width = 0;
+
+        } else if (token[0] == 'H') {
+
+            height = strtol(token + 1, &end, 10);
+            if (*end) height = 0;
+
+        } else if (token[0] == 'C') {
+
+            colorspace = token + 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0 || width > Y4M_MAX_SIZE || height > Y4M_MAX_SIZE) {
+        printf("Invalid Y4M file!\n");
+        return FAILURE;
+    }
+
+    head->width = (int)width;
+    head->height = (int)height;
+    head->planes = 3;
+
+    /* Subsampling of the chroma planes (8-bit samples only) */
+    if (strcmp(colorspace, "420") == 0 || strcmp(colorspace, "420jpeg") == 0
+        || strcmp(colorspace, "420paldv") == 0 || strcmp(colorspace, "420mpeg2") == 0) {
+
+        head->chroma_width = (head->width + 1) / 2;
+        head->chroma_height = (head->height + 1) / 2;
+
+    } else if (strcmp(colorspace, "422") == 0) {
+
+        head->chroma_width = (head->width + 1) / 2;
+        head->chroma_height = head->height;
+
+    } else if (strcmp(colorspace, "444") == 0 || strcmp(colorspace, "444alpha") == 0) {
+
+        head->chroma_width = head->width;
+        head->chroma_height = head->height;
+        if (colorspace[3]) head->planes = Y4M_MAX_PLANES;
+
+    } else if (strcmp(colorspace, "411") == 0) {
+
+        head->chroma_width = (head->width + 3) / 4;
+        head->chroma_height = head->height;
+
+    } else if (strcmp(colorspace, "mono") == 0) {
+
+        head->chroma_width = head->chroma_height = 0;
+        head->planes = 1;
+
+    } else {
+
+        printf("Invalid Y4M subformat!\nPlease use an 8-bit Y4M video.\n");
+        return FAILURE;
+    }
+
+    head->frame_size = (long)head->width * head->height
+                       + (head->planes > 1 ? 2L * head->chroma_width * head->chroma_height : 0)
+                       + (head->planes == Y4M_MAX_PLANES ? (long)head->width * head->height : 0);
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function returns the plane of the frame which carries the payload.
+ *
+ * @param head Header of the video
+ * @param plane PLANE_Y, PLANE_U or PLANE_V
+ * @param offset Pointer to the first byte of the plane in the frame
+ * @param width Pointer to the samples of a row of the plane
+ * @param height Pointer to the rows of the plane
+ *
+ * @return SUCCESS or FAILURE if the video has no such plane
+*/
+int y4m_plane(const y4m_head *head, int plane, long *offset, int *width, int *height){
+
+    /* Sanity check */
+    if (!head || !offset || !width || !height) {
+        printf("Error in y4m_plane!\n");
+        return FAILURE;
+    }
+
+    if (plane == PLANE_Y) {
+
+        *offset = 0;
+        *width = head->width;
+        *height = head->height;
+
+        return SUCCESS;
+    }
+
+    if (head->planes == 1) {
+        return FAILURE;
+    }
+
+    /* U follows Y, V follows U */
+    *offset = (long)head->width * head->height + (plane == PLANE_V ? (long)head->chroma_width * head->chroma_height : 0);
+    *width = head->chroma_width;
+    *height = head->chroma_height;
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function reads the header and the planes of the next frame.
+ *
+ * @param fp Opened video
+ * @param head Header of the video
+ * @param line Buffer of Y4M_LINE_SIZE bytes for the frame header
+ * @param length Pointer to the bytes of the frame header, 0 if the video ends
+ * @param frame Buffer of frame_size bytes for the planes
+ *
+ * @return SUCCESS or FAILURE if the frame is not valid or cut
+*/
+static int read_frame(FILE *fp, const y4m_head *head, char *line, int *length, byte *frame){
+
+    if (read_line(fp, line, length) == FAILURE
+        || (*length > 0 && (strncmp(line, Y4M_FRAME, strlen(Y4M_FRAME)) != 0
+                            || fread(frame, 1, (size_t)head->frame_size, fp) != (size_t)head->frame_size))) {
+
+        printf("Invalid Y4M frame!\n");
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * This function hides the payload in the frames of the video (one frame in memory).
+ * The rows of the plane of every frame follow the rows of the frame before, so the payload is split across the frames
+ * and written by the windowed bitstream writer of the hide; the frames after the payload are copied as they are.
+ *
+ * @param in Opened video (after the stream header)
+ * @param out Video to be written
+ * @param head Header of the video
+ * @param payload_path Path to the payload
+ * @param opts Options (layout of the bits and the plane)
+ *
+ * @return 0 if success, 1 if the payload cannot be read, 2 if a frame is not valid, 3 if the video is too short, 6 different error
+*/
+static int hide_frames(FILE *in, FILE *out, const y4m_head *head, char *payload_path, options *opts){
+
+    /* Declaration and initialization of variables */
+    char line[Y4M_LINE_SIZE];
+    hide_plan plan;
+    image *win = NULL;
+    byte *frame = NULL;
+    long offset = 0, first, rows;
+    int width = 0, height = 0, length = 0, ret;
+    size_t n;
+
+    y4m_plane(head, opts->plane, &offset, &width, &height);
+
+    /* The tall picture has as many frames as the rows of an int can count */
+    ret = make_hide_plan(&plan, payload_path, opts, width / Y4M_SAMPLES_PER_PIXEL, INT_MAX / height * height);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    rows = plan_rows(&plan);
+    frame = (byte *)malloc((size_t)head->frame_size);
+    win = frame ? wrap_image(width / Y4M_SAMPLES_PER_PIXEL, height, frame + offset, width) : NULL;
+
+    if (!win || fwrite(head->line, 1, (size_t)head->length, out) != (size_t)head->length) {
+        printf("Error in hide_frames!\n");
+        ret = 6;
+    }
+
+    /* Frames which carry the payload */
+    for (first = 0; ret == 0 && first < rows; first += height) {
+
+        if (read_frame(in, head, line, &length, frame) == FAILURE) {
+            ret = 2;
+            break;
+        }
+
+        if (length == 0) {
+            printf("Data is too big to hide in this video!\nPlease choose a longer video!\n");
+            ret = 3;
+            break;
+        }
+
+        plan_write_window(&plan, win, (int)first, height);
+
+        if (fwrite(line, 1, (size_t)length, out) != (size_t)length
+            || fwrite(frame, 1, (size_t)head->frame_size, out) != (size_t)head->frame_size) {
+            printf("Error in hide_frames!\n");
+            ret = 6;
+        }
+    }
+
+    /* The rest of the video is copied as it is */
+    while (ret == 0 && (n = fread(frame, 1, (size_t)head->frame_size, in)) > 0) {
+
+        if (fwrite(frame, 1, n, out) != n) {
+            printf("Error in hide_frames!\n");
+            ret = 6;
+        }
+    }
+
+    if (ret == 0 && ferror(in)) {
+        printf("Error in hide_frames!\n");
+        ret = 6;
+    }
+
+    if (ret == 0) {
+        printf("Data hidden successfully!\n");
+        printf("Frames: %ld carry the payload\n", (rows + height - 1) / height);
+    }
+
+    if (win) free_image(win);
+    free(frame);
+    free_hide_plan(&plan);
+
+    return ret;
+}
+
+
+/**
+ * This function extracts the payload from the frames of the video (one frame in memory, the frames after the payload are not read).
+ *
+ * @param in Opened video (after the stream header)
+ * @param head Header of the video
+ * @param to Path to the file where the payload will be written
+ * @param opts Options (the plane)
+ *
+ * @return 0 if success, 2 if a frame is not valid, 4 no hidden content, 5 damaged content, 6 different error
+*/
+static int extract_frames(FILE *in, const y4m_head *head, char *to, options *opts){
+
+    /* Declaration and initialization of variables */
+    char line[Y4M_LINE_SIZE];
+    extract_plan plan;
+    image *win = NULL;
+    byte *frame = NULL;
+    long offset = 0, first;
+    int width = 0, height = 0, length = 0, ret = 0;
+
+    y4m_plane(head, opts->plane, &offset, &width, &height);
+
+    if (make_extract_plan(&plan, width / Y4M_SAMPLES_PER_PIXEL) == FAILURE) {
+        return 6;
+    }
+
+    frame = (byte *)malloc((size_t)head->frame_size);
+    win = frame ? wrap_image(width / Y4M_SAMPLES_PER_PIXEL, height, frame + offset, width) : NULL;
+
+    if (!win) {
+        printf("Error in extract_frames!\n");
+        ret = 6;
+    }
+
+    for (first = 0; ret == 0 && !plan.done && first <= INT_MAX - height; first += height) {
+
+        if (read_frame(in, head, line, &length, frame) == FAILURE) {
+            ret = 2;
+            break;
+        }
+
+        if (length == 0) {
+            break;
+        }
+
+        ret = plan_extract_window(&plan, win, (int)first, height);
+    }
+
+    if (ret == 0) {
+
+        ret = plan_extract_finish(&plan, to);
+
+    } else if (ret == 4) {
+
+        printf("No hidden content!\nTry a different video!\n");
+
+    } else if (ret == 5) {
+
+        printf("Invalid size!\nContent damaged!\n");
+    }
+
+    if (win) free_image(win);
+    free(frame);
+    free_extract_plan(&plan);
+
+    return ret;
+}
+
+
+/**
+ * This function will hide / extract the payload in / from the Y4M video.
+ * The video is read from the standard input if its path is -, a hidden video goes to the standard output
+ * (then the messages go to the standard error) if the video is read from it or if the output is -.
+ *
+ * @param paths Array of paths
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 if success, 1 the video cannot be opened, 2 not in correct format, 3 if video is not long enough,
+ *         4 no hidden content, 5 damagged content, 6 different errror
+*/
+int proceed_y4m(char **paths, char sw, options *opts){
+
+    /* Declaration and initialization of variables */
+    FILE *in = NULL, *out = NULL;
+    char *target, *part = NULL;
+    y4m_head head;
+    long offset;
+    int width, height, to_stdout, ret;
+
+    /* Sanity check */
+    if (!paths || !opts) {
+        printf("Error in proceed_y4m!\n");
+        return FAILURE;
+    }
+
+    if (sw != 'h' && sw != 'x') {
+        printf("Wrong switch\n");
+        return 1;
+    }
+
+    target = opts->output ? opts->output : paths[0];
+    to_stdout = sw == 'h' && strcmp(target, STDIO_PATH) == 0;
+
+    /* The messages must not get into the video */
+    if (to_stdout && !(out = data_stdout())) {
+        return 6;
+    }
+
+    /* Every frame is written before the next one is read */
+    if (sw == 'h' && (opts->key || opts->matrix != MATRIX_OFF)) {
+        printf("A Y4M video is hidden frame by frame, it cannot be used with --key or --matrix!\n");
+        if (out) fclose(out);
+        return 1;
+    }
+
+    in = strcmp(paths[0], STDIO_PATH) == 0 ? data_stdin() : fopen(paths[0], "rb");
+
+    if (!in) {
+
+        /* WRONG PARAMETERS - 1 */
+        printf("Invalid path: %s\n", paths[0]);
+        if (out) fclose(out);
+        return 1;
+    }
+
+    /* Not an 8-bit Y4M, or the plane is missing (mono) or too narrow - not in correct format */
+    ret = 2;
+
+    if (read_y4m_head(in, &head) == FAILURE) {
+
+        if (in != stdin) fclose(in);
+        if (out) fclose(out);
+        return ret;
+    }
+
+    if (y4m_plane(&head, opts->plane, &offset, &width, &height) == FAILURE || width < Y4M_SAMPLES_PER_PIXEL) {
+
+        printf("The plane of the video is missing or narrower than %d samples!\n", Y4M_SAMPLES_PER_PIXEL);
+        if (in != stdin) fclose(in);
+        if (out) fclose(out);
+        return ret;
+    }
+
+    if (sw == 'x') {
+
+        ret = extract_frames(in, &head, paths[1], opts);
+
+    } else {
+
+        /* A file is written next to the target and replaces it when the video is complete */
+        if (!to_stdout) {
+
+            part = part_path(target);
+            out = part ? fopen(part, "wb") : NULL;
+        }
+
+        ret = out ? hide_frames(in, out, &head, paths[1], opts) : 6;
+
+        if (out && fclose(out) != 0 && ret == 0) {
+            printf("Error in proceed_y4m!\n");
+            ret = 6;
+        }
+
+        if (part && out) {
+
+            if (ret == 0) {
+                if (replace_file(part, target) == FAILURE) ret = 6;
+            } else {
+                remove(part);
+            }
+        }
+
+        if (!out) {
+            printf("Error in proceed_y4m!\n");
+        }
+
+        free(part);
+    }
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return ret;
+}
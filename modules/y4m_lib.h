@@ -0,0 +1,97 @@
+/* Y4M_LIB.H */
+
+/* Inclusion guard */
+#ifndef __Y4M_LIB_H__
+#define __Y4M_LIB_H__
+
+#include <stdio.h>
+#include "my_defs.h"
+#include "input.h"
+
+
+/* Defines */
+
+/* Start of the stream header and of the header of every frame */
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_FRAME "FRAME"
+
+/* Longest header line (the parameters are copied as they are) */
+#define Y4M_LINE_SIZE 4096
+
+/* Biggest width and height of a frame */
+#define Y4M_MAX_SIZE 65536L
+
+/* Planes of a frame (Y, U, V and the alpha of 444alpha) */
+#define Y4M_MAX_PLANES 4
+
+/* Samples of the plane which make one pixel of the layout (its r, g and b) */
+#define Y4M_SAMPLES_PER_PIXEL 3
+
+
+
+/* Structures */
+
+/* Stream header of the Y4M video */
+typedef struct {
+
+    /* Size of the frame (of the Y plane) */
+    int width;
+    int height;
+
+    /* Size of the U and V planes */
+    int chroma_width;
+    int chroma_height;
+
+    /* Count of planes of a frame (1 for mono) */
+    int planes;
+
+    /* Bytes of the planes of one frame */
+    long frame_size;
+
+    /* Header line as it was read (with the line end) */
+    char line[Y4M_LINE_SIZE];
+    int length;
+
+} y4m_head;
+
+
+
+/* Prototypes */
+
+/**
+ * This function reads and parses the stream header of the Y4M video (8-bit 420, 422, 444, 411, mono or 444alpha).
+ *
+ * @param fp Opened video (at its first byte)
+ * @param head Header to be filled
+ *
+ * @return SUCCESS or FAILURE
+*/
+int read_y4m_head(FILE *fp, y4m_head *head);
+
+
+/**
+ * This function returns the plane of the frame which carries the payload.
+ *
+ * @param head Header of the video
+ * @param plane PLANE_Y, PLANE_U or PLANE_V
+ * @param offset Pointer to the first byte of the plane in the frame
+ * @param width Pointer to the samples of a row of the plane
+ * @param height Pointer to the rows of the plane
+ *
+ * @return SUCCESS or FAILURE if the video has no such plane
+*/
+int y4m_plane(const y4m_head *head, int plane, long *offset, int *width, int *height);
+
+
+/**
+ * This function will hide / extract data in / from Y4M video, frame by frame (also from the standard input to the standard output)
+ *
+ * @param paths Array of paths to files
+ * @param sw Switch
+ * @param opts Options
+ *
+ * @return 0 success, 1 the video cannot be opened, 2 not in correct format, 3 video too short, 4 no hidden content, 5 damagged file, 6 error
+*/
+int proceed_y4m(char **paths, char sw, options *opts);
+
+#endif
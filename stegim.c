@@ -4,7 +4,11 @@
 #include "modules/input.h"
 #include "modules/bmp_lib.h"
 #include "modules/png_lib.h"
+#include "modules/qoi_lib.h"
+#include "modules/pnm_lib.h"
+#include "modules/y4m_lib.h"
 #include "modules/pixel_secrets.h"
+#include "modules/cpu_dispatch.h"
 #include "modules/my_defs.h"
 
 
@@ -20,9 +24,10 @@ int main(int argc, char *argv[]){
 	/* Declaration of variables */
 	char sw, **paths;
 	int exit_code = 0;
+	options opts;
 
 	/* Check if the number of arguments is valid and paths are valid */
-	paths = get_files(argc, argv, &sw);
+	paths = get_files(argc, argv, &sw, &opts);
 
 	/* Check if everything is ok */
 	if (!paths) {
@@ -31,20 +36,60 @@ int main(int argc, char *argv[]){
 		return 1;
 	}
 
+	/* Select the kernels once for the whole run */
+	if (init_kernels(opts.tier) == FAILURE) {
 
-	/* Check if the picture is bmp or png */
+		free(paths[0]);
+		free(paths[1]);
+		free(paths);
+
+		/* WRONG PARAMETERS 1*/
+		return 1;
+	}
+
+
+	/* Check if the picture is bmp, png, qoi, ppm / pam or a y4m video */
 	exit_code = check_picture(paths[0]);
 
+	/* An option the format cannot honour is refused before anything is written */
+	if (exit_code != FAILURE && sw == 'h' && check_hide_options(exit_code, &opts) == FAILURE) {
+
+		free(paths[0]);
+		free(paths[1]);
+		free(paths);
+
+		/* WRONG PARAMETERS 1*/
+		return 1;
+	}
+
 	switch (exit_code) {
 		case BMP: {
 			/* BMP */
-			exit_code = proceed_bmp(paths, sw);
+			exit_code = proceed_bmp(paths, sw, &opts);
 			break;
 		}
 		case PNG: {
 			
 			/* PNG */
-			exit_code = proceed_png(paths, sw);
+			exit_code = proceed_png(paths, sw, &opts);
+			break;
+		}
+		case QOI: {
+
+			/* QOI */
+			exit_code = proceed_qoi(paths, sw, &opts);
+			break;
+		}
+		case PNM: {
+
+			/* PPM / PAM */
+			exit_code = proceed_pnm(paths, sw, &opts);
+			break;
+		}
+		case Y4M: {
+
+			/* Y4M (also piped) */
+			exit_code = proceed_y4m(paths, sw, &opts);
 			break;
 		}
 		case FAILURE: {